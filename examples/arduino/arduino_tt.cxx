@@ -52,6 +52,7 @@
 #define RESET_BUTTON 6          ///< Reset button pin
 #define LED_PULSE_LEN_MS 50     ///< LED pulse duration in ms
 #define DEBOUNCE_TIME_MS 200    ///< Debounce time necessary for button
+#define TEMPO_HYSTERESIS 0.5f   ///< Smallest tempo change in BPM that is printed
 
 // Button states
 #define PRESSED false           ///< Pull-Up, pressed button yields a low state
@@ -110,11 +111,26 @@ void handle_led(async_pulse_led *led) {
 
 // Main
 
-tempo_tapper *tt;
+tempo_tapper tt;        // Statically allocated, avoids heap fragmentation
 async_pulse_led *led;
 
 bool tap_btn_prev, rst_btn_prev;
-unsigned long tstamp;
+tt_time_t beat;         // Clock time of the next predicted beat
+bool beat_valid;        // A beat has been predicted
+bool predict;           // The tempo tapper has been tapped since the beat has been predicted
+
+// Called by the tempo tapper once the tempo has moved by more than TEMPO_HYSTERESIS, or on resets
+void report_tempo(tempo_tapper *, tt_event event, BPM_t bpm, void *)
+{
+        if (event == TT_EVENT_RESET) {
+                Serial.println("Reset!");
+                return;
+        }
+
+        Serial.print("Tempo: ");
+        Serial.print(bpm);
+        Serial.println(" BPM");
+}
 
 void setup()
 {
@@ -124,13 +140,8 @@ void setup()
 
         Serial.begin(9600);
 
-        tt = tt_new();      // Initialize tempo tapper
-
-        // Check if malloc failed
-        if (tt == NULL) {
-                // HANDLE ERORR HERE...
-                exit(EXIT_FAILURE);
-        }
+        tt_init(&tt);       // Initialize tempo tapper
+        tt_observe(&tt, TEMPO_HYSTERESIS, report_tempo, NULL); // Print tempo changes and resets
 
         led = new_apl(LED); // Initialize struct to asynchronously control internal LED
 
@@ -148,27 +159,34 @@ void loop()
         // Check for tap
         bool pressed = CHECK_BTN_PRESSED(tap_btn_prev, tap_btn);
         if (pressed) {
-                tt_tap(tt);                                 // Register tap
-                tstamp = micros();                          // Tempo period starts here
+                tt_tap(&tt);                                 // Register tap, calls report_tempo() if the tempo has changed
                 start_led_pulse(led, LED_PULSE_LEN_MS);     // Start LED pulse
-                Serial.println("Tempo: " + String(tt_bpm(tt)) + " BPM");
+                predict = true;                             // Re-predict the beats
                 DEBOUNCE();                                 // Debounce the button
         }
         
         // Check for reset
         pressed = CHECK_BTN_PRESSED(rst_btn_prev, rst_btn);
         if (pressed) {
-                tt_reset(tt);          // Reset tempo tapper
+                tt_reset(&tt);          // Reset tempo tapper, calls report_tempo()
                 cancel_led_pulse(led); // Abort any ongoing LED pulse
-                Serial.println("Reset!");
+                beat_valid = false;    // Stop pulsing
+                predict = false;
                 DEBOUNCE();            // Debounce the button
         }
 
-        // Pulse LED at the current tempo
-        unsigned long period = tt_period_us(tt);
-        if (period > 0 && micros() - tstamp >= period) {
-                tstamp = micros();
-                start_led_pulse(led, LED_PULSE_LEN_MS); // Start LED pulse
+        // Pulse LED on the predicted beats
+        tt_time_t now;
+        current_time(&now); // Also keeps track of micros() wraps, as it is read on every loop
+
+        if (predict) {
+                predict = false;
+                beat_valid = tt_next_beat_time(&tt, &now, &beat) == 0; // Re-predict once the tempo tapper has been tapped
+        }
+
+        if (beat_valid && (int64_t) (now - beat) >= 0) {
+                start_led_pulse(led, LED_PULSE_LEN_MS);     // Start LED pulse
+                tt_next_beat_time(&tt, &now, &beat);        // Deadline of the following beat
         }
 
         handle_led(led); // Handle LED pulse
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file analysis_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Measures the throughput scaling and accuracy of the offline tempo analysis
+ *
+ * The following file writes a set of synthetic stereo WAV files at 44.1kHz to a
+ * temporary directory, each of kick drums on every beat and quieter hi-hats on
+ * every off-beat over background noise, at tempos spread across 70 to 180 BPM and
+ * with durations varying by a factor of four, so that the work per file is uneven.
+ * The batch is then analyzed with 1, 2, 4, ... threads up to the number of online
+ * CPUs, or up to max_threads if given, and the throughput in files per second is
+ * reported for each, along with the speedup over a single thread, the number of
+ * files whose tempo has been estimated within 1 BPM, and the number of files whose
+ * tempo has been estimated within 1 BPM of its double or half, i.e. octave errors.
+ * Threads beyond the number of online CPUs are marked as oversubscribed, as they
+ * cannot speed the batch up, so scaling can only be judged on a multi-core machine.
+ * If any file has not been estimated within 1 BPM, the program exits with 1.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/analysis_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_onset.cxx src/tempo_tapper_analysis.cxx -lpthread -o examples/posix/analysis_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/analysis_bench [files] [max_threads]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_analysis.h>
+
+#define RATE 44100
+#define CHANNELS 2
+
+static void put16(FILE *f, uint16_t v)
+{
+        fputc(v & 0xFF, f);
+        fputc(v >> 8, f);
+}
+
+static void put32(FILE *f, uint32_t v)
+{
+        put16(f, v & 0xFFFF);
+        put16(f, v >> 16);
+}
+
+// Writes a recording of kicks and hi-hats as 16 bit PCM WAV file
+static int write_wav(const char *path, double bpm, double secs)
+{
+        FILE *f = fopen(path, "wb");
+        size_t frames = (size_t) (secs * RATE);
+        uint32_t bytes = frames * CHANNELS * sizeof(int16_t);
+        double beat = 60.0 * RATE / bpm;
+
+        if (f == NULL)
+                return -1;
+
+        fwrite("RIFF", 1, 4, f);
+        put32(f, 36 + bytes);
+        fwrite("WAVEfmt ", 1, 8, f);
+        put32(f, 16);
+        put16(f, 1);
+        put16(f, CHANNELS);
+        put32(f, RATE);
+        put32(f, RATE * CHANNELS * sizeof(int16_t));
+        put16(f, CHANNELS * sizeof(int16_t));
+        put16(f, 16);
+        fwrite("data", 1, 4, f);
+        put32(f, bytes);
+
+        for (size_t i = 0; i < frames; i++) {
+                double pos = fmod((double) i, beat);
+                double off = fmod((double) i + beat / 2, beat);
+                double v = (drand48() - 0.5) * 200;
+
+                v += 20000 * exp(-pos / (0.05 * RATE)) * sin(2 * M_PI * 60 * pos / RATE);
+                v += 4000 * exp(-off / (0.01 * RATE)) * (drand48() - 0.5);
+
+                for (int c = 0; c < CHANNELS; c++)
+                        put16(f, (uint16_t) (int16_t) lrint(v));
+        }
+
+        return fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+        size_t n = argc > 1 ? atoi(argv[1]) : 32;
+        long cpus = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+        char dir[] = "/tmp/tt_analysis_XXXXXX";
+
+        if (n == 0 || cpus < 1)
+                cpus = 1;
+
+        if (mkdtemp(dir) == NULL) {
+                perror("mkdtemp");
+                return EXIT_FAILURE;
+        }
+
+        char **paths = (char **) malloc(n * sizeof(char *));
+        double *bpms = (double *) malloc(n * sizeof(double));
+        tt_analysis_result *results = (tt_analysis_result *) malloc(n * sizeof(tt_analysis_result));
+
+        if (paths == NULL || bpms == NULL || results == NULL) {
+                perror("malloc");
+                return EXIT_FAILURE;
+        }
+
+        srand48(1);
+        printf("Writing %zu files to %s\n", n, dir);
+
+        for (size_t i = 0; i < n; i++) {
+                paths[i] = (char *) malloc(sizeof(dir) + 16);
+                sprintf(paths[i], "%s/%04zu.wav", dir, i);
+
+                // Tempos and durations are spread across the batch
+                bpms[i] = 70 + 110.0 * ((i * 7) % n) / n;
+
+                if (write_wav(paths[i], bpms[i], 15 + 45.0 * ((i * 3) % n) / n) != 0) {
+                        perror(paths[i]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        size_t missed = 0;
+        double base = 0;
+
+        printf("\n%ld online CPUs", online);
+
+        if (online < 2)
+                printf(", so the speedup of more threads cannot be measured");
+
+        printf("\n\n%8s %10s %8s %10s %10s\n", "threads", "files/s", "speedup", "accurate", "octave");
+
+        for (long threads = 1; threads <= cpus; threads *= 2) {
+                tt_time_t start, end;
+
+                current_time(&start);
+                tt_analyze_batch(paths, n, threads, NULL, results);
+                current_time(&end);
+
+                double secs = (double) (end - start) / (S_TO_US * TT_TICKS_PER_US);
+                double rate = n / secs;
+                size_t accurate = 0, octave = 0;
+
+                for (size_t i = 0; i < n; i++) {
+                        if (results[i].status != TT_ANALYSIS_OK)
+                                continue;
+
+                        if (fabs(results[i].bpm - bpms[i]) < 1)
+                                accurate++;
+                        else if (fabs(results[i].bpm - 2 * bpms[i]) < 1 || fabs(results[i].bpm - bpms[i] / 2) < 1)
+                                octave++;
+                }
+
+                if (threads == 1)
+                        base = rate;
+
+                printf("%8ld %10.1f %7.2fx %6zu/%zu %6zu/%zu%s\n", threads, rate, rate / base, accurate, n, octave, n,
+                       threads > online ? "  oversubscribed" : "");
+
+                if (n - accurate > missed)
+                        missed = n - accurate;
+
+                // Covers the number of CPUs if it is not a power of two
+                if (threads < cpus && threads * 2 > cpus)
+                        threads = cpus / 2;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+                unlink(paths[i]);
+                free(paths[i]);
+        }
+
+        rmdir(dir);
+        free(paths);
+        free(bpms);
+        free(results);
+
+        if (missed > 0) {
+                printf("\nFAIL: %zu of %zu files have not been estimated within 1 BPM\n", missed, n);
+                return 1;
+        }
+
+        return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file analyze_tt_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Tags WAV files with their tempo
+ *
+ * The following file estimates the tempo of a batch of 16 bit PCM WAV files on
+ * one thread per online CPU (see tempo_tapper_analysis.h) and writes the results as JSON lines,
+ * one per file, to stdout or to a results file. Progress and a summary are
+ * printed to stderr.
+ *
+ * Large catalogs can be passed trough xargs, ex:
+ * ```
+ *      $ find music/ -name '*.wav' -print0 | xargs -0 ./examples/posix/analyze_tt -o results.jsonl
+ * ```
+ * Note that xargs may split long lists into several invocations, in which case -o
+ * should be omitted and stdout appended to the results file instead.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/analyze_tt_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_onset.cxx src/tempo_tapper_analysis.cxx -lpthread -o examples/posix/analyze_tt
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/analyze_tt [-j threads] [-m min_bpm] [-M max_bpm] [-o results.jsonl] file.wav...
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_analysis.h>
+
+int main(int argc, char **argv)
+{
+        tt_analysis_cfg cfg;
+        unsigned int threads = 0;
+        const char *out_path = NULL;
+        int opt;
+
+        tt_analysis_defaults(&cfg);
+
+        while ((opt = getopt(argc, argv, "j:m:M:o:")) != -1) {
+                switch (opt) {
+                case 'j':
+                        threads = atoi(optarg);
+                        break;
+                case 'm':
+                        cfg.min_bpm = atof(optarg);
+                        break;
+                case 'M':
+                        cfg.max_bpm = atof(optarg);
+                        break;
+                case 'o':
+                        out_path = optarg;
+                        break;
+                default:
+                        fprintf(stderr, "usage: %s [-j threads] [-m min_bpm] [-M max_bpm] [-o results.jsonl] file.wav...\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        size_t n = argc - optind;
+        const char *const *paths = (const char *const *) &argv[optind];
+
+        if (n == 0) {
+                fprintf(stderr, "%s: no files given\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        tt_analysis_result *results = (tt_analysis_result *) malloc(n * sizeof(tt_analysis_result));
+        if (results == NULL) {
+                perror("malloc");
+                return EXIT_FAILURE;
+        }
+
+        FILE *out = out_path ? fopen(out_path, "w") : stdout;
+        if (out == NULL) {
+                perror(out_path);
+                return EXIT_FAILURE;
+        }
+
+        tt_time_t start, end;
+        current_time(&start);
+
+        if (tt_analyze_batch(paths, n, threads, &cfg, results) < 0) {
+                fprintf(stderr, "Failed to start the analysis\n");
+                return EXIT_FAILURE;
+        }
+
+        current_time(&end);
+
+        if (tt_analysis_write_jsonl(out, paths, results, n) < 0) {
+                perror(out_path ? out_path : "stdout");
+                return EXIT_FAILURE;
+        }
+
+        size_t ok = 0;
+        double audio = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                if (results[i].status == TT_ANALYSIS_OK)
+                        ok++;
+                audio += results[i].duration;
+        }
+
+        double secs = (double) (end - start) / (S_TO_US * TT_TICKS_PER_US);
+
+        fprintf(stderr, "%zu of %zu files analyzed in %.2fs (%.1f files/s, %.0fx real time)\n",
+                ok, n, secs, n / secs, audio / secs);
+
+        if (out != stdout)
+                fclose(out);
+
+        free(results);
+        return ok == n ? 0 : EXIT_FAILURE;
+}
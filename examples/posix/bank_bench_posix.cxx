@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file bank_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Benchmarks the tempo tapper bank against an array of tempo tappers
+ *
+ * The following file taps the same synthetic tap stream into an array of
+ * tempo tapper structs and into a tempo tapper bank with the same number of
+ * channels. It then compares the time needed to evaluate the tempo of all
+ * channels by looping over tt_period_us() and tt_bpm(), and by a single
+ * tt_bank_eval() call, and verifies that both yield identical results.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/bank_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_bank.cxx -o examples/posix/bank_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/bank_bench [channels]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_bank.h>
+
+#define TAPS 8          ///< Number of taps per channel
+#define ROUNDS 100      ///< Number of timed evaluations of all channels
+
+static double elapsed_ns(tt_time_t start)
+{
+        tt_time_t end;
+        current_time(&end);
+        return (double) (end - start);
+}
+
+int main(int argc, char **argv)
+{
+        size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+
+        tempo_tapper *tts = (tempo_tapper *) malloc(n * sizeof(tempo_tapper));
+        tt_bank *bank = tt_bank_new(n);
+        unsigned long *period_us = (unsigned long *) malloc(n * sizeof(unsigned long));
+        BPM_t *bpm = (BPM_t *) malloc(n * sizeof(BPM_t));
+
+        if (tts == NULL || bank == NULL || period_us == NULL || bpm == NULL) {
+                printf("bank_bench: Allocation failed!\n");
+                return EXIT_FAILURE;
+        }
+
+        // Tap every channel at a slightly different tempo
+        srand(1);
+        for (size_t k = 0; k < n; k++) {
+                tt_init(&tts[k]);
+                tt_time_t t = rand();
+
+                for (int i = 0; i < TAPS; i++) {
+                        t += 300000000 + rand() % 200000000;
+                        tt_tap_at(&tts[k], &t);
+                        tt_bank_tap_at(bank, k, &t);
+                }
+        }
+
+        // Scalar loop over tempo tapper structs
+        volatile BPM_t sink = 0;
+        tt_time_t start;
+        current_time(&start);
+        for (int r = 0; r < ROUNDS; r++)
+                for (size_t k = 0; k < n; k++)
+                        sink = sink + tt_bpm(&tts[k]) + tt_period_us(&tts[k]);
+        double loop_ns = elapsed_ns(start) / ROUNDS;
+
+        // Single pass over the bank
+        current_time(&start);
+        for (int r = 0; r < ROUNDS; r++)
+                tt_bank_eval(bank, period_us, bpm);
+        double bank_ns = elapsed_ns(start) / ROUNDS;
+
+        size_t mismatches = 0;
+        for (size_t k = 0; k < n; k++)
+                if (period_us[k] != tt_period_us(&tts[k]) || bpm[k] != tt_bpm(&tts[k]))
+                        mismatches++;
+
+        printf("channels:       %zu\n", n);
+        printf("tt_bpm() loop:  %.2f ns/channel\n", loop_ns / n);
+        printf("tt_bank_eval(): %.2f ns/channel\n", bank_ns / n);
+        printf("speedup:        %.2fx\n", loop_ns / bank_ns);
+        printf("mismatches:     %zu\n", mismatches);
+
+        tt_bank_free(bank);
+        free(tts);
+        free(period_us);
+        free(bpm);
+        return mismatches == 0 ? 0 : EXIT_FAILURE;
+}
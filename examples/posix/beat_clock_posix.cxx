@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file beat_clock_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Drives a beat clock from taps on the terminal
+ *
+ * The following file runs a beat clock on the tempo tapped by pressing enter.
+ * Every beat prints its number, every subdivision a dot. Entering 'r' resets the
+ * tempo tapper, entering 'q' stops the beat clock and prints its wakeup lateness
+ * statistics.
+ *
+ * Alternatively, when a tempo in BPM and a duration in seconds are passed, the
+ * tempo is tapped synthetically and the beat clock runs silently for the given
+ * duration, which allows the wakeup jitter to be measured.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/beat_clock_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_conc.cxx src/tempo_tapper_clock.cxx -lpthread -o examples/posix/beat_clock
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/beat_clock [-s subdivisions] [-p SCHED_FIFO priority] [-c cpu] [bpm seconds]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_conc.h>
+#include <tempo_tapper_clock.h>
+
+static tt_conc conc;
+
+static void on_beat(const tt_beat_event *ev, void *arg)
+{
+        if (arg)
+                printf("\nBeat %llu (%.1fus late) ", (unsigned long long) ev->beat, ev->late_ns / 1000.0);
+
+        fflush(stdout);
+}
+
+static void on_sub(const tt_beat_event *ev, void *arg)
+{
+        (void) ev;
+
+        if (arg)
+                printf(".");
+
+        fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+        tt_beat_clock_cfg cfg = {};
+        tt_beat_clock clk;
+        int opt;
+
+        cfg.subdiv = 1;
+        cfg.cpu = -1;
+        cfg.on_beat = on_beat;
+        cfg.on_sub = on_sub;
+
+        while ((opt = getopt(argc, argv, "s:p:c:")) != -1) {
+                switch (opt) {
+                case 's':
+                        cfg.subdiv = atoi(optarg);
+                        break;
+                case 'p':
+                        cfg.priority = atoi(optarg);
+                        break;
+                case 'c':
+                        cfg.cpu = atoi(optarg);
+                        break;
+                default:
+                        fprintf(stderr, "usage: %s [-s subdivisions] [-p priority] [-c cpu] [bpm seconds]\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        bool synthetic = argc - optind >= 2;
+        cfg.arg = synthetic ? NULL : &clk; // Only print ticks in interactive mode
+
+        tt_conc_init(&conc);
+
+        if (synthetic) {
+                double bpm = atof(argv[optind]);
+                tt_time_t prd = (tt_time_t) (60.0 * S_TO_US * TT_TICKS_PER_US / bpm);
+                tt_time_t t;
+
+                current_time(&t);
+                for (int i = 0; i < 4; i++) {
+                        tt_conc_tap_at(&conc, &t);
+                        t += prd;
+                }
+        }
+
+        int ret = tt_beat_clock_init(&clk);
+        if (ret == 0 && (ret = tt_beat_clock_start(&clk, &conc, &cfg)) != 0)
+                tt_beat_clock_destroy(&clk);
+
+        if (ret != 0) {
+                fprintf(stderr, "Failed to start beat clock: %s\n", strerror(ret));
+                return EXIT_FAILURE;
+        }
+
+        if (synthetic) {
+                sleep(atoi(argv[optind + 1]));
+        } else {
+                printf("Press enter to tap, 'r' + enter to reset, 'q' + enter to quit\n");
+
+                int c;
+                while ((c = getchar()) != EOF && c != 'q') {
+                        if (c == '\n')
+                                tt_conc_tap(&conc);
+                        else if (c == 'r')
+                                tt_conc_reset(&conc);
+                }
+        }
+
+        tt_beat_clock_stop(&clk);
+
+        tt_beat_stats stats;
+        tt_beat_clock_stats(&clk, &stats);
+
+        printf("\nticks:        %llu\n", (unsigned long long) stats.ticks);
+        printf("missed:       %llu\n", (unsigned long long) stats.missed);
+        printf("late min:     %.1fus\n", stats.late_min_ns / 1000.0);
+        printf("late max:     %.1fus\n", stats.late_max_ns / 1000.0);
+        printf("late avg:     %.1fus\n", stats.late_avg_ns / 1000.0);
+        printf("jitter (sd):  %.1fus\n", stats.late_sd_ns / 1000.0);
+
+        tt_beat_clock_destroy(&clk);
+        return 0;
+}
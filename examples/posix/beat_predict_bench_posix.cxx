@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file beat_predict_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Measures the drift and jitter of predicted beats on synthetic tap streams
+ *
+ * The following file taps a tempo tapper with synthetic tap streams, whose
+ * taps deviate from an ideal beat grid by gaussian jitter, and whose tempo
+ * optionally ramps up over time. After every tap, the next beat, as well as
+ * the beat 8 beats ahead, is predicted by:
+ *
+ * - last tap - Adding the period to the last tap, as done by polling the
+ *   period since the last tap
+ * - tt_next_beat_time() - The least-squares fitted beat grid
+ *
+ * For each stream and method, the mean error (drift) and standard deviation
+ * (jitter) of the predictions against the ideal beat grid are reported in
+ * milliseconds.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/beat_predict_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx -lm -o examples/posix/beat_predict_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/beat_predict_bench
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <tempo_tapper.h>
+
+#define TAPS 10000
+#define WINDOW 8
+#define AHEAD 8
+
+typedef struct stream
+{
+        const char *name;
+        double bpm;             ///< Initial tempo
+        double ramp;            ///< Tempo change in BPM per beat
+        double jitter_ms;       ///< Standard deviation of the tap jitter
+} stream;
+
+typedef struct error_stats
+{
+        double sum, sq_sum;
+        long n;
+} error_stats;
+
+static const stream streams[] = {
+        { "120 BPM, no jitter", 120, 0, 0 },
+        { "120 BPM, 5ms jitter", 120, 0, 5 },
+        { "120 BPM, 15ms jitter", 120, 0, 15 },
+        { "90-150 BPM ramp, 5ms jitter", 90, 60.0 / TAPS, 5 },
+};
+
+static double gaussian()
+{
+        double u = 1 - drand48(), v = drand48();
+        return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void add_error(error_stats *st, double err_ms)
+{
+        st->sum += err_ms;
+        st->sq_sum += err_ms * err_ms;
+        st->n++;
+}
+
+static void print_error(const char *method, error_stats *st)
+{
+        double mean = st->sum / st->n;
+        double sd = sqrt(st->sq_sum / st->n - mean * mean);
+        printf("  %-22s %12.3f %12.3f\n", method, mean, sd);
+}
+
+// Returns the time of the ideal beat in ticks, beat times follow the integrated tempo
+static double ideal_beat(const stream *str, long beat)
+{
+        double t = 0;
+
+        // Closed form of summing the periods of a linear tempo ramp is not worth the hassle
+        static double cache_t = 0;
+        static long cache_beat = 0;
+        static const stream *cache_str = NULL;
+
+        if (cache_str != str || beat < cache_beat) {
+                cache_str = str;
+                cache_beat = 0;
+                cache_t = 1e9;
+        }
+
+        t = cache_t;
+        for (long b = cache_beat; b < beat; b++)
+                t += 60e9 / (str->bpm + str->ramp * b);
+
+        cache_beat = beat;
+        cache_t = t;
+        return t;
+}
+
+int main()
+{
+        printf("%d taps per stream, window of %d intervals, times in ms\n\n", TAPS, WINDOW);
+
+        for (size_t i = 0; i < sizeof(streams)/sizeof(streams[0]); i++) {
+                const stream *str = &streams[i];
+                error_stats naive[2] = {}, fit[2] = {};
+                tempo_tapper tt;
+
+                srand48(1);
+                tt_init(&tt);
+                tt_set_window(&tt, WINDOW);
+
+                for (long b = 0; b < TAPS; b++) {
+                        double ideal = ideal_beat(str, b);
+                        tt_time_t t = (tt_time_t) llround(ideal + gaussian() * str->jitter_ms * 1e6);
+                        tt_tap_at(&tt, &t);
+
+                        if (b < WINDOW)
+                                continue;
+
+                        tt_time_t prd = tt_period_ticks(&tt);
+
+                        for (int k = 0; k < 2; k++) {
+                                long ahead = k == 0 ? 1 : AHEAD;
+                                double target = ideal_beat(str, b + ahead);
+
+                                // Query halfway before the predicted beat
+                                tt_time_t now = t + prd * ahead - prd / 2;
+                                tt_time_t beat;
+                                tt_next_beat_time(&tt, &now, &beat);
+
+                                add_error(&naive[k], ((double) (t + prd * ahead) - target) / 1e6);
+                                add_error(&fit[k], ((double) beat - target) / 1e6);
+                        }
+                }
+
+                printf("%s\n", str->name);
+                printf("  %-22s %12s %12s\n", "next beat", "drift", "jitter");
+                print_error("last tap + period", &naive[0]);
+                print_error("tt_next_beat_time()", &fit[0]);
+                printf("  %-22s %12s %12s\n", "8 beats ahead", "drift", "jitter");
+                print_error("last tap + period", &naive[1]);
+                print_error("tt_next_beat_time()", &fit[1]);
+                printf("\n");
+        }
+
+        return 0;
+}
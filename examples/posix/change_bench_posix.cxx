@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file change_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Measures how fast the tempo converges after a tempo change
+ *
+ * The following file simulates a person tapping a steady tempo, who then switches
+ * to a different tempo, with taps that deviate from the beats by normally distributed
+ * timing errors. For several tempo steps and every estimator, it reports how many
+ * taps after the step it takes until the estimated tempo settles within 2% of the new
+ * tempo for good, with and without change detection (see tt_set_change_detection()),
+ * averaged over many simulated tappers. Tappers that have not settled by the end of a
+ * stream count as the length of the stream, and are reported as unsettled.
+ *
+ * It also reports how often the change detection restarts the tempo on a steady tempo,
+ * where every restart is a false alarm, and how many fresh tappers are restarted by a
+ * single doubled or missed tap, or by no glitch at all, from that tap on. A glitch must
+ * never restart the tempo, otherwise the program exits with 1.
+ *
+ * The change detection and the median estimator are only compiled in if TT_CHANGE and
+ * TT_MEDIAN are defined.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -D TT_CHANGE -D TT_MEDIAN -I include/ examples/posix/change_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx -o examples/posix/change_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/change_bench [threshold] [jitter_ms]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <tempo_tapper.h>
+
+#ifndef TT_CHANGE
+#error Compile with -D TT_CHANGE to enable the tempo change detection
+#endif
+
+#ifndef TT_MEDIAN
+#error Compile with -D TT_MEDIAN to enable the median estimator
+#endif
+
+#define TRIALS 1000
+#define TAPS_BEFORE 32          // Taps at the initial tempo
+#define TAPS_AFTER 64           // Taps at the new tempo
+#define TOLERANCE 0.03          // Relative tempo error at which the tempo counts as settled
+#define STEADY_TAPS 100000      // Taps of the steady stream used to count false alarms
+
+struct config
+{
+        const char *name;
+        tt_estimator est;
+        unsigned int win;
+};
+
+static const config configs[] = {
+        { "cumulative mean", TT_EST_MEAN, 0 },
+        { "window mean (8)", TT_EST_MEAN, 8 },
+        { "median (8)", TT_EST_MEDIAN, 8 },
+};
+
+struct glitch
+{
+        const char *name;
+        double at;              ///< Position of the extra tap in periods after the previous beat, 0 for a missed tap, -1 for none
+};
+
+static const glitch glitches[] = {
+        { "none", -1 },
+        { "doubled at 0.5p", 0.5 },
+        { "doubled at 0.3p", 0.3 },
+        { "missed", 0 },
+};
+
+static const double steps[][2] = {
+        { 120, 140 },
+        { 120, 100 },
+        { 120, 126 },
+        { 90, 180 },
+};
+
+// Returns a normally distributed random number (Box-Muller transform)
+static double gauss()
+{
+        double u = 1 - drand48();
+        double v = drand48();
+
+        return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void setup(tempo_tapper *tt, const config &cfg, float threshold)
+{
+        tt_init(tt);
+        tt_set_estimator(tt, cfg.est);
+        tt_set_window(tt, cfg.win);
+        tt_set_change_detection(tt, threshold);
+}
+
+/*
+ * Taps a tempo step and returns the number of taps after the step until the
+ * tempo stays within the tolerance for the rest of the stream
+ */
+static int settle(const config &cfg, float threshold, double from, double to, double jitter_ns)
+{
+        tempo_tapper tt;
+        double beat = 1e9;
+        int settled = 0;
+
+        setup(&tt, cfg, threshold);
+
+        for (int i = 0; i < TAPS_BEFORE + TAPS_AFTER; i++) {
+                tt_time_t t = (tt_time_t) (beat + gauss() * jitter_ns);
+                tt_tap_at(&tt, &t);
+
+                beat += 60e9 / (i < TAPS_BEFORE - 1 ? from : to);
+
+                if (i < TAPS_BEFORE)
+                        continue;
+
+                if (fabs(tt_bpm(&tt) - to) > to * TOLERANCE)
+                        settled = i - TAPS_BEFORE + 2;
+        }
+
+        return settled;
+}
+
+// Returns the number of restarts on a steady tempo
+static uint32_t false_alarms(const config &cfg, float threshold, double bpm, double jitter_ns)
+{
+        tempo_tapper tt;
+        double beat = 1e9;
+
+        setup(&tt, cfg, threshold);
+
+        for (int i = 0; i < STEADY_TAPS; i++) {
+                tt_time_t t = (tt_time_t) (beat + gauss() * jitter_ns);
+                tt_tap_at(&tt, &t);
+                beat += 60e9 / bpm;
+        }
+
+        return tt_changes(&tt);
+}
+
+/*
+ * Taps a steady tempo with a single doubled or missed tap after TAPS_BEFORE taps and
+ * returns the number of restarts from the glitch on
+ */
+static uint32_t glitch_restarts(const config &cfg, float threshold, const glitch &g, double bpm, double jitter_ns)
+{
+        tempo_tapper tt;
+        double prd = 60e9 / bpm;
+        double beat = 1e9;
+        uint32_t before = 0;
+
+        setup(&tt, cfg, threshold);
+
+        for (int i = 0; i < TAPS_BEFORE + TAPS_AFTER; i++) {
+                tt_time_t t = (tt_time_t) (beat + gauss() * jitter_ns);
+
+                if (i == TAPS_BEFORE)
+                        before = tt_changes(&tt);
+
+                if (i != TAPS_BEFORE || g.at != 0)
+                        tt_tap_at(&tt, &t);
+
+                if (i == TAPS_BEFORE && g.at > 0) {
+                        t = (tt_time_t) (beat + g.at * prd + gauss() * jitter_ns);
+                        tt_tap_at(&tt, &t);
+                }
+
+                beat += prd;
+        }
+
+        return tt_changes(&tt) - before;
+}
+
+int main(int argc, char **argv)
+{
+        int ret = 0;
+
+        float threshold = argc > 1 ? atof(argv[1]) : 5;
+        double jitter_ns = (argc > 2 ? atof(argv[2]) : 10) * 1e6;
+
+        printf("Taps until the tempo settles within %.0f%% after a step, mean over %d tappers,\n", TOLERANCE * 100, TRIALS);
+        printf("%.1fms timing error, change detection threshold %.1f\n\n", jitter_ns / 1e6, threshold);
+        printf("%-16s %-10s %8s %10s %8s %10s %9s\n", "estimator", "step", "off", "unsettled", "on", "unsettled", "speedup");
+
+        for (const config &cfg : configs) {
+                for (const double *step : steps) {
+                        double sum[2] = { 0, 0 };
+                        int unsettled[2] = { 0, 0 };
+
+                        for (int on = 0; on < 2; on++) {
+                                srand48(1);
+
+                                for (int k = 0; k < TRIALS; k++) {
+                                        int n = settle(cfg, on ? threshold : 0, step[0], step[1], jitter_ns);
+                                        sum[on] += n;
+                                        unsettled[on] += n > TAPS_AFTER;
+                                }
+                        }
+
+                        char name[16];
+                        snprintf(name, sizeof(name), "%.0f->%.0f", step[0], step[1]);
+
+                        printf("%-16s %-10s %8.1f %10d %8.1f %10d %8.1fx\n", cfg.name, name,
+                               sum[0] / TRIALS, unsettled[0], sum[1] / TRIALS, unsettled[1], sum[0] / sum[1]);
+                }
+        }
+
+        printf("\nFalse alarms on a steady 120 BPM stream\n\n");
+
+        for (const config &cfg : configs) {
+                srand48(1);
+                uint32_t n = false_alarms(cfg, threshold, 120, jitter_ns);
+                printf("%-16s %6u restarts in %d taps (one every %.0f taps)\n", cfg.name, n, STEADY_TAPS,
+                       n ? (double) STEADY_TAPS / n : INFINITY);
+        }
+
+        printf("\nTappers restarted by a single glitch on a steady 120 BPM stream, out of %d\n\n", TRIALS);
+        printf("%-16s", "estimator");
+
+        for (const glitch &g : glitches)
+                printf(" %16s", g.name);
+
+        printf("\n");
+
+        for (const config &cfg : configs) {
+                printf("%-16s", cfg.name);
+
+                for (const glitch &g : glitches) {
+                        uint32_t n = 0;
+                        srand48(1);
+
+                        for (int k = 0; k < TRIALS; k++)
+                                n += glitch_restarts(cfg, threshold, g, 120, jitter_ns) > 0;
+
+                        printf(" %16u", n);
+                        ret |= n > 0;
+                }
+
+                printf("\n");
+        }
+
+        if (ret)
+                printf("\nFAIL: a single doubled or missed tap restarted the tempo\n");
+
+        return ret;
+}
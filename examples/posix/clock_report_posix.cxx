@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file clock_report_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Reports the per-call cost and resolution of all POSIX clock sources
+ *
+ * The following file selects every clock source listed in tt_clock_src
+ * through tt_clock_init() and reports:
+ *
+ *      - The average cost of a current_time() call in nanoseconds
+ *      - The smallest non-zero difference observed between two consecutive
+ *        current_time() calls, which is an upper bound of the clock resolution
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/clock_report_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx -o examples/posix/clock_report
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/clock_report
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <tempo_tapper.h>
+
+#define CALLS 1000000 ///< Number of current_time() calls per clock source
+
+static const char *src_names[] = {
+        "TT_CLOCK_REALTIME",
+        "TT_CLOCK_MONOTONIC",
+        "TT_CLOCK_MONOTONIC_RAW",
+        "TT_CLOCK_TSC",
+};
+
+int main()
+{
+        printf("%-24s %12s %16s\n", "Clock source", "ns/call", "resolution (ns)");
+
+        for (int i = TT_CLOCK_REALTIME; i <= TT_CLOCK_TSC; i++) {
+                if (tt_clock_init((tt_clock_src) i) < 0) {
+                        printf("%-24s %12s %16s\n", src_names[i], "n/a", "n/a");
+                        continue;
+                }
+
+                tt_time_t start, end, prev, cur;
+                tt_time_t res = UINT64_MAX;
+
+                // Measure per-call cost
+                current_time(&start);
+                for (int c = 0; c < CALLS; c++)
+                        current_time(&cur);
+                current_time(&end);
+
+                // Measure smallest observable step
+                current_time(&prev);
+                for (int c = 0; c < CALLS; c++) {
+                        current_time(&cur);
+                        if (cur != prev && cur - prev < res)
+                                res = cur - prev;
+                        prev = cur;
+                }
+
+                printf("%-24s %12.2f %16llu\n", src_names[i],
+                       (double) (end - start) / CALLS, (unsigned long long) res);
+        }
+
+        return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file conc_stress_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Stress test of the concurrent tempo tapper under contention
+ *
+ * The following file hammers a single concurrent tempo tapper with taps from
+ * multiple producer threads while reader threads continuously read snapshots.
+ * Readers check that every snapshot is consistent, i.e. that the number of taps
+ * never decreases and that the period matches a tempo tapper state that could have
+ * been published. Once all producers are done, the program checks that every tap
+ * has either been applied or rejected, and reports the tap and read throughput.
+ *
+ * The first tap is applied before the producers start, the producers then tap
+ * with the current clock time. Since intervals telescope, the period sum of any
+ * published state equals the time between the first and last applied tap.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/conc_stress_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_conc.cxx -lpthread -o examples/posix/conc_stress
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/conc_stress [producers] [readers] [taps per producer]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include <atomic>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_conc.h>
+
+static tt_conc conc;
+static tt_time_t first;
+static int producers, readers;
+static long taps_per_producer;
+
+static std::atomic<bool> done(false);
+static std::atomic<long> inconsistent(0);
+static std::atomic<long> reads(0);
+
+static void *producer(void *arg)
+{
+        (void) arg;
+
+        for (long i = 0; i < taps_per_producer; i++)
+                tt_conc_tap(&conc);
+
+        return NULL;
+}
+
+static void *reader(void *arg)
+{
+        (void) arg;
+        int prev_taps = -1;
+
+        while (!done.load()) {
+                tt_conc_snapshot snap;
+                tt_conc_read(&conc, &snap);
+
+                // Taps never go backwards and the period must stem from the same state
+                bool ok = snap.taps >= prev_taps;
+                if (snap.taps > 0)
+                        ok = ok && snap.period_us == ((snap.lst_t - first) / TT_TICKS_PER_US) / snap.taps;
+
+                if (!ok)
+                        inconsistent++;
+
+                prev_taps = snap.taps;
+                reads++;
+        }
+
+        return NULL;
+}
+
+int main(int argc, char **argv)
+{
+        producers = argc > 1 ? atoi(argv[1]) : 4;
+        readers = argc > 2 ? atoi(argv[2]) : 2;
+        taps_per_producer = argc > 3 ? atol(argv[3]) : 1000000;
+
+        pthread_t *prod = (pthread_t *) malloc(producers * sizeof(pthread_t));
+        pthread_t *read = (pthread_t *) malloc(readers * sizeof(pthread_t));
+
+        tt_conc_init(&conc);
+
+        current_time(&first);
+        tt_conc_tap_at(&conc, &first);
+        tt_conc_drain(&conc);
+
+        tt_time_t start, end;
+        current_time(&start);
+
+        for (long i = 0; i < readers; i++)
+                pthread_create(&read[i], NULL, reader, NULL);
+        for (long i = 0; i < producers; i++)
+                pthread_create(&prod[i], NULL, producer, NULL);
+
+        for (int i = 0; i < producers; i++)
+                pthread_join(prod[i], NULL);
+
+        current_time(&end);
+        done = true;
+
+        for (int i = 0; i < readers; i++)
+                pthread_join(read[i], NULL);
+
+        while (conc.head != conc.tail.load())
+                tt_conc_drain(&conc);
+
+        tt_conc_snapshot snap;
+        tt_conc_read(&conc, &snap);
+
+        long total = producers * taps_per_producer;
+        long applied = snap.taps; // Excludes the initial tap
+        double secs = (double) (end - start) / (TT_TICKS_PER_US * S_TO_US);
+
+        printf("producers:    %d\n", producers);
+        printf("readers:      %d\n", readers);
+        printf("taps:         %ld (%.2f M/s)\n", total, total / secs / 1e6);
+        printf("reads:        %ld (%.2f M/s)\n", reads.load(), reads.load() / secs / 1e6);
+        printf("applied:      %ld\n", applied);
+        printf("rejected:     %lu\n", tt_conc_rejected(&conc));
+        printf("inconsistent: %ld\n", inconsistent.load());
+
+        bool ok = inconsistent == 0 && applied + (long) tt_conc_rejected(&conc) == total;
+        printf("%s\n", ok ? "PASS" : "FAIL");
+
+        free(prod);
+        free(read);
+        return ok ? 0 : EXIT_FAILURE;
+}
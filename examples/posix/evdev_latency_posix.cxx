@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file evdev_latency_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Measures the wake-to-tap delay removed by kernel timestamped taps
+ *
+ * The following file creates a virtual keyboard trough uinput, on which a thread
+ * presses the enter key at a steady tempo, and reads the key presses trough the
+ * input front-end of tempo_tapper_evdev.h. Every key press taps two tempo tappers:
+ * one at the kernel timestamp of the key press, and one with tt_tap() once the key
+ * press has been handled, as a terminal based tempo tapper would. After every key
+ * press, the reader optionally busy-waits for a number of microseconds to simulate
+ * the redraw of a user interface.
+ *
+ * The example then reports the tempo and the standard deviation of the tapped
+ * intervals of both tempo tappers, along with the wake-to-tap delay statistics. The
+ * kernel timestamped intervals only carry the jitter of the pressing thread.
+ *
+ * Creating the virtual keyboard requires write access to /dev/uinput.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/evdev_latency_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_evdev.cxx -lpthread -o examples/posix/evdev_latency
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/evdev_latency [-w redraw_us] [bpm] [taps]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/input-event-codes.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_evdev.h>
+
+#define S_TO_NS 1000000000LL
+
+typedef struct presser
+{
+        tt_evdev_virtual *vd;
+        double bpm;
+        unsigned long taps;
+} presser;
+
+typedef struct interval_stats
+{
+        unsigned long n;
+        double sum;
+        double sq_sum;
+} interval_stats;
+
+static void add_interval(interval_stats *s, tt_time_t a, tt_time_t b)
+{
+        double d = (double) (b - a);
+
+        s->n++;
+        s->sum += d;
+        s->sq_sum += d * d;
+}
+
+static double interval_sd_ms(const interval_stats *s)
+{
+        double avg = s->sum / s->n;
+        double var = s->sq_sum / s->n - avg * avg;
+
+        return var > 0 ? sqrt(var) / 1e6 : 0;
+}
+
+// Presses the enter key on a steady grid of absolute deadlines
+static void *press(void *arg)
+{
+        presser *p = (presser *) arg;
+        int64_t prd = (int64_t) (60 * S_TO_NS / p->bpm);
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        for (unsigned long i = 0; i < p->taps; i++) {
+                int64_t ns = (int64_t) ts.tv_nsec + prd;
+
+                ts.tv_sec += ns / S_TO_NS;
+                ts.tv_nsec = ns % S_TO_NS;
+
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+                tt_evdev_virtual_press(p->vd, KEY_ENTER);
+        }
+
+        return NULL;
+}
+
+static void busy_wait(long us)
+{
+        tt_time_t start, now;
+        current_time(&start);
+
+        do {
+                current_time(&now);
+        } while ((now - start) / TT_TICKS_PER_US < (tt_time_t) us);
+}
+
+int main(int argc, char **argv)
+{
+        long redraw_us = 0;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "w:")) != -1) {
+                if (opt != 'w') {
+                        fprintf(stderr, "usage: %s [-w redraw_us] [bpm] [taps]\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+
+                redraw_us = atol(optarg);
+        }
+
+        presser p;
+        tt_evdev_virtual vd;
+        tt_evdev ev;
+        int err;
+
+        p.vd = &vd;
+        p.bpm = optind < argc ? atof(argv[optind]) : 240;
+        p.taps = optind + 1 < argc ? atol(argv[optind + 1]) : 64;
+
+        if ((err = tt_evdev_virtual_open(&vd)) != 0) {
+                fprintf(stderr, "Failed to create a virtual keyboard: %s\n", strerror(err));
+                return EXIT_FAILURE;
+        }
+
+        tempo_tapper kernel_tt, wake_tt;
+        tt_init(&kernel_tt);
+        tt_init(&wake_tt);
+
+        // The key presses must not reach any other reader, so the device is grabbed
+        if ((err = tt_evdev_init(&ev, &kernel_tt, KEY_ENTER)) != 0 || (err = tt_evdev_open(&ev, vd.path, true)) != 0) {
+                fprintf(stderr, "%s: %s\n", vd.path, strerror(err));
+                tt_evdev_virtual_close(&vd);
+                return EXIT_FAILURE;
+        }
+
+        printf("Pressing %lu keys at %.2f BPM on %s, %ldus redraw\n", p.taps, p.bpm, vd.path, redraw_us);
+
+        pthread_t thread;
+        pthread_create(&thread, NULL, press, &p);
+
+        interval_stats kernel_iv = {0, 0, 0}, wake_iv = {0, 0, 0};
+        tt_time_t last_kernel = 0, last_wake = 0;
+        unsigned long seen = 0;
+        tt_evdev_key keys[16];
+
+        while (seen < p.taps) {
+                int n = tt_evdev_poll(&ev, 1000, keys, 16);
+
+                if (n <= 0) {
+                        fprintf(stderr, "Key presses stopped after %lu taps\n", seen);
+                        break;
+                }
+
+                for (int i = 0; i < n; i++) {
+                        tt_time_t now;
+
+                        tt_tap(&wake_tt);
+                        current_time(&now);
+
+                        if (seen > 0) {
+                                add_interval(&kernel_iv, last_kernel, keys[i].time);
+                                add_interval(&wake_iv, last_wake, now);
+                        }
+
+                        last_kernel = keys[i].time;
+                        last_wake = now;
+                        seen++;
+                }
+
+                busy_wait(redraw_us);
+        }
+
+        pthread_join(thread, NULL);
+
+        tt_evdev_delay_stats st;
+        tt_evdev_stats(&ev, &st);
+
+        if (kernel_iv.n > 0) {
+                printf("\n%-20s %12s %18s\n", "", "tempo", "interval jitter");
+                printf("%-20s %8.2f BPM %15.3fms\n", "kernel timestamps", tt_bpm(&kernel_tt), interval_sd_ms(&kernel_iv));
+                printf("%-20s %8.2f BPM %15.3fms\n", "tt_tap() on wakeup", tt_bpm(&wake_tt), interval_sd_ms(&wake_iv));
+        }
+
+        printf("\nWake-to-tap delay over %llu taps: %.3fms min, %.3fms max, %.3fms average, %.3fms jitter\n",
+               (unsigned long long) st.taps, st.delay_min_ns / 1e6, st.delay_max_ns / 1e6,
+               st.delay_avg_ns / 1e6, st.delay_sd_ns / 1e6);
+
+        tt_evdev_close(&ev);
+        tt_evdev_virtual_close(&vd);
+        return 0;
+}
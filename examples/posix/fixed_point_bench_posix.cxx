@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file fixed_point_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Compares the accuracy and cost of tt_bpm_fx() and tt_bpm()
+ *
+ * The following file sweeps all periods from 916us (65500 BPM) to 6s (10 BPM)
+ * and compares the fixed-point BPM conversion used by tt_bpm_fx() and the
+ * floating-point conversion used by tt_bpm() against the exact tempo.
+ * It then reports the largest absolute error of both conversions, along
+ * with their average cost in nanoseconds and, on x86-64, in TSC cycles.
+ *
+ * Note that the cost is measured on the host CPU, which has an FPU. The
+ * fixed-point conversion exists for CPUs without FPU (ex. AVR), where the
+ * float conversion is emulated in software.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/fixed_point_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx -o examples/posix/fixed_point_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/fixed_point_bench
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_tpl.h>
+
+#define MIN_PERIOD_US 916
+#define MAX_PERIOD_US 6000000
+
+static uint64_t cycles()
+{
+#if defined(__x86_64__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+}
+
+// Same conversion as tt_bpm()
+static BPM_t float_bpm(unsigned long us)
+{
+        return (60 * S_TO_US)/(BPM_t)us;
+}
+
+int main()
+{
+        double fx_err = 0, fl_err = 0;
+        unsigned long fx_worst = 0, fl_worst = 0;
+
+        for (unsigned long us = MIN_PERIOD_US; us <= MAX_PERIOD_US; us++) {
+                double exact = 60.0 * S_TO_US / us;
+                double fx = (double) tt::detail::bpm_fx_from_us(us) / TT_BPM_FX_ONE;
+                double fl = float_bpm(us);
+
+                if (fabs(fx - exact) > fx_err) {
+                        fx_err = fabs(fx - exact);
+                        fx_worst = us;
+                }
+
+                if (fabs(fl - exact) > fl_err) {
+                        fl_err = fabs(fl - exact);
+                        fl_worst = us;
+                }
+        }
+
+        unsigned long n = MAX_PERIOD_US - MIN_PERIOD_US + 1;
+        volatile uint64_t fx_sink = 0;
+        volatile BPM_t fl_sink = 0;
+        tt_time_t start, end;
+
+        current_time(&start);
+        uint64_t c0 = cycles();
+        for (unsigned long us = MIN_PERIOD_US; us <= MAX_PERIOD_US; us++)
+                fx_sink = fx_sink + tt::detail::bpm_fx_from_us(us);
+        uint64_t c1 = cycles();
+        current_time(&end);
+        double fx_ns = (double) (end - start) / n;
+        double fx_cyc = (double) (c1 - c0) / n;
+
+        current_time(&start);
+        c0 = cycles();
+        for (unsigned long us = MIN_PERIOD_US; us <= MAX_PERIOD_US; us++)
+                fl_sink = fl_sink + float_bpm(us);
+        c1 = cycles();
+        current_time(&end);
+        double fl_ns = (double) (end - start) / n;
+        double fl_cyc = (double) (c1 - c0) / n;
+
+        printf("%-12s %16s %14s %10s %12s\n", "conversion", "max error (BPM)", "at period (us)", "ns/call", "cycles/call");
+        printf("%-12s %16.8f %14lu %10.2f %12.2f\n", "tt_bpm_fx()", fx_err, fx_worst, fx_ns, fx_cyc);
+        printf("%-12s %16.8f %14lu %10.2f %12.2f\n", "tt_bpm()", fl_err, fl_worst, fl_ns, fl_cyc);
+
+        return 0;
+}
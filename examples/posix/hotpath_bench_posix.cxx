@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file hotpath_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Microbenchmarks of the tap and query hot path, emitting JSON
+ *
+ * The following file measures the cost of current_time(), tt_tap(), tt_bpm() and
+ * tt_period_us(), and reports for every measurement the average cost in nanoseconds
+ * and TSC cycles per call, along with the 50th, 99th and 99.9th percentile and the
+ * maximum of the individual calls, i.e. the tail latency.
+ *
+ * The calls are measured:
+ *
+ *      - per clock source (see tt_clock_init()), for current_time() and tt_tap()
+ *      - on a single tempo tapper, and round-robin on TT_BENCH_INSTANCES tempo
+ *        tappers, whose working set exceeds the caches of most CPUs
+ *      - with a hot cache, and with a cold cache, for which the tempo tapper is
+ *        flushed from all caches before every call (x86-64 only)
+ *
+ * As tt_bpm() is memoized, it is measured both on a memoized tempo ("tt_bpm") and
+ * right after a tap ("tt_bpm_after_tap"). Every call is timed individually with
+ * the TSC, minus the overhead of reading it. On other architectures, calls are
+ * timed with CLOCK_MONOTONIC instead and cycles are reported as null.
+ *
+ * Results are written as a single JSON document to stdout, or to the file passed
+ * with -o, so that they can be tracked across releases. A human readable summary is
+ * printed to stderr. The tools/makebench.sh script builds and runs this benchmark.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/hotpath_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx -o examples/posix/hotpath_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/hotpath_bench [-n samples] [-o results.json]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#define BENCH_TSC
+#endif
+
+#include <tempo_tapper.h>
+
+#ifndef TT_BENCH_INSTANCES
+#define TT_BENCH_INSTANCES 16384        ///< Number of tempo tappers of the many-instance measurements
+#endif
+
+#define CACHE_LINE 64
+
+typedef enum op
+{
+        OP_CURRENT_TIME,
+        OP_TAP,
+        OP_BPM,
+        OP_BPM_AFTER_TAP,
+        OP_PERIOD_US,
+} op;
+
+static const char *op_names[] = {
+        "current_time",
+        "tt_tap",
+        "tt_bpm",
+        "tt_bpm_after_tap",
+        "tt_period_us",
+};
+
+static const char *src_names[] = {
+        "realtime",
+        "monotonic",
+        "monotonic_raw",
+        "tsc",
+};
+
+typedef struct result
+{
+        op o;
+        tt_clock_src src;
+        unsigned int instances;
+        bool cold;
+        double ns_per_op;
+        double cycles_per_op;
+        double p50_ns;
+        double p99_ns;
+        double p999_ns;
+        double max_ns;
+} result;
+
+static double ns_per_tick = 1;  ///< Nanoseconds per timestamp tick
+static uint64_t overhead = 0;   ///< Ticks taken by an empty measurement
+
+// Reads the timestamp counter, serialized so that the measured call can not be reordered around it
+static inline uint64_t stamp()
+{
+#ifdef BENCH_TSC
+        _mm_lfence();
+        uint64_t t = __rdtsc();
+        _mm_lfence();
+        return t;
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void calibrate()
+{
+        uint64_t best = UINT64_MAX;
+
+        for (int i = 0; i < 100000; i++) {
+                uint64_t t0 = stamp();
+                uint64_t t1 = stamp();
+
+                if (t1 - t0 < best)
+                        best = t1 - t0;
+        }
+
+        overhead = best;
+
+#ifdef BENCH_TSC
+        struct timespec a, b;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &a);
+        uint64_t c0 = stamp();
+        usleep(200000);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &b);
+        uint64_t c1 = stamp();
+
+        ns_per_tick = ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / (double) (c1 - c0);
+#endif
+}
+
+static void flush(const void *p, size_t len)
+{
+#ifdef BENCH_TSC
+        for (size_t off = 0; off < len; off += CACHE_LINE)
+                _mm_clflush((const char *) p + off);
+
+        _mm_mfence();
+#else
+        (void) p;
+        (void) len;
+#endif
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+        return x < y ? -1 : x > y;
+}
+
+static volatile BPM_t bpm_sink;
+static volatile unsigned long us_sink;
+
+static void measure(result *r, tempo_tapper *tts, uint64_t *samples, size_t n)
+{
+        tt_time_t t;
+
+        for (size_t i = 0; i < n; i++) {
+                tempo_tapper *tt = &tts[i % r->instances];
+
+                // Invalidates the memoized tempo outside of the measured call
+                if (r->o == OP_BPM_AFTER_TAP)
+                        tt_tap(tt);
+
+                if (r->cold)
+                        flush(tt, sizeof(tempo_tapper));
+
+                uint64_t t0 = stamp();
+
+                switch (r->o) {
+                case OP_CURRENT_TIME:
+                        current_time(&t);
+                        break;
+                case OP_TAP:
+                        tt_tap(tt);
+                        break;
+                case OP_BPM:
+                case OP_BPM_AFTER_TAP:
+                        bpm_sink = tt_bpm(tt);
+                        break;
+                case OP_PERIOD_US:
+                        us_sink = tt_period_us(tt);
+                        break;
+                }
+
+                uint64_t t1 = stamp();
+                samples[i] = t1 - t0 > overhead ? t1 - t0 - overhead : 0;
+        }
+
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; i++)
+                sum += samples[i];
+
+        qsort(samples, n, sizeof(uint64_t), cmp_u64);
+
+        double avg = (double) sum / n;
+
+#ifdef BENCH_TSC
+        r->cycles_per_op = avg;
+#else
+        r->cycles_per_op = -1;
+#endif
+        r->ns_per_op = avg * ns_per_tick;
+        r->p50_ns = samples[n / 2] * ns_per_tick;
+        r->p99_ns = samples[n * 99 / 100] * ns_per_tick;
+        r->p999_ns = samples[n * 999 / 1000] * ns_per_tick;
+        r->max_ns = samples[n - 1] * ns_per_tick;
+}
+
+static void print_json(FILE *f, const result *res, size_t n_res, size_t samples)
+{
+        fprintf(f, "{\n  \"benchmark\": \"hotpath\",\n  \"compiler\": \"%s\",\n", __VERSION__);
+#ifdef BENCH_TSC
+        fprintf(f, "  \"timer\": \"tsc\",\n");
+#else
+        fprintf(f, "  \"timer\": \"clock_monotonic\",\n");
+#endif
+        fprintf(f, "  \"samples\": %zu,\n  \"results\": [\n", samples);
+
+        for (size_t i = 0; i < n_res; i++) {
+                const result *r = &res[i];
+
+                fprintf(f, "    {\"op\": \"%s\", \"clock\": \"%s\", \"instances\": %u, \"cache\": \"%s\", ",
+                        op_names[r->o], src_names[r->src], r->instances, r->cold ? "cold" : "hot");
+                fprintf(f, "\"ns_per_op\": %.2f, ", r->ns_per_op);
+
+                if (r->cycles_per_op < 0)
+                        fprintf(f, "\"cycles_per_op\": null, ");
+                else
+                        fprintf(f, "\"cycles_per_op\": %.2f, ", r->cycles_per_op);
+
+                fprintf(f, "\"p50_ns\": %.2f, \"p99_ns\": %.2f, \"p999_ns\": %.2f, \"max_ns\": %.2f}%s\n",
+                        r->p50_ns, r->p99_ns, r->p999_ns, r->max_ns, i + 1 < n_res ? "," : "");
+        }
+
+        fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+        size_t n = 200000;
+        const char *out_path = NULL;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+                switch (opt) {
+                case 'n':
+                        n = atol(optarg);
+                        break;
+                case 'o':
+                        out_path = optarg;
+                        break;
+                default:
+                        fprintf(stderr, "usage: %s [-n samples] [-o results.json]\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (n < 1000)
+                n = 1000;
+
+        uint64_t *samples = (uint64_t *) malloc(n * sizeof(uint64_t));
+        tempo_tapper *tts = (tempo_tapper *) malloc(TT_BENCH_INSTANCES * sizeof(tempo_tapper));
+        result *res = (result *) malloc(64 * sizeof(result));
+        size_t n_res = 0;
+
+        if (samples == NULL || tts == NULL || res == NULL) {
+                perror("malloc");
+                return EXIT_FAILURE;
+        }
+
+        calibrate();
+
+        // Clock dependent calls, per clock source
+        for (int src = TT_CLOCK_REALTIME; src <= TT_CLOCK_TSC; src++) {
+                if (tt_clock_init((tt_clock_src) src) < 0)
+                        continue;
+
+                for (int o = OP_CURRENT_TIME; o <= OP_TAP; o++) {
+                        result *r = &res[n_res++];
+                        r->o = (op) o;
+                        r->src = (tt_clock_src) src;
+                        r->instances = 1;
+                        r->cold = false;
+
+                        tt_init(&tts[0]);
+                        measure(r, tts, samples, n);
+                }
+        }
+
+        tt_clock_init(TT_CLOCK_MONOTONIC_RAW);
+
+        // Tempo tapper calls, on one or many instances with a hot or cold cache
+        for (int o = OP_TAP; o <= OP_PERIOD_US; o++) {
+                for (int many = 0; many <= 1; many++) {
+                        for (int cold = 0; cold <= 1; cold++) {
+#ifndef BENCH_TSC
+                                if (cold)
+                                        continue;
+#endif
+                                result *r = &res[n_res++];
+                                r->o = (op) o;
+                                r->src = TT_CLOCK_MONOTONIC_RAW;
+                                r->instances = many ? TT_BENCH_INSTANCES : 1;
+                                r->cold = cold;
+
+                                // Every tempo tapper holds a tempo, so queries do not take the early exit
+                                for (unsigned int i = 0; i < r->instances; i++) {
+                                        tt_init(&tts[i]);
+                                        tt_tap(&tts[i]);
+                                        tt_tap(&tts[i]);
+                                }
+
+                                measure(r, tts, samples, n);
+                        }
+                }
+        }
+
+        fprintf(stderr, "%-18s %-14s %9s %5s %10s %10s %10s %10s %10s\n",
+                "call", "clock", "instances", "cache", "ns/op", "cycles/op", "p50 ns", "p99 ns", "p99.9 ns");
+
+        for (size_t i = 0; i < n_res; i++) {
+                const result *r = &res[i];
+
+                fprintf(stderr, "%-18s %-14s %9u %5s %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                        op_names[r->o], src_names[r->src], r->instances, r->cold ? "cold" : "hot",
+                        r->ns_per_op, r->cycles_per_op, r->p50_ns, r->p99_ns, r->p999_ns);
+        }
+
+        FILE *out = out_path ? fopen(out_path, "w") : stdout;
+        if (out == NULL) {
+                perror(out_path);
+                return EXIT_FAILURE;
+        }
+
+        print_json(out, res, n_res, n);
+
+        if (out != stdout)
+                fclose(out);
+
+        free(samples);
+        free(tts);
+        free(res);
+        return 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file kalman_ramp_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Compares the Kalman filter estimator against the other estimators on tempo ramps
+ *
+ * The following file simulates a person tapping a steady tempo, a ritardando and an
+ * accelerando, with taps that deviate from the beats by normally distributed timing
+ * errors, and reports for every estimator:
+ *
+ *      - On the steady tempo, how many taps it takes until the tempo settles within 1%
+ *        for good, and the RMS tempo error after 8 taps
+ *      - On the ramps, the RMS and the mean error of the tempo against the tempo of the
+ *        latest beat, from the start of the ramp until 8 beats after its end, where a
+ *        negative mean error is a tempo that lags behind
+ *      - The cost of a tap in nanoseconds
+ *
+ * For the Kalman filter, it also reports how many tempo errors lie within two of the
+ * standard deviations reported by tt_covariance(), which is about 95% if the noise
+ * model matches the tapping. The example fails if the coverage on a ramp lies outside
+ * of 90% to 99%, or drops below 90% on the steady tempo, where the random drift
+ * of the model makes the reported uncertainty larger than the actual error.
+ *
+ * The median and the Kalman filter estimators are only compiled in if TT_MEDIAN and TT_KALMAN
+ * are defined. To run the fixed-point
+ * Kalman filter used on Arduino platforms, compile with -D TT_KALMAN_FIXED as well.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -D TT_MEDIAN -D TT_KALMAN -I include/ examples/posix/kalman_ramp_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx -o examples/posix/kalman_ramp
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/kalman_ramp [jitter_ms]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <tempo_tapper.h>
+
+#ifndef TT_KALMAN
+#error Compile with -D TT_KALMAN to enable the Kalman filter estimator
+#endif
+
+#ifndef TT_MEDIAN
+#error Compile with -D TT_MEDIAN to enable the median estimator
+#endif
+
+#define TRIALS 1000
+#define STEADY_TAPS 64
+#define SETTLE_TOLERANCE 0.01   // Relative tempo error at which the tempo counts as settled
+#define LEAD_IN 16              // Steady beats before a ramp
+#define RAMP_BEATS 32           // Beats of a ramp
+#define TAIL_BEATS 8            // Steady beats after a ramp that are still evaluated
+#define COST_TAPS 1000000
+#define COVERAGE_MIN 90.0       // Lowest acceptable share of tempo errors within two standard deviations, in percent
+#define COVERAGE_MAX 99.0       // Highest acceptable share on ramps, in percent
+
+struct config
+{
+        const char *name;
+        tt_estimator est;
+        unsigned int win;
+};
+
+static const config configs[] = {
+        { "cumulative mean", TT_EST_MEAN, 0 },
+        { "window mean (8)", TT_EST_MEAN, 8 },
+        { "median (8)", TT_EST_MEDIAN, 8 },
+        { "kalman", TT_EST_KALMAN, 0 },
+};
+
+struct ramp
+{
+        const char *name;
+        double from;
+        double to;
+};
+
+static const ramp ramps[] = {
+        { "ritardando 120->90", 120, 90 },
+        { "accelerando 100->140", 100, 140 },
+};
+
+// Returns a normally distributed random number (Box-Muller transform)
+static double gauss()
+{
+        double u = 1 - drand48();
+        double v = drand48();
+
+        return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void setup(tempo_tapper *tt, const config &cfg)
+{
+        tt_init(tt);
+        tt_set_estimator(tt, cfg.est);
+        tt_set_window(tt, cfg.win);
+}
+
+// Tempo of the beat that starts after beat i of a ramp, changing linearly in BPM
+static double ramp_bpm(const ramp &r, int i)
+{
+        if (i < LEAD_IN)
+                return r.from;
+
+        if (i >= LEAD_IN + RAMP_BEATS)
+                return r.to;
+
+        return r.from + (r.to - r.from) * (i - LEAD_IN + 1) / RAMP_BEATS;
+}
+
+struct errors
+{
+        double sq_sum;          // Sum of squared tempo errors
+        double sum;             // Sum of tempo errors
+        unsigned long n;        // Number of tempo errors
+        unsigned long covered;  // Tempo errors within two reported standard deviations
+};
+
+static void add_error(errors *e, tempo_tapper *tt, double bpm)
+{
+        double err = tt_bpm(tt) - bpm;
+        tt_tempo_cov cov;
+
+        e->sq_sum += err * err;
+        e->sum += err;
+        e->n++;
+
+        if (tt_covariance(tt, &cov) == 0 && fabs(err) <= 2 * cov.bpm_sd)
+                e->covered++;
+}
+
+// Taps a steady tempo, returns the number of taps until it settles and collects the errors after 8 taps
+static int steady(const config &cfg, double bpm, double jitter_ns, errors *e)
+{
+        tempo_tapper tt;
+        int settled = 0;
+
+        setup(&tt, cfg);
+
+        for (int i = 0; i < STEADY_TAPS; i++) {
+                tt_time_t t = (tt_time_t) (1e9 + i * 60e9 / bpm + gauss() * jitter_ns);
+                tt_tap_at(&tt, &t);
+
+                if (i < 1)
+                        continue;
+
+                if (fabs(tt_bpm(&tt) - bpm) > bpm * SETTLE_TOLERANCE)
+                        settled = i + 1;
+
+                if (i >= 8)
+                        add_error(e, &tt, bpm);
+        }
+
+        return settled;
+}
+
+// Taps a ramp and collects the errors from its start until TAIL_BEATS after its end
+static void track(const config &cfg, const ramp &r, double jitter_ns, errors *e)
+{
+        tempo_tapper tt;
+        double beat = 1e9;
+
+        setup(&tt, cfg);
+
+        for (int i = 0; i < LEAD_IN + RAMP_BEATS + TAIL_BEATS; i++) {
+                tt_time_t t = (tt_time_t) (beat + gauss() * jitter_ns);
+                tt_tap_at(&tt, &t);
+
+                if (i > LEAD_IN)
+                        add_error(e, &tt, ramp_bpm(r, i - 1));
+
+                beat += 60e9 / ramp_bpm(r, i);
+        }
+}
+
+// Returns the cost of a tap in nanoseconds
+static double tap_cost(const config &cfg)
+{
+        tempo_tapper tt;
+        tt_time_t start, end;
+
+        setup(&tt, cfg);
+        current_time(&start);
+
+        for (int i = 0; i < COST_TAPS; i++) {
+                tt_time_t t = (tt_time_t) i * 500000000 + (i % 7) * 1000000;
+                tt_tap_at(&tt, &t);
+        }
+
+        current_time(&end);
+
+        // Keeps the taps from being optimized away
+        if (tt_period_ticks(&tt) == 0)
+                printf("!");
+
+        return (double) (end - start) / TT_TICKS_PER_US * 1000 / COST_TAPS;
+}
+
+int main(int argc, char **argv)
+{
+        double jitter_ns = (argc > 1 ? atof(argv[1]) : 10) * 1e6;
+        bool calibrated = true;
+
+#ifdef TT_KALMAN_FIXED
+        const char *arith = "fixed-point";
+#else
+        const char *arith = "floating-point";
+#endif
+
+        printf("%.1fms timing error, mean over %d tappers, %s Kalman filter\n\n", jitter_ns / 1e6, TRIALS, arith);
+
+        printf("Steady 120 BPM\n\n");
+        printf("%-16s %12s %10s %10s %10s\n", "estimator", "settled 1%", "RMS BPM", "within 2sd", "ns/tap");
+
+        for (const config &cfg : configs) {
+                errors e = {};
+                double settled = 0;
+
+                srand48(1);
+
+                for (int k = 0; k < TRIALS; k++)
+                        settled += steady(cfg, 120, jitter_ns, &e);
+
+                printf("%-16s %12.1f %10.3f", cfg.name, settled / TRIALS, sqrt(e.sq_sum / e.n));
+
+                if (cfg.est == TT_EST_KALMAN) {
+                        double coverage = 100.0 * e.covered / e.n;
+
+                        printf(" %9.1f%%", coverage);
+                        calibrated &= coverage >= COVERAGE_MIN;
+                } else
+                        printf(" %10s", "-");
+
+                printf(" %10.1f\n", tap_cost(cfg));
+        }
+
+        for (const ramp &r : ramps) {
+                printf("\n%s over %d beats\n\n", r.name, RAMP_BEATS);
+                printf("%-16s %10s %10s %10s\n", "estimator", "RMS BPM", "mean BPM", "within 2sd");
+
+                for (const config &cfg : configs) {
+                        errors e = {};
+
+                        srand48(1);
+
+                        for (int k = 0; k < TRIALS; k++)
+                                track(cfg, r, jitter_ns, &e);
+
+                        printf("%-16s %10.3f %10.3f", cfg.name, sqrt(e.sq_sum / e.n), e.sum / e.n);
+
+                        if (cfg.est == TT_EST_KALMAN) {
+                                double coverage = 100.0 * e.covered / e.n;
+
+                                printf(" %9.1f%%\n", coverage);
+                                calibrated &= coverage >= COVERAGE_MIN && coverage <= COVERAGE_MAX;
+                        } else
+                                printf(" %10s\n", "-");
+                }
+        }
+
+        if (!calibrated) {
+                printf("\nThe Kalman filter covariance does not match the tempo errors, tune TT_KALMAN_DRIFT and TT_KALMAN_JITTER_US\n");
+                return 1;
+        }
+
+        return 0;
+}
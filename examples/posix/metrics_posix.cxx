@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file metrics_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Collects and exports tempo tapper metrics
+ *
+ * The following file taps a tempo tapper at 240 BPM with a slight human jitter for
+ * about five seconds, queries its tempo every 50ms and resets it halfway, and then
+ * writes the collected metrics to stdout, either in the Prometheus text exposition
+ * format, or, if -j is passed, as JSON.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -D TT_METRICS -I include/ examples/posix/metrics_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_metrics.cxx -o examples/posix/metrics
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/metrics [-j]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_metrics.h>
+
+#define TAPS 20
+#define QUERIES_PER_TAP 5
+
+int main(int argc, char **argv)
+{
+        tt_metrics_format fmt = TT_METRICS_PROMETHEUS;
+        tempo_tapper tt;
+
+        if (argc > 1 && strcmp(argv[1], "-j") == 0)
+                fmt = TT_METRICS_JSON;
+
+        tt_init(&tt);
+        srand48(1);
+
+        for (int i = 0; i < TAPS; i++) {
+                tt_tap(&tt);
+
+                if (i == TAPS / 2)
+                        tt_reset(&tt);
+
+                // 250ms beats, +-10ms jitter, split into queries
+                useconds_t beat = 240000 + (useconds_t) (drand48() * 20000);
+
+                for (int q = 0; q < QUERIES_PER_TAP; q++) {
+                        usleep(beat / QUERIES_PER_TAP);
+                        tt_bpm(&tt);
+                }
+        }
+
+        if (tt_metrics_dump(STDOUT_FILENO, fmt) < 0) {
+                perror("tt_metrics_dump");
+                return EXIT_FAILURE;
+        }
+
+        return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file onset_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Measures the throughput and accuracy of the onset detector
+ *
+ * The following file synthesizes long stereo recordings at 44.1kHz, one of kick
+ * drums on every beat, and one with additional, quieter hi-hats on every off-beat,
+ * both over background noise, and streams them trough the onset detector. For each
+ * recording, it reports how many times faster than real time the audio has been
+ * processed on a single core, how many onsets have been detected on beats and
+ * off-beats, the timing error of the onsets, and the resulting tempo. Note that the
+ * hi-hats are onsets as well, so their tempo is that of the eighth notes. The tempo is
+ * estimated by the median estimator, which is only compiled in if TT_MEDIAN is defined.
+ *
+ * To compare the SSE2 kernel against the scalar one, compile a second time with
+ * -D TT_ONSET_SCALAR.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -D TT_MEDIAN -I include/ examples/posix/onset_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_onset.cxx -o examples/posix/onset_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/onset_bench [minutes] [bpm]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_onset.h>
+
+#ifndef TT_MEDIAN
+#error Compile with -D TT_MEDIAN to enable the median estimator
+#endif
+
+#define RATE 44100
+#define CHANNELS 2
+#define BLOCK_FRAMES 256
+
+static int16_t clamp16(double v)
+{
+        return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t) lrint(v);
+}
+
+// Synthesizes a recording, kicks are decaying 60Hz sines, hi-hats decaying noise
+static int16_t *synthesize(size_t frames, double bpm, bool hihats)
+{
+        int16_t *pcm = (int16_t *) malloc(frames * CHANNELS * sizeof(int16_t));
+        double beat = 60.0 * RATE / bpm;
+
+        if (pcm == NULL)
+                return NULL;
+
+        srand48(1);
+
+        for (size_t i = 0; i < frames; i++) {
+                double pos = fmod((double) i, beat);
+                double off = fmod((double) i + beat / 2, beat);
+                double v = (drand48() - 0.5) * 200;
+
+                v += 20000 * exp(-pos / (0.05 * RATE)) * sin(2 * M_PI * 60 * pos / RATE);
+                if (hihats)
+                        v += 4000 * exp(-off / (0.01 * RATE)) * (drand48() - 0.5);
+
+                for (int c = 0; c < CHANNELS; c++)
+                        pcm[i * CHANNELS + c] = clamp16(v);
+        }
+
+        return pcm;
+}
+
+static void run(const char *name, size_t frames, double bpm, bool hihats)
+{
+        int16_t *pcm = synthesize(frames, bpm, hihats);
+        if (pcm == NULL) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+        }
+
+        tempo_tapper tt;
+        tt_onset od;
+        double eighth_s = 30.0 / bpm;
+        double err_sum = 0;
+        unsigned long on_beat = 0, off_beat = 0;
+
+        tt_init(&tt);
+        tt_set_estimator(&tt, TT_EST_MEDIAN);
+        tt_onset_init(&od, &tt, RATE, CHANNELS, NULL);
+
+        tt_time_t start, end;
+        current_time(&start);
+
+        for (size_t i = 0; i < frames; i += BLOCK_FRAMES) {
+                size_t n = frames - i < BLOCK_FRAMES ? frames - i : BLOCK_FRAMES;
+
+                if (tt_onset_process(&od, &pcm[i * CHANNELS], n) == 0)
+                        continue;
+
+                // Onsets are matched to the closest eighth note
+                double t = (double) tt.lst_t / (S_TO_US * TT_TICKS_PER_US);
+                long eighth = lround(t / eighth_s);
+
+                err_sum += fabs(t - eighth * eighth_s);
+
+                if (eighth % 2 == 0)
+                        on_beat++;
+                else
+                        off_beat++;
+        }
+
+        current_time(&end);
+
+        double secs = (double) (end - start) / (S_TO_US * TT_TICKS_PER_US);
+        double audio = (double) frames / RATE;
+
+        printf("%s\n", name);
+        printf("  processed:   %.1fs of audio in %.3fs (%.0fx real time)\n", audio, secs, audio / secs);
+        printf("  throughput:  %.1f M frames/s\n", frames / secs / 1e6);
+        printf("  onsets:      %lu (%lu on beats, %lu on off-beats, %lu beats)\n",
+               od.onsets, on_beat, off_beat, (unsigned long) (audio * bpm / 60));
+        printf("  error:       %.2fms mean absolute\n", od.onsets ? err_sum / od.onsets * 1000 : 0);
+        printf("  tempo:       %.2f BPM\n", tt_bpm(&tt));
+
+        free(pcm);
+}
+
+int main(int argc, char **argv)
+{
+        double minutes = argc > 1 ? atof(argv[1]) : 10;
+        double bpm = argc > 2 ? atof(argv[2]) : 128;
+        size_t frames = (size_t) (minutes * 60 * RATE);
+
+#ifdef TT_ONSET_SCALAR
+        printf("%.1f minutes at %.1f BPM, scalar kernel\n\n", minutes, bpm);
+#else
+        printf("%.1f minutes at %.1f BPM, default kernel\n\n", minutes, bpm);
+#endif
+
+        run("kicks", frames, bpm, false);
+        run("kicks and hi-hats", frames, bpm, true);
+
+        return 0;
+}
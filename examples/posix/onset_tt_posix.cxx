@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file onset_tt_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Taps the tempo of audio from a WAV file or a PCM pipe
+ *
+ * The following file streams 16 bit PCM audio from a WAV file, or from stdin,
+ * trough the onset detector, which taps a tempo tapper on every onset. Each onset
+ * is printed along with its stream time and the current tempo. As onsets of
+ * off-beats count as taps too, the median estimator is used, which is only compiled
+ * in if TT_MEDIAN is defined.
+ *
+ * WAV data is read from stdin if the file name is '-'. Raw PCM, ex. captured by
+ * arecord, can be piped in by passing the sample rate and number of channels:
+ * ```
+ *      $ arecord -f S16_LE -r 44100 -c 2 | ./examples/posix/onset_tt -r 44100 -c 2
+ * ```
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -D TT_MEDIAN -I include/ examples/posix/onset_tt_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_onset.cxx -o examples/posix/onset_tt
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/onset_tt file.wav
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_onset.h>
+
+#ifndef TT_MEDIAN
+#error Compile with -D TT_MEDIAN to enable the median estimator
+#endif
+
+#define BLOCK_FRAMES 1024
+
+static uint32_t le32(const uint8_t *p)
+{
+        return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+        return p[0] | p[1] << 8;
+}
+
+/*
+ * Reads the WAV header up to the start of the data chunk, chunks are skipped
+ * by reading, so the header can also be parsed from a pipe
+ */
+static int read_wav_header(FILE *f, unsigned int *rate, unsigned int *channels)
+{
+        uint8_t hdr[12], chunk[8];
+        bool fmt = false;
+
+        if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4))
+                return -1;
+
+        while (fread(chunk, 1, 8, f) == 8) {
+                uint32_t len = le32(chunk + 4);
+
+                if (!memcmp(chunk, "data", 4))
+                        return fmt ? 0 : -1;
+
+                if (!memcmp(chunk, "fmt ", 4) && len >= 16) {
+                        uint8_t body[16];
+
+                        if (fread(body, 1, 16, f) != 16)
+                                return -1;
+
+                        uint16_t format = le16(body);
+                        *channels = le16(body + 2);
+                        *rate = le32(body + 4);
+
+                        // Plain PCM or WAVE_FORMAT_EXTENSIBLE, 16 bit only
+                        if ((format != 1 && format != 0xFFFE) || le16(body + 14) != 16)
+                                return -1;
+
+                        fmt = true;
+                        len -= 16;
+                }
+
+                // Chunks are padded to an even length
+                for (uint32_t i = 0; i < len + (len & 1); i++) {
+                        if (fgetc(f) == EOF)
+                                return -1;
+                }
+        }
+
+        return -1;
+}
+
+int main(int argc, char **argv)
+{
+        unsigned int rate = 0, channels = 0;
+        const char *path = "-";
+        int opt;
+
+        while ((opt = getopt(argc, argv, "r:c:")) != -1) {
+                switch (opt) {
+                case 'r':
+                        rate = atoi(optarg);
+                        break;
+                case 'c':
+                        channels = atoi(optarg);
+                        break;
+                default:
+                        fprintf(stderr, "usage: %s [-r rate -c channels] [file.wav | -]\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (optind < argc)
+                path = argv[optind];
+
+        FILE *f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+        if (f == NULL) {
+                perror(path);
+                return EXIT_FAILURE;
+        }
+
+        // Raw PCM if the format has been passed, WAV otherwise
+        if ((rate == 0 || channels == 0) && read_wav_header(f, &rate, &channels) < 0) {
+                fprintf(stderr, "%s: not a 16 bit PCM WAV file\n", path);
+                return EXIT_FAILURE;
+        }
+
+        tempo_tapper tt;
+        tt_onset od;
+
+        tt_init(&tt);
+        tt_set_estimator(&tt, TT_EST_MEDIAN);
+
+        if (tt_onset_init(&od, &tt, rate, channels, NULL) < 0) {
+                fprintf(stderr, "Unsupported format: %u Hz, %u channels\n", rate, channels);
+                return EXIT_FAILURE;
+        }
+
+        int16_t *block = (int16_t *) malloc(BLOCK_FRAMES * channels * sizeof(int16_t));
+        size_t frames;
+
+        while ((frames = fread(block, channels * sizeof(int16_t), BLOCK_FRAMES, f)) > 0) {
+                if (tt_onset_process(&od, block, frames) > 0) {
+                        printf("Onset at %9.3fs, Tempo: %.2f BPM\n",
+                               (double) tt.lst_t / (S_TO_US * TT_TICKS_PER_US), tt_bpm(&tt));
+                }
+        }
+
+        printf("%lu onsets, Tempo: %.2f BPM\n", od.onsets, tt_bpm(&tt));
+
+        free(block);
+        if (f != stdin)
+                fclose(f);
+
+        return 0;
+}
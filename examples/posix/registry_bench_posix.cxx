@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file registry_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Measures how the tap throughput of the tempo tapper registry scales with threads
+ *
+ * The following file taps randomly chosen channels from a growing number of threads,
+ * first trough a global map guarded by a single mutex, with tempo tappers created by
+ * tt_new() on the first tap of a channel, then trough the tempo tapper registry (see
+ * tempo_tapper_registry.h), one channel at a time and in batches of 64 channels. For every
+ * number of threads, it prints the taps per second of all three, along with the reads per
+ * second of concurrent reader threads, which look up the tempo of random channels, under the
+ * mutex, respectively without locks. Runs with more tapping and reading threads than online
+ * CPUs are marked as oversubscribed, as their threads take turns rather than running in
+ * parallel, so the scaling can only be judged on a machine with enough cores.
+ *
+ * After every registry run, all channels are read back and checked: the taps of all
+ * channels must add up to the applied taps.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/registry_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_pool.cxx src/tempo_tapper_registry.cxx -lpthread -o examples/posix/registry_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/registry_bench [max threads] [readers] [channels] [taps per thread]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_registry.h>
+
+#define BATCH 64
+
+enum mode { GLOBAL_LOCK, REGISTRY, REGISTRY_BATCH };
+
+static std::unordered_map<uint64_t, tempo_tapper *> global_map;
+static std::mutex global_lock;
+static tt_registry *reg;
+
+static enum mode mode;
+static uint64_t channels;
+static int readers;
+static long taps_per_thread;
+
+static std::atomic<bool> done(false);
+static std::atomic<long> reads(0);
+
+// Returns the next channel ID of a thread (xorshift64)
+static inline uint64_t next_id(uint64_t &state)
+{
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state % channels;
+}
+
+static BPM_t global_bpm(uint64_t id)
+{
+        std::lock_guard<std::mutex> guard(global_lock);
+        auto it = global_map.find(id);
+
+        return it != global_map.end() ? tt_bpm(it->second) : 0;
+}
+
+static void global_tap(uint64_t id)
+{
+        std::lock_guard<std::mutex> guard(global_lock);
+        tempo_tapper *&tt = global_map[id];
+
+        if (tt == NULL)
+                tt = tt_new();
+
+        tt_tap(tt);
+}
+
+static void *tapper(void *arg)
+{
+        uint64_t state = 0x9e3779b97f4a7c15ULL * ((uintptr_t) arg + 1);
+        uint64_t ids[BATCH];
+
+        if (mode == REGISTRY_BATCH) {
+                for (long i = 0; i < taps_per_thread; i += BATCH) {
+                        for (int k = 0; k < BATCH; k++)
+                                ids[k] = next_id(state);
+
+                        tt_registry_tap_batch(reg, ids, NULL, BATCH);
+                }
+
+                return NULL;
+        }
+
+        for (long i = 0; i < taps_per_thread; i++) {
+                if (mode == GLOBAL_LOCK)
+                        global_tap(next_id(state));
+                else
+                        tt_registry_tap(reg, next_id(state));
+        }
+
+        return NULL;
+}
+
+static void *reader(void *arg)
+{
+        (void) arg;
+        uint64_t state = 0x2545f4914f6cdd1dULL;
+        BPM_t sum = 0;
+
+        while (!done.load(std::memory_order_relaxed)) {
+                if (mode == GLOBAL_LOCK)
+                        sum += global_bpm(next_id(state));
+                else
+                        sum += tt_registry_bpm(reg, next_id(state));
+
+                reads.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return sum < 0 ? arg : NULL;
+}
+
+// Runs all threads and returns the number of taps per second, along with the reads per second
+static double run(enum mode m, int threads, double *rps)
+{
+        pthread_t tid[threads];
+        pthread_t rd[readers];
+        tt_time_t start, end;
+
+        mode = m;
+        done = false;
+        reads = 0;
+
+        for (long i = 0; i < readers; i++)
+                pthread_create(&rd[i], NULL, reader, NULL);
+
+        current_time(&start);
+
+        for (long i = 0; i < threads; i++)
+                pthread_create(&tid[i], NULL, tapper, (void *) i);
+
+        for (int i = 0; i < threads; i++)
+                pthread_join(tid[i], NULL);
+
+        current_time(&end);
+        done = true;
+
+        for (int i = 0; i < readers; i++)
+                pthread_join(rd[i], NULL);
+
+        double secs = (double) (end - start) / (TT_TICKS_PER_US * S_TO_US);
+        *rps = reads.load() / secs;
+        return threads * taps_per_thread / secs;
+}
+
+// Checks that the taps of all channels add up to the applied taps
+static bool check(int threads, tt_registry_entry *entries)
+{
+        size_t n = tt_registry_read_all(reg, entries, channels);
+        long taps = 0;
+
+        for (size_t i = 0; i < n; i++)
+                taps += entries[i].taps + 1;
+
+        return n == tt_registry_count(reg) && taps + (long) tt_registry_rejected(reg) == threads * taps_per_thread;
+}
+
+int main(int argc, char **argv)
+{
+        int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+        readers = argc > 2 ? atoi(argv[2]) : 1;
+        channels = argc > 3 ? atol(argv[3]) : 100000;
+        taps_per_thread = argc > 4 ? atol(argv[4]) : 1000000;
+        taps_per_thread -= taps_per_thread % BATCH;
+
+        if (max_threads < 1 || readers < 0 || channels < 1 || taps_per_thread < BATCH) {
+                fprintf(stderr, "Usage: %s [max threads] [readers] [channels] [taps per thread]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        tt_registry_entry *entries = (tt_registry_entry *) malloc(channels * sizeof(tt_registry_entry));
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        bool ok = true;
+
+        printf("%ld taps per thread over %lu channels, M taps/s (M reads/s of %d concurrent readers)\n",
+               taps_per_thread, (unsigned long) channels, readers);
+        printf("%ld online CPUs%s\n\n", online, online < 2 ? ", so the scaling with threads cannot be measured" : "");
+        printf("%7s %20s %20s %20s\n", "threads", "global lock", "registry", "registry batch");
+
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+                double tps[3], rps[3];
+
+                tps[0] = run(GLOBAL_LOCK, threads, &rps[0]);
+
+                for (int m = 1; m < 3; m++) {
+                        reg = tt_registry_new(channels, 0, 0, NULL);
+                        tps[m] = run(m == 1 ? REGISTRY : REGISTRY_BATCH, threads, &rps[m]);
+                        ok = ok && check(threads, entries);
+                        tt_registry_free(reg);
+                }
+
+                printf("%7d", threads);
+                for (int m = 0; m < 3; m++)
+                        printf(" %11.2f (%6.2f)", tps[m] / 1e6, rps[m] / 1e6);
+                printf("%s\n", threads + readers > online ? "  oversubscribed" : "");
+
+                for (auto &it : global_map)
+                        free(it.second);
+                global_map.clear();
+        }
+
+        printf("\n%s\n", ok ? "PASS" : "FAIL");
+
+        free(entries);
+        return ok ? 0 : EXIT_FAILURE;
+}
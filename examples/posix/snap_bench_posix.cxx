@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file snap_bench_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Measures saving and restoring snapshots of large tempo tapper populations
+ *
+ * The following file taps a population of tempo tappers with random tempos and a mix
+ * of estimators, leaving a few of them untapped, saves a snapshot of all of them (see tempo_tapper_snap.h), and measures
+ * how long it takes to save the snapshot, to open it, to read the tempo of every record
+ * straight from the mapping, and to restore the whole population. Finally, it checks that
+ * every restored tempo tapper reports the tempo of the original one, and, with the Kalman
+ * filter estimator, predicts the same beat, and that the records of the untapped tempo
+ * tappers hold no stale clock times from the former contents of their memory.
+ *
+ * The median and the Kalman filter estimators are only compiled in if TT_MEDIAN and TT_KALMAN
+ * are defined.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -D TT_MEDIAN -D TT_KALMAN -I include/ examples/posix/snap_bench_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_snap.cxx -o examples/posix/snap_bench
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/snap_bench [tappers] [path]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_snap.h>
+
+#ifndef TT_KALMAN
+#error Compile with -D TT_KALMAN to enable the Kalman filter estimator
+#endif
+
+#ifndef TT_MEDIAN
+#error Compile with -D TT_MEDIAN to enable the median estimator
+#endif
+
+#define TAPS 8
+#define UNTAPPED 16     // Every 16th tempo tapper is left untapped
+
+static double ms_since(tt_time_t start)
+{
+        tt_time_t now;
+        current_time(&now);
+        return (double) (now - start) / TT_TICKS_PER_US / 1000;
+}
+
+int main(int argc, char **argv)
+{
+        size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+        const char *path = argc > 2 ? argv[2] : "/tmp/tempo_tapper.snap";
+
+        tempo_tapper *src = (tempo_tapper *) malloc(n * sizeof(tempo_tapper));
+        tempo_tapper *dst = (tempo_tapper *) malloc(n * sizeof(tempo_tapper));
+
+        if (src == NULL || dst == NULL) {
+                perror("malloc");
+                return EXIT_FAILURE;
+        }
+
+        // Untapped tempo tappers must not carry the former contents of their memory into the snapshot
+        memset(src, 0xab, n * sizeof(tempo_tapper));
+        srand48(1);
+
+        for (size_t i = 0; i < n; i++) {
+                tt_time_t times[TAPS];
+                tt_time_t prd = (tt_time_t) ((60.0 / (60 + drand48() * 140)) * S_TO_US * TT_TICKS_PER_US);
+
+                for (int k = 0; k < TAPS; k++)
+                        times[k] = (tt_time_t) 1000000000 + k * prd + (tt_time_t) (drand48() * 10000 * TT_TICKS_PER_US);
+
+                tt_init(&src[i]);
+                tt_set_estimator(&src[i], (tt_estimator) (i % 3));
+
+                if (i % UNTAPPED != 0)
+                        tt_tap_batch(&src[i], times, TAPS);
+        }
+
+        printf("%zu tempo tappers, %zu bytes each in memory\n\n", n, sizeof(tempo_tapper));
+
+        tt_time_t start;
+        current_time(&start);
+
+        if (tt_snap_save(path, src, n) < 0) {
+                perror("tt_snap_save");
+                return EXIT_FAILURE;
+        }
+
+        printf("save:         %8.2f ms (%zu bytes)\n", ms_since(start), sizeof(tt_snap_header) + n * sizeof(tt_snap_record));
+
+        tt_snap snap;
+        current_time(&start);
+
+        if (tt_snap_open(&snap, path) < 0) {
+                perror("tt_snap_open");
+                return EXIT_FAILURE;
+        }
+
+        printf("open:         %8.2f ms\n", ms_since(start));
+
+        double bpm_sum = 0;
+        current_time(&start);
+
+        for (size_t i = 0; i < snap.count; i++)
+                bpm_sum += tt_snap_bpm(&snap.records[i], snap.ticks_per_us);
+
+        printf("read tempos:  %8.2f ms (mean %.2f BPM)\n", ms_since(start), bpm_sum / snap.count);
+
+        // The population is restored into existing tempo tappers, whose pages have already been faulted in
+        memset(dst, 0, n * sizeof(tempo_tapper));
+
+        current_time(&start);
+        size_t restored = tt_snap_restore_all(&snap, dst, n);
+        printf("restore all:  %8.2f ms (%zu restored)\n", ms_since(start), restored);
+
+        size_t stale = 0;
+
+        for (size_t i = 0; i < snap.count; i += UNTAPPED)
+                stale += snap.records[i].lst_t != 0;
+
+        tt_snap_close(&snap);
+        unlink(path);
+
+        size_t mismatches = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                tt_time_t now = src[i].lst_t, a = 0, b = 0;
+
+                tt_next_beat_time(&src[i], &now, &a);
+                tt_next_beat_time(&dst[i], &now, &b);
+
+                if (tt_bpm(&src[i]) != tt_bpm(&dst[i]) || tt_period_ticks(&src[i]) != tt_period_ticks(&dst[i]) ||
+                    (src[i].est == TT_EST_KALMAN && a != b))
+                        mismatches++;
+        }
+
+        printf("\n%zu tempo mismatches\n", mismatches);
+        printf("%zu untapped records with stale clock times\n", stale);
+
+        free(src);
+        free(dst);
+        return mismatches == 0 && stale == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tap_log_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Records a tap log and replays it faster than real time
+ *
+ * The following file shows the tap log recorder and the replay engine (see tempo_tapper_log.h).
+ *
+ * In record mode, it simulates a show with several performers, each tapping into their own
+ * channel with their own drifting tempo and timing error, occasionally resetting their tempo
+ * tapper, and records every tap and reset into a log.
+ *
+ * In replay mode, it maps a log, replays it twice into fresh tempo tappers and prints the
+ * number of events, the digest of the tempo sequence, which is identical for both replays,
+ * and the number of events replayed per second. With -v, the tempo after every event is printed.
+ * Without TT_CHANGE, the recorded tempo tappers do not detect tempo changes.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -D TT_CHANGE -I include/ examples/posix/tap_log_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_log.cxx -o examples/posix/tap_log
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/tap_log record <path> [channels] [events]
+ *      $ ./examples/posix/tap_log replay [-v] <path> [channels]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_log.h>
+
+#define MAX_CHANNELS 64
+
+// Returns a normally distributed random number (Box-Muller transform)
+static double gauss()
+{
+        double u = 1 - drand48();
+        double v = drand48();
+
+        return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void print_event(const tt_log_record *rec, tempo_tapper *tapper, void *arg)
+{
+        (void) arg;
+        printf("%20llu %4u %6s %10.2f\n", (unsigned long long) rec->time, rec->channel,
+               rec->type == TT_LOG_TAP ? "tap" : "reset", tt_bpm(tapper));
+}
+
+static int record(const char *path, int channels, long events)
+{
+        double bpm[MAX_CHANNELS];
+        double next[MAX_CHANNELS];
+        tempo_tapper cfg;
+        tt_log log;
+
+        // The recorded tempo tappers use a window of 8 intervals and detect tempo changes
+        tt_init(&cfg);
+        tt_set_window(&cfg, 8);
+#ifdef TT_CHANGE
+        tt_set_change_detection(&cfg, 5);
+#endif
+
+        if (tt_log_create(&log, path, events, &cfg) < 0) {
+                perror(path);
+                return 1;
+        }
+
+        srand48(1);
+
+        for (int c = 0; c < channels; c++) {
+                bpm[c] = 90 + drand48() * 60;
+                next[c] = 1e9 + drand48() * 1e9;
+        }
+
+        for (long i = 0; i < events; i++) {
+                // The performer with the earliest pending tap comes next
+                int c = 0;
+                for (int j = 1; j < channels; j++)
+                        if (next[j] < next[c])
+                                c = j;
+
+                tt_time_t t = (tt_time_t) (next[c] / (1000 / TT_TICKS_PER_US));
+
+                if (drand48() < 0.002) {
+                        tt_log_reset(&log, c, &t);
+                        bpm[c] = 90 + drand48() * 60;
+                        next[c] += 2e9;
+                        continue;
+                }
+
+                tt_log_tap(&log, c, &t);
+                bpm[c] += gauss() * 0.2;
+                next[c] += 60e9 / bpm[c] + gauss() * 10e6;
+        }
+
+        printf("Recorded %zu events of %d channels into %s\n", tt_log_count(&log), channels, path);
+
+        if (tt_log_close(&log) < 0) {
+                perror(path);
+                return 1;
+        }
+
+        return 0;
+}
+
+static int replay(const char *path, int channels, bool verbose)
+{
+        static tempo_tapper tappers[MAX_CHANNELS];
+        tt_replay_result res[2];
+        tt_log_view view;
+        double ms[2];
+
+        if (tt_log_map(&view, path) < 0) {
+                perror(path);
+                return 1;
+        }
+
+        for (int r = 0; r < 2; r++) {
+                tt_time_t start, end;
+
+                current_time(&start);
+                if (tt_replay(&view, tappers, channels, verbose && r == 0 ? print_event : NULL, NULL, &res[r]) < 0) {
+                        fprintf(stderr, "%s: invalid tempo tapper configuration\n", path);
+                        tt_log_unmap(&view);
+                        return 1;
+                }
+                current_time(&end);
+
+                ms[r] = (double) (end - start) / TT_TICKS_PER_US / 1000;
+        }
+
+        for (int r = 0; r < 2; r++) {
+                printf("Replay %d: %zu events, %zu skipped, digest %016llx, %.2f ms (%.1f M events/s)\n",
+                       r + 1, res[r].events, res[r].skipped, (unsigned long long) res[r].digest,
+                       ms[r], res[r].events / ms[r] / 1000);
+        }
+
+        printf("Replays are %s\n", res[0].digest == res[1].digest ? "identical" : "DIFFERENT");
+
+        tt_log_unmap(&view);
+        return res[0].digest == res[1].digest ? 0 : 1;
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr, "Usage: %s record <path> [channels] [events]\n", prog);
+        fprintf(stderr, "       %s replay [-v] <path> [channels]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+        if (argc > 2 && strcmp(argv[1], "record") == 0) {
+                int channels = argc > 3 ? atoi(argv[3]) : 16;
+                long events = argc > 4 ? atol(argv[4]) : 1000000;
+
+                if (channels < 1 || channels > MAX_CHANNELS || events < 1) {
+                        usage(argv[0]);
+                        return 1;
+                }
+
+                return record(argv[2], channels, events);
+        }
+
+        if (argc > 2 && strcmp(argv[1], "replay") == 0) {
+                bool verbose = strcmp(argv[2], "-v") == 0;
+                int arg = verbose ? 3 : 2;
+
+                if (argc <= arg) {
+                        usage(argv[0]);
+                        return 1;
+                }
+
+                int channels = argc > arg + 1 ? atoi(argv[arg + 1]) : MAX_CHANNELS;
+
+                if (channels < 1 || channels > MAX_CHANNELS) {
+                        usage(argv[0]);
+                        return 1;
+                }
+
+                return replay(argv[arg], channels, verbose);
+        }
+
+        usage(argv[0]);
+        return 1;
+}
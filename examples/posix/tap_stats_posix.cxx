@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tap_stats_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Shows how the tap statistics judge the trustworthiness of a tapped tempo
+ *
+ * The following file simulates a person tapping a tempo, whose taps deviate from
+ * the beats by normally distributed timing errors, and prints after every tap the
+ * tempo along with the tap statistics (see tt_stats()): the jitter of the intervals,
+ * the shortest and longest interval, the coefficient of variation and the confidence,
+ * which rises as more, and steadier, taps come in.
+ *
+ * The statistics are only compiled in if TT_STATS is defined.
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -O2 -D TT_TARGET_PLATFORM_POSIX -D TT_STATS -I include/ examples/posix/tap_stats_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx -o examples/posix/tap_stats
+ * ```
+ *
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/tap_stats [bpm] [jitter_ms] [taps]
+ * ```
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <tempo_tapper.h>
+
+#ifndef TT_STATS
+#error Compile with -D TT_STATS to enable the tap statistics
+#endif
+
+// Returns a normally distributed random number (Box-Muller transform)
+static double gauss()
+{
+        double u = 1 - drand48();
+        double v = drand48();
+
+        return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+int main(int argc, char **argv)
+{
+        double bpm = argc > 1 ? atof(argv[1]) : 120;
+        double jitter_ms = argc > 2 ? atof(argv[2]) : 15;
+        int taps = argc > 3 ? atoi(argv[3]) : 24;
+        double prd_ns = 60e9 / bpm;
+
+        tempo_tapper tt;
+        tt_init(&tt);
+        srand48(1);
+
+        printf("Tapping %d times at %.2f BPM with %.1fms timing error\n\n", taps, bpm, jitter_ms);
+        printf("%4s %10s %10s %10s %10s %8s %11s\n", "tap", "BPM", "jitter ms", "min ms", "max ms", "CV %", "confidence");
+
+        for (int i = 0; i < taps; i++) {
+                tt_time_t t = (tt_time_t) (1e9 + i * prd_ns + gauss() * jitter_ms * 1e6);
+                tt_tap_stats st;
+
+                tt_tap_at(&tt, &t);
+                tt_stats(&tt, &st);
+
+                if (st.intervals == 0)
+                        continue;
+
+                printf("%4d %10.2f %10.2f %10.2f %10.2f %8.2f %11.2f\n", i + 1, tt_bpm(&tt), st.stddev_us / 1000,
+                       st.min_us / 1000.0, st.max_us / 1000.0, st.cv * 100, st.confidence);
+        }
+
+        return 0;
+}
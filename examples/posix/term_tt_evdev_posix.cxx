@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file term_tt_evdev_posix.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Example of a terminal based tempo tapper reading taps from a Linux input device
+ *
+ * The following file provides the terminal based tempo tapper of term_tt_posix.cxx,
+ * rebuilt on the input front-end of tempo_tapper_evdev.h. Instead of reading the
+ * terminal, key presses are read from an input device, ex. the keyboard, and tapped
+ * at their kernel timestamps, so neither the wakeup of the process nor the redraw of
+ * the terminal delays the taps. The tempo tapper is tapped with the enter key, reset
+ * with the r key and quit with the q key. Besides the tempo, the terminal displays
+ * the delay between the kernel timestamps and the handling of the taps, which
+ * term_tt_posix.cxx adds to every tap.
+ *
+ * Available input devices are listed by /proc/bus/input/devices, or by name in
+ * /dev/input/by-id/. With -g, the device is grabbed, so that key presses do not
+ * reach the terminal or other applications while the example runs.
+ *
+ * Dependencies:
+ *      - ncurses
+ *
+ * To compile, execute the following command from the projects root directory:
+ * ```
+ *      $ g++ -D TT_TARGET_PLATFORM_POSIX -I include/ examples/posix/term_tt_evdev_posix.cxx src/tempo_tapper_common.cxx src/tempo_tapper_posix.cxx src/tempo_tapper_evdev.cxx -lncurses -o examples/posix/term_tt_evdev
+ * ```
+ *
+ * The resulting executable will be located in examples/posix/.
+ * To execute it from the project root directory, run:
+ * ```
+ *      $ ./examples/posix/term_tt_evdev [-g] /dev/input/eventN
+ * ```
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <curses.h>
+
+#include <tempo_tapper.h>
+#include <tempo_tapper_evdev.h>
+
+// Key codes of linux/input-event-codes.h, whose KEY_ macros clash with those of curses
+#define EV_KEY_Q 16
+#define EV_KEY_R 19
+#define EV_KEY_ENTER 28
+
+#define MAX_KEYS 16
+
+int main(int argc, char **argv)
+{
+        bool grab = false;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "g")) != -1) {
+                if (opt != 'g') {
+                        fprintf(stderr, "usage: %s [-g] /dev/input/eventN\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+
+                grab = true;
+        }
+
+        if (optind >= argc) {
+                fprintf(stderr, "usage: %s [-g] /dev/input/eventN\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        tempo_tapper tt;
+        tt_evdev ev;
+        int err;
+
+        tt_init(&tt);
+
+        if ((err = tt_evdev_init(&ev, &tt, EV_KEY_ENTER)) != 0 || (err = tt_evdev_open(&ev, argv[optind], grab)) != 0) {
+                fprintf(stderr, "term_tt_evdev: %s: %s\n", argv[optind], strerror(err));
+                return EXIT_FAILURE;
+        }
+
+        // Initialize ncurses, keys are read from the input device, so the terminal must not echo them
+        initscr();
+        noecho();
+        curs_set(0);
+
+        bool quit = false;
+        tt_evdev_key keys[MAX_KEYS];
+
+        clear();
+        printw("Use the enter key to tap a tempo. Press q to quit.\n");
+        refresh();
+
+        while (!quit) {
+                int n = tt_evdev_poll(&ev, -1, keys, MAX_KEYS);
+
+                if (n < 0) {
+                        endwin();
+                        fprintf(stderr, "term_tt_evdev: %s\n", strerror(-n));
+                        return EXIT_FAILURE;
+                }
+
+                for (int i = 0; i < n; i++) {
+                        if (keys[i].code == EV_KEY_Q)
+                                quit = true;
+                        else if (keys[i].code == EV_KEY_R)
+                                tt_reset(&tt); // Reset tempo tapper
+                }
+
+                // Discard the keys the terminal has received as well
+                flushinp();
+
+                tt_evdev_delay_stats st;
+                tt_evdev_stats(&ev, &st);
+
+                clear();
+                printw("Tempo: %.2f BPM, Period: %.2fms\n", tt_bpm(&tt), float(tt_period_us(&tt))/1000);
+                printw("Wake-to-tap delay: %.3fms average, %.3fms jitter, %.3fms max over %llu taps\n",
+                       st.delay_avg_ns / 1e6, st.delay_sd_ns / 1e6, st.delay_max_ns / 1e6, (unsigned long long) st.taps);
+                printw("Press r to reset, press q to quit.\n");
+                refresh();
+        }
+
+        endwin();
+        tt_evdev_close(&ev);
+        return 0;
+}
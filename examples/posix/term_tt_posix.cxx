@@ -27,7 +27,8 @@
  * POSIX compliant systems (ex. Linux, MacOS, etc.). Once the program is started,
  * the user will be prompted to tap in the tempo using the enter key. The terminal
  * displays the detected tempo in BPM, restricted to the 2nd decimal, and the tempo
- * period in ms, restricted to the 2nd decimal. The tempo tapper can be reset by
+ * period in ms, restricted to the 2nd decimal. The tempo is printed by an observer
+ * callback (see tt_observe()), only when it changes. The tempo tapper can be reset by
  * pressing the r key and quit by pressing the q key.
  * 
  * Dependencies:
@@ -53,6 +54,16 @@
 
 #include <tempo_tapper.h>
 
+// Called by the tempo tapper whenever the tempo changes by more than 0.01 BPM, or is reset
+static void print_tempo(tempo_tapper *, tt_event event, BPM_t bpm, void *)
+{
+        move(1, 0);
+        clrtoeol();
+
+        if (event == TT_EVENT_TEMPO)
+                printw("Tempo: %.2f BPM, Period: %.2fms", bpm, 60000 / bpm);
+}
+
 int main()
 {
         tempo_tapper *tt = tt_new(); // Create new tempo tapper instance
@@ -71,6 +82,8 @@ int main()
 
         char input; // Keyboard input
 
+        tt_observe(tt, 0.01, print_tempo, NULL); // Print the tempo whenever it changes
+
         do {
                 clear();
                 printw("Use the enter key to tap a tempo. Press q to quit.\n");
@@ -78,18 +91,18 @@ int main()
 
                 while (1) {
                         input = getchar();
-                        clear();
+                        move(2, 0);
+                        clrtoeol();
 
                         if (input == 'q' || input == 'r')
                                 break;
                         else if (input == '\r' || input == '\n')
-                                tt_tap(tt); // Newline received, tap!
+                                tt_tap(tt); // Newline received, tap! Calls print_tempo() if the tempo has changed
                         else
-                                printw("Invalid input!\n");
-                        
-                        // Get tempo, using tt_bpm(), and tempo period using tt_preiod_us(), and print it out!
-                        printw("Tempo: %.2f BPM, Period: %.2fms\n", tt_bpm(tt), float(tt_period_us(tt))/1000);
-                        printw("Press r to reset, press q to quit.\n");
+                                printw("Invalid input!");
+
+                        mvprintw(0, 0, "Press r to reset, press q to quit.");
+                        clrtoeol();
                         refresh();
                 }
 
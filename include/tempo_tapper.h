@@ -38,18 +38,63 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define S_TO_US 1000000
 
+/*
+ * Clock time in monotonic ticks (see TT_TICKS_PER_US). Differences are taken
+ * modulo 2^64, so they stay correct across a wrap of the tick count.
+ */
+typedef uint64_t tt_time_t;
+
 #if defined(TT_TARGET_PLATFORM_POSIX)
 
-#include <sys/time.h>
-typedef struct timeval tt_time_t;
+#include <time.h>
+#define TT_TICKS_PER_US 1000    ///< Number of tt_time_t ticks per microsecond, i.e. nanosecond ticks
+
+/**
+ * @brief Clock sources available on POSIX platforms
+ * 
+ * The following enum lists all clock sources that can be selected
+ * by tt_clock_init() to read the current clock time on POSIX platforms.
+ * All sources are converted to nanosecond ticks.
+ */
+typedef enum tt_clock_src
+{
+        TT_CLOCK_REALTIME,      ///< Wall clock time (gettimeofday()), subject to NTP slews and steps. Microsecond resolution.
+        TT_CLOCK_MONOTONIC,     ///< clock_gettime(CLOCK_MONOTONIC), never steps, but is slewed by NTP
+        TT_CLOCK_MONOTONIC_RAW, ///< clock_gettime(CLOCK_MONOTONIC_RAW), neither stepped nor slewed (default)
+        TT_CLOCK_TSC,           ///< Invariant time stamp counter calibrated against CLOCK_MONOTONIC_RAW (x86-64 only)
+} tt_clock_src;
+
+/**
+ * @brief Selects the clock source used by current_time()
+ * 
+ * The following function selects the clock source that current_time()
+ * reads from. It should be called once at initialization, before any
+ * tempo tapper is tapped, since time values of different clock sources
+ * cannot be mixed. If never called, TT_CLOCK_MONOTONIC_RAW is used.
+ * 
+ * Selecting TT_CLOCK_TSC calibrates the time stamp counter against
+ * CLOCK_MONOTONIC_RAW, which blocks for roughly 20ms.
+ * 
+ * @return 0 on success, -1 if the clock source is not supported by the platform
+ * @note This function is only available on POSIX platforms.
+ */
+int tt_clock_init(tt_clock_src src);
+
+/**
+ * @brief Returns the currently selected clock source
+ * 
+ * @note This function is only available on POSIX platforms.
+ */
+tt_clock_src tt_clock_source();
 
 #elif defined(TT_TARGET_PLATFORM_ARDUINO)
 
 #include <Arduino.h>
-typedef unsigned long tt_time_t;
+#define TT_TICKS_PER_US 1               ///< Number of tt_time_t ticks per microsecond, i.e. micros() extended to 64 bits
 
 #else
 
@@ -59,6 +104,242 @@ typedef unsigned long tt_time_t;
 
 typedef float BPM_t; // Data type to store BPM values
 
+typedef uint32_t BPM_fx_t;      // Data type to store BPM values in unsigned Q16.16 fixed-point format
+#define TT_BPM_FX_SHIFT 16      ///< Number of fractional bits of BPM_fx_t
+#define TT_BPM_FX_ONE ((BPM_fx_t) 1 << TT_BPM_FX_SHIFT) ///< 1 BPM in BPM_fx_t
+
+/**
+ * @brief Capacity of the interval ring buffer
+ * 
+ * The following macro defines how many of the most recent intervals
+ * a tempo tapper keeps, and thus the largest window that can be selected
+ * by tt_set_window(). Define it in the compiler flags to override the
+ * platform default. Define it as 0 to compile the ring buffer out, which
+ * leaves only the cumulative mean and the Kalman filter estimators.
+ */
+#ifndef TT_WINDOW_CAP
+#if defined(TT_TARGET_PLATFORM_ARDUINO)
+#define TT_WINDOW_CAP 8
+#else
+#define TT_WINDOW_CAP 32
+#endif
+#endif
+
+/**
+ * @brief Enables tap statistics
+ * 
+ * Define TT_STATS in the compiler flags to maintain running statistics of the
+ * tapped intervals, which can be read with tt_stats(). Without it, neither the
+ * statistics members of the tempo_tapper struct nor their updates are compiled,
+ * so builds for small MCUs pay nothing for them.
+ */
+#ifdef TT_STATS
+
+/**
+ * @brief Relative standard error of the mean period at which the confidence drops to 0
+ * 
+ * See tt_tap_stats::confidence. Define it in the compiler flags to override the default of 2%.
+ */
+#ifndef TT_STATS_MAX_RSE
+#define TT_STATS_MAX_RSE 0.02f
+#endif
+
+/**
+ * @brief Snapshot of the tap statistics
+ * 
+ * The following struct holds the statistics of all intervals tapped since the
+ * last reset, as returned by tt_stats(). Unlike the tempo, the statistics always
+ * cover all intervals, regardless of the selected estimator and window.
+ */
+typedef struct tt_tap_stats
+{
+        unsigned long intervals;        ///< Number of tapped intervals
+        float mean_us;                  ///< Mean interval in microseconds
+        float variance_us2;             ///< Sample variance of the intervals in square microseconds
+        float stddev_us;                ///< Standard deviation of the intervals in microseconds, i.e. the tap jitter
+        unsigned long min_us;           ///< Shortest interval in microseconds
+        unsigned long max_us;           ///< Longest interval in microseconds
+        float cv;                       ///< Coefficient of variation, i.e. the standard deviation relative to the mean
+
+        /**
+         * Confidence in the tapped tempo, from 0 to 1. It falls linearly from 1 to 0 as the
+         * relative standard error of the mean period, cv / sqrt(intervals), grows from 0 to
+         * TT_STATS_MAX_RSE, so it rises with steadier and with more taps. It is 0 for fewer
+         * than two intervals.
+         */
+        float confidence;
+} tt_tap_stats;
+
+#endif
+
+/**
+ * @brief Enables the tempo change detection
+ * 
+ * Define TT_CHANGE in the compiler flags to compile the automatic detection of
+ * tempo changes, which is enabled with tt_set_change_detection(). Without it,
+ * neither the change detection members of the tempo_tapper struct nor the
+ * detection itself are compiled, so taps do not pay for it.
+ */
+#ifdef TT_CHANGE
+
+/**
+ * @brief Tuning of the tempo change detection
+ * 
+ * The following macros tune the change detection enabled by tt_set_change_detection().
+ * Jitter values are relative to the tapped period. Define them in the compiler flags
+ * to override the defaults.
+ */
+#ifndef TT_CHANGE_DRIFT
+#define TT_CHANGE_DRIFT 0.5f            ///< Deviation per interval, in jitter standard deviations, that does not count towards a change
+#endif
+
+#ifndef TT_CHANGE_JITTER
+#define TT_CHANGE_JITTER 0.03f          ///< Tap jitter assumed until it has been measured, typical for tapping by hand
+#endif
+
+#ifndef TT_CHANGE_MIN_JITTER
+#define TT_CHANGE_MIN_JITTER 0.005f     ///< Lowest tap jitter assumed, so that perfectly steady taps do not make the detection overly sensitive
+#endif
+
+#define TT_CHANGE_SPAN 32               ///< Number of intervals the measured tap jitter and the reference period are averaged over
+#define TT_CHANGE_WARMUP 8              ///< Number of intervals averaged into the reference period before deviations are accumulated
+#define TT_CHANGE_OUTLIER 3.0f          ///< Deviation in jitter standard deviations beyond which an interval is not averaged
+
+#endif
+
+/**
+ * @brief Enables the median estimator
+ * 
+ * Define TT_MEDIAN in the compiler flags to compile the median estimator, TT_EST_MEDIAN.
+ * Without it, neither the sorted copy of the intervals in the tempo_tapper struct nor
+ * the code maintaining it are compiled, and tt_set_estimator() rejects TT_EST_MEDIAN.
+ * The median is taken from the ring buffer, so TT_WINDOW_CAP must not be 0.
+ */
+#if defined(TT_MEDIAN) && TT_WINDOW_CAP == 0
+#error TT_MEDIAN requires the interval ring buffer, TT_WINDOW_CAP must not be 0
+#endif
+
+/**
+ * @brief Enables the Kalman filter estimator
+ * 
+ * Define TT_KALMAN in the compiler flags to compile the Kalman filter estimator,
+ * TT_EST_KALMAN, and tt_covariance(). Without it, neither the Kalman filter members
+ * of the tempo_tapper struct nor the filter itself are compiled.
+ */
+#ifdef TT_KALMAN
+
+/**
+ * @brief Tuning of the Kalman filter estimator
+ * 
+ * The following macros set the noise model of TT_EST_KALMAN. Define them in the
+ * compiler flags to override the defaults. The default drift follows tempo ramps of
+ * about 30 BPM over 32 beats, on which about 95% of the tempo errors lie within two of
+ * the standard deviations reported by tt_covariance(). On steady tempos, the reported
+ * uncertainty is larger than the actual error, and on faster ramps or with more jitter
+ * than TT_KALMAN_JITTER_US, it is smaller.
+ */
+#ifndef TT_KALMAN_JITTER_US
+#define TT_KALMAN_JITTER_US 10000       ///< Standard deviation of the timing error of a tap in microseconds
+#endif
+
+#ifndef TT_KALMAN_DRIFT
+#define TT_KALMAN_DRIFT 0.4f            ///< Standard deviation of the change of the period per beat, relative to TT_KALMAN_JITTER_US
+#endif
+
+/**
+ * @brief Arithmetic of the Kalman filter estimator
+ * 
+ * The covariance of the Kalman filter is held in units of the squared tap jitter, which keeps all of its
+ * entries in the order of 1. On Arduino platforms, it is held in signed Q8.24 fixed-point format, so the
+ * filter runs without soft-float routines. Define TT_KALMAN_FIXED in the compiler flags to select the
+ * fixed-point filter on other platforms, or TT_KALMAN_FLOAT to select the floating-point filter on Arduino
+ * platforms.
+ */
+#if defined(TT_TARGET_PLATFORM_ARDUINO) && !defined(TT_KALMAN_FLOAT) && !defined(TT_KALMAN_FIXED)
+#define TT_KALMAN_FIXED
+#endif
+
+#ifdef TT_KALMAN_FIXED
+typedef int32_t tt_kf_t;        // Kalman filter covariance in Q8.24 fixed-point format
+#define TT_KF_SHIFT 24          ///< Number of fractional bits of tt_kf_t
+#else
+typedef float tt_kf_t;          // Kalman filter covariance
+#endif
+
+/**
+ * @brief Uncertainty of the Kalman filter estimate
+ * 
+ * The following struct holds the covariance of the beat phase and period estimated by
+ * TT_EST_KALMAN, as returned by tt_covariance(). The phase is the clock time of the beat
+ * closest to the last tap (see tt_next_beat_time()).
+ */
+typedef struct tt_tempo_cov
+{
+        float phase_var_us2;    ///< Variance of the beat phase in square microseconds
+        float period_var_us2;   ///< Variance of the period in square microseconds
+        float cov_us2;          ///< Covariance of beat phase and period in square microseconds
+        float bpm_sd;           ///< Standard deviation of the tempo in BPM, derived from the period variance
+} tt_tempo_cov;
+
+#endif
+
+/**
+ * @brief Tempo estimators
+ * 
+ * The following enum lists the estimators that a tempo tapper
+ * can use to derive the tempo from the tapped intervals (see tt_set_estimator()).
+ */
+typedef enum tt_estimator
+{
+        TT_EST_MEAN,    ///< Mean of the intervals (default)
+        TT_EST_MEDIAN,  ///< Median of the intervals, robust against missed or doubled taps (only with TT_MEDIAN)
+#ifdef TT_KALMAN
+        TT_EST_KALMAN,  ///< Kalman filter tracking beat phase and period, follows gradual tempo changes (only with TT_KALMAN)
+#endif
+} tt_estimator;
+
+/**
+ * @brief Number of observer slots per tempo tapper
+ * 
+ * The following macro defines how many callbacks can be registered with tt_observe()
+ * on a single tempo tapper, at most 8. The slots are stored within the tempo tapper
+ * struct, so no memory is allocated when registering a callback. Define it as 0 in the
+ * compiler flags to compile the observers out.
+ */
+#ifndef TT_OBSERVERS
+#define TT_OBSERVERS 2
+#endif
+
+/**
+ * @brief Events reported to observers (see tt_observe())
+ */
+typedef enum tt_event
+{
+        TT_EVENT_TEMPO,         ///< The tempo has moved beyond the hysteresis of the observer
+        TT_EVENT_RESET,         ///< The tempo tapper has been reset
+} tt_event;
+
+struct tempo_tapper;
+
+/**
+ * @brief Observer callback
+ * 
+ * Receives the tempo tapper, the event, the tempo in BPM (0 on resets) and the
+ * argument passed to tt_observe().
+ */
+typedef void (*tt_observer_cb)(struct tempo_tapper *tapper, tt_event event, BPM_t bpm, void *arg);
+
+/**
+ * @brief Observer slot (see tt_observe())
+ */
+typedef struct tt_observer
+{
+        tt_observer_cb cb;      ///< Callback
+        void *arg;              ///< Argument passed to the callback
+        BPM_t hysteresis;       ///< Smallest tempo change in BPM that is reported
+        BPM_t reported;         ///< Most recently reported tempo, 0 if none has been reported since the last reset
+} tt_observer;
+
 /**
  * @brief Tempo tapper struct
  * 
@@ -70,18 +351,50 @@ typedef float BPM_t; // Data type to store BPM values
  * functions:
  * 
  * - tt_new() - Creates a new tempo tapper struct
+ * - tt_init() - Initializes a tempo tapper struct on caller provided storage
  * - tt_period_us() - Returns the period of a tempo in microseconds
  * - tt_tap() - "Taps" the tempo tapper
+ * - tt_tap_at() - "Taps" the tempo tapper at a given clock time
+ * - tt_tap_batch() - "Taps" the tempo tapper for an array of clock times
  * - tt_reset() - Resets the tempo tapper
  * - tt_bpm() - Returns the tempo in BPM
+ * - tt_bpm_fx() - Returns the tempo in BPM as fixed-point value
+ * - tt_period_ticks() - Returns the period of a tempo in clock ticks
+ * - tt_set_window() - Selects between the cumulative and sliding window tempo
+ * - tt_set_estimator() - Selects between the mean, median (only with TT_MEDIAN) and Kalman filter (only with TT_KALMAN) tempo
+ * - tt_set_change_detection() - Enables the automatic detection of tempo changes (only with TT_CHANGE)
+ * - tt_changes() - Returns the number of detected tempo changes (only with TT_CHANGE)
+ * - tt_generation() - Returns the generation counter of the tempo tapper
+ * - tt_observe() - Registers a callback for tempo changes and resets
+ * - tt_unobserve() - Unregisters a callback
+ * - tt_next_beat_time() - Predicts the clock time of the next beat
+ * - tt_phase() - Returns the phase of the beat at a given clock time
+ * - tt_beats_until() - Returns the number of predicted beats up to a given clock time
+ * - tt_covariance() - Reads the uncertainty of the Kalman filter tempo (only with TT_KALMAN)
+ * - tt_stats() - Reads the statistics of the tapped intervals (only with TT_STATS)
+ * 
+ * By default, the tempo is averaged over all intervals since the last reset.
+ * Alternatively, tt_set_window() limits the average to the last N intervals,
+ * which are kept in a ring buffer along with their running sum.
+ * The median estimator (only with TT_MEDIAN) keeps a sorted copy of the same intervals.
+ * The Kalman filter estimator tracks the beat phase and period along with their covariance.
+ * 
+ * The results of tt_period_us(), tt_bpm() and tt_bpm_fx() are memoized, and only
+ * recomputed after the tempo tapper has been tapped, reset or reconfigured.
+ * Every such change also increments a generation counter (see tt_generation()),
+ * which callers can compare to skip work when nothing has changed.
  * 
- * To store time values, the platform varying tt_time_t typedef is used, as each
- * platform offers its own preferred data type or struct to store time values
- * (Ex. timeval on posix). This means that time arithmetic is implemented differently
- * on every platform (see current_time(), add_time(), sub_time(), time_to_us(), reset_time()).
- * For the library user, this is irrelevant as platform specific code is handled
- * by the library internally. The only noticable external difference may be a variation
- * in speed and precision. 
+ * Besides the tempo, the tempo tapper also tracks the phase of the beat. Rather
+ * than starting each beat at the last tap, the beat grid is laid through the most
+ * recent taps by a least-squares fit (see tt_next_beat_time()), which averages
+ * out the timing jitter of individual taps.
+ * 
+ * To store time values, the tt_time_t typedef is used, which counts 64 bit clock ticks
+ * on every platform, with a platform specific tick length (Ex. nanosecond ticks on posix,
+ * microseconds on arduino, see TT_TICKS_PER_US). Time arithmetic is therefore plain integer
+ * arithmetic, inlined into the caller (see add_time(), sub_time(), time_to_us(), reset_time()),
+ * and only reading the clock is platform specific (see current_time()). For the library user,
+ * the only noticable difference between platforms is a variation in speed and precision. 
  */
 
 typedef struct tempo_tapper
@@ -89,6 +402,64 @@ typedef struct tempo_tapper
         tt_time_t prd_sum;      ///< Holds the sum of all measured/"tapped" periods.
         tt_time_t lst_t;        ///< Hold the clock time of the last tap.
         int taps;               ///< Number of taps. The inital val is -1, meaning the 1st tap does not count.
+
+#if TT_WINDOW_CAP > 0
+        tt_time_t ring[TT_WINDOW_CAP];  ///< Ring buffer of the most recent intervals
+        uint16_t ring_head;             ///< Index of the next ring buffer slot to be written
+        uint16_t ring_cnt;              ///< Number of intervals stored in the ring buffer
+        tt_time_t win_sum;              ///< Running sum of the intervals within the sliding window
+#endif
+        uint16_t win_len;               ///< Sliding window length in intervals, 0 selects the cumulative average
+
+        uint8_t est;                    ///< Selected tt_estimator
+#ifdef TT_MEDIAN
+        uint16_t srt_cnt;               ///< Number of intervals in srt
+        tt_time_t srt[TT_WINDOW_CAP];   ///< Window intervals in ascending order, only maintained by the median estimator
+#endif
+
+#ifdef TT_KALMAN
+        int64_t kf_e;                   ///< Kalman filter beat phase, in clock ticks relative to the last tap
+        tt_time_t kf_p;                 ///< Kalman filter period in clock ticks, 0 until the first interval
+        tt_kf_t kf_p00;                 ///< Kalman filter phase variance, relative to the squared tap jitter
+        tt_kf_t kf_p01;                 ///< Kalman filter phase and period covariance, relative to the squared tap jitter
+        tt_kf_t kf_p11;                 ///< Kalman filter period variance, relative to the squared tap jitter
+#endif
+
+        uint32_t gen;                   ///< Generation counter, incremented whenever the tempo may have changed
+        uint8_t memo;                   ///< Flags of the memoized results that are valid for the current generation
+        unsigned long memo_period_us;   ///< Memoized tt_period_us() result
+        BPM_t memo_bpm;                 ///< Memoized tt_bpm() result
+        BPM_fx_t memo_bpm_fx;           ///< Memoized tt_bpm_fx() result
+        tt_time_t memo_prd;             ///< Memoized period of the beat grid in clock ticks
+        tt_time_t memo_anchor;          ///< Memoized clock time of the fitted beat closest to the last tap
+
+#ifdef TT_CHANGE
+        float chg_h;                    ///< Change detection threshold in jitter standard deviations, 0 disables it
+        float chg_var;                  ///< Running variance of the interval deviations relative to the period
+        float chg_slow;                 ///< CUSUM of lengthening intervals, i.e. of a slowing tempo
+        float chg_fast;                 ///< CUSUM of shortening intervals, i.e. of a quickening tempo
+        float chg_ref;                  ///< Reference period of the CUSUM in clock ticks, the mean of the recent intervals that have not been clipped
+        uint32_t chg_ref_n;             ///< Number of intervals averaged by chg_ref, up to TT_CHANGE_SPAN
+        tt_time_t chg_short;            ///< Last interval if it was short enough to be the first half of a doubled tap, 0 otherwise
+        uint32_t chg_slow_n;            ///< Number of intervals accumulated by chg_slow
+        uint32_t chg_fast_n;            ///< Number of intervals accumulated by chg_fast
+        tt_time_t chg_slow_sum;         ///< Sum of the intervals accumulated by chg_slow
+        tt_time_t chg_fast_sum;         ///< Sum of the intervals accumulated by chg_fast
+        uint32_t chg_cnt;               ///< Number of detected tempo changes since initialization
+#endif
+
+#if TT_OBSERVERS > 0
+        tt_observer obs[TT_OBSERVERS];  ///< Observer slots
+        uint8_t obs_mask;               ///< Bit mask of the used observer slots
+#endif
+
+#ifdef TT_STATS
+        uint32_t st_n;                  ///< Number of intervals of the statistics
+        float st_mean;                  ///< Running mean of the intervals in clock ticks
+        float st_m2;                    ///< Running sum of squared deviations from the mean (Welford's algorithm)
+        tt_time_t st_min;               ///< Shortest interval
+        tt_time_t st_max;               ///< Longest interval
+#endif
 } tempo_tapper;
 
 // Platform Specific
@@ -100,40 +471,56 @@ typedef struct tempo_tapper
  * to the current clock time. The clock time may be
  * the time that has passed since the start of the program,
  * (ex. micros() on arduino platforms), but may also be the
- * current time of the day (ex. gettimeofday() on posix).
+ * current time of the day (ex. TT_CLOCK_REALTIME on posix).
+ * 
+ * On POSIX platforms, the clock source can be selected through
+ * tt_clock_init().
+ * 
+ * On Arduino platforms, the 32 bit micros() counter, which wraps about
+ * every 71 minutes, is extended to 64 bits by counting its wraps. A wrap
+ * is only detected if this function is called at least once in between,
+ * ex. on every loop() iteration, or by a tap at least every 71 minutes.
+ * The function must not be called from interrupt handlers.
  * 
  * @note The implementation of this function is platform specific.
  */
 void current_time(tt_time_t *time);
 
+// Time arithmetic
+
 /**
  * @brief Adds two time values
  * 
  * The following function adds two time values, a, and b and
  * stores the result in res.
- * 
- * @note The implementation of this function is platform specific.
  */
-void add_time(tt_time_t *a, tt_time_t *b, tt_time_t *res);
+inline void add_time(tt_time_t *a, tt_time_t *b, tt_time_t *res)
+{
+        *res = *a + *b;
+}
 
 /**
  * @brief Subtracts two time values
  * 
  * The following function subtracts the time value of b from a
- * and stores the result in res.
- * 
- * @note The implementation of this function is platform specific.
+ * and stores the result in res. As the subtraction is performed
+ * modulo 2^64, the difference of two clock times is correct even
+ * if the clock wrapped in between.
  */
-void sub_time(tt_time_t *a, tt_time_t *b, tt_time_t *res);
+inline void sub_time(tt_time_t *a, tt_time_t *b, tt_time_t *res)
+{
+        *res = *a - *b;
+}
 
 /**
  * @brief Resets a time var to 0
  * 
  * The following function resets a time var to 0
- * 
- * @note The implementation of this function is platform specific.
  */
-void reset_time(tt_time_t *time);
+inline void reset_time(tt_time_t *time)
+{
+        *time = 0;
+}
 
 /**
  * @brief Returns a time value in microseconds
@@ -141,9 +528,11 @@ void reset_time(tt_time_t *time);
  * The following function converts and returns a time value in microseconds.
  * 
  * @return Time in microseconds
- * @note The implementation of this function is platform specific.
  */
-unsigned long time_to_us(tt_time_t *time);
+inline uint64_t time_to_us(tt_time_t *time)
+{
+        return *time / TT_TICKS_PER_US;
+}
 
 // Common
 
@@ -157,6 +546,18 @@ unsigned long time_to_us(tt_time_t *time);
  */
 tempo_tapper* tt_new();
 
+/**
+ * @brief Initializes a tempo tapper instance on caller provided storage
+ * 
+ * The following function initializes a tempo tapper struct that has been
+ * allocated by the caller, ex. as a global, on the stack or as part of another
+ * struct. Unlike tt_new(), no memory is allocated, which avoids heap
+ * fragmentation on small targets.
+ * 
+ * For large numbers of tempo tappers, see the tt_pool allocator in tempo_tapper_pool.h.
+ */
+void tt_init(tempo_tapper *tapper);
+
 /**
  * @brief Returns the period of a tempo in microseconds
  * 
@@ -164,6 +565,11 @@ tempo_tapper* tt_new();
  * for a period of the current tempo set by the tempo tapper
  * struct.
  * 
+ * On Arduino platforms, the 64 bit interval sums are divided by a
+ * 32 step shift-and-subtract loop, so neither this function nor
+ * tt_bpm(), tt_bpm_fx() and tt_period_ticks() pull in the 64 bit
+ * division routine. Periods of 2^32us and above saturate.
+ * 
  * @return Period time in microseconds
  * 
  */
@@ -181,6 +587,165 @@ unsigned long tt_period_us(tempo_tapper *tapper);
  */
 void tt_tap(tempo_tapper *tapper);
 
+/**
+ * @brief "Taps" the tempo tapper at a given clock time
+ * 
+ * The following function behaves like tt_tap(), except that
+ * the time of the tap is provided by the caller instead of being
+ * read through current_time(). This allows taps to be timestamped
+ * elsewhere (ex. input events, recorded logs, audio onsets).
+ * 
+ * The provided time must originate from the same clock as
+ * current_time() if the tapper is also tapped through tt_tap().
+ * 
+ */
+void tt_tap_at(tempo_tapper *tapper, tt_time_t *time);
+
+/**
+ * @brief "Taps" the tempo tapper for an array of clock times
+ * 
+ * The following function folds n taps, timestamped by the times
+ * array, into the tempo tapper. The times must be in chronological
+ * order. The result is identical to calling tt_tap_at() on every
+ * element of the array in order, but since the intervals between
+ * consecutive taps telescope into a single difference, the means and
+ * the median only fold in the last TT_WINDOW_CAP intervals. With
+ * TT_STATS defined, the statistics still take every interval into
+ * account. The Kalman filter estimator and the tempo change detection
+ * (see tt_set_change_detection()) are tapped for every element in turn.
+ * 
+ */
+void tt_tap_batch(tempo_tapper *tapper, const tt_time_t *times, size_t n);
+
+/**
+ * @brief Returns the generation counter of the tempo tapper
+ * 
+ * The following function returns a counter that is incremented whenever
+ * the tempo tapper is tapped, reset or reconfigured, i.e. whenever the values
+ * returned by tt_period_us() and tt_bpm() may have changed. Callers that poll
+ * the tempo can store the generation and skip their work as long as it stays
+ * the same.
+ * 
+ * @return Generation counter, wraps around after 2^32 changes
+ */
+uint32_t tt_generation(tempo_tapper *tapper);
+
+#if TT_OBSERVERS > 0
+
+/**
+ * @brief Registers a callback for tempo changes and resets
+ * 
+ * The following function registers a callback that is invoked with TT_EVENT_TEMPO
+ * whenever a tap moves the tempo by more than hysteresis BPM away from the tempo last
+ * reported to the callback, and with TT_EVENT_RESET whenever the tempo tapper is reset.
+ * The first tempo after a reset is always reported. A hysteresis of 0 reports every change.
+ * 
+ * Callbacks are invoked from tt_tap(), tt_tap_at(), tt_tap_batch() and tt_reset(), at most
+ * once per call, in the order of their slots. They may read the tempo tapper, but must not
+ * tap, reset or reconfigure it. Without observers, taps only check for an empty slot mask.
+ * 
+ * Observers are removed by tt_init(), but kept across tt_reset().
+ * 
+ * @return Slot of the observer, to be passed to tt_unobserve(), or -1 if all TT_OBSERVERS
+ *         slots are in use, cb is NULL or hysteresis is negative
+ */
+int tt_observe(tempo_tapper *tapper, BPM_t hysteresis, tt_observer_cb cb, void *arg);
+
+/**
+ * @brief Unregisters a callback registered by tt_observe()
+ */
+void tt_unobserve(tempo_tapper *tapper, int slot);
+
+#endif
+
+/**
+ * @brief Selects between the cumulative and sliding window tempo
+ * 
+ * The following function sets the number of most recent intervals
+ * that tt_period_us() and tt_bpm() average over. A length of 0 selects
+ * the cumulative average over all intervals since the last reset, which
+ * is the default. Intervals tapped before the call are taken into account,
+ * and the window length is kept across tt_reset().
+ * 
+ * @return 0 on success, -1 if n exceeds TT_WINDOW_CAP
+ */
+int tt_set_window(tempo_tapper *tapper, unsigned int n);
+
+/**
+ * @brief Selects the tempo estimator
+ * 
+ * The following function selects how tt_period_us() and tt_bpm() derive the tempo
+ * from the tapped intervals. TT_EST_MEAN averages the intervals, either cumulatively
+ * or over the sliding window. TT_EST_MEDIAN returns the median interval of the sliding
+ * window, or of the last TT_WINDOW_CAP intervals if no window has been set, so that a
+ * single missed or doubled tap does not skew the tempo. The median is maintained
+ * in a sorted array, costing a binary search and a short memmove per tap. It is only
+ * available if TT_MEDIAN is defined.
+ * 
+ * TT_EST_KALMAN tracks the beat phase and the period with a Kalman filter, which models
+ * taps as beats with timing errors of TT_KALMAN_JITTER_US and lets the period drift by
+ * TT_KALMAN_DRIFT per beat. Unlike the means, it weighs recent taps more, so it follows
+ * gradual tempo changes such as a ritardando with less than half the tempo error of a
+ * window mean over 8 intervals. In turn, it keeps following the jitter on steady tempos,
+ * where its tempo error is larger than that of the window mean, and several times that
+ * of the cumulative mean (see the kalman_ramp_posix.cxx example). An update costs about
+ * twenty arithmetic operations, in fixed-point on Arduino platforms (see TT_KALMAN_FIXED).
+ * The uncertainty of its estimate can be read with tt_covariance(). It ignores the window
+ * length, and is refitted to the last TT_WINDOW_CAP intervals when selected, or restarted
+ * from the mean interval if TT_WINDOW_CAP is 0. It is only available if TT_KALMAN is defined.
+ * 
+ * The estimator is kept across tt_reset().
+ * 
+ * @return 0 on success, -1 if est is not a valid estimator or is not compiled in
+ */
+int tt_set_estimator(tempo_tapper *tapper, tt_estimator est);
+
+#ifdef TT_CHANGE
+
+/**
+ * @brief Enables the automatic detection of tempo changes
+ * 
+ * Without a reset, the cumulative mean only converges to a new tempo after many
+ * taps. With change detection enabled, every interval is compared against a
+ * reference period, in units of the tap jitter, both of which the tempo tapper
+ * measures as it is tapped, averaging only intervals that are not outliers.
+ * Deviations in either direction are accumulated by a two-sided CUSUM, which
+ * tolerates deviations of up to TT_CHANGE_DRIFT standard deviations per interval.
+ * Once either sum reaches the threshold, the tempo is restarted from the intervals
+ * that have accumulated, as if the tempo tapper had been reset just before the new
+ * tempo, which works with all estimators. The first TT_CHANGE_WARMUP intervals after
+ * a reset or restart only measure the reference period.
+ * 
+ * As each interval contributes at most a third of the threshold, at least three
+ * deviating intervals are needed for a restart. A missed tap makes one long interval,
+ * and the two short intervals of a doubled tap, which add up to the reference period,
+ * count as one, so neither triggers a restart on its own. A clear tempo change is
+ * detected after three taps, a subtle one after a few more, and a doubled tempo, whose
+ * intervals pair up like doubled taps, after five. Lower thresholds detect changes
+ * sooner but restart more often on steady tempos. A threshold of 5 suits tapping by
+ * hand. A threshold of 0 disables the detection, which is the default.
+ * 
+ * The threshold is kept across tt_reset(). While enabled, tt_tap_batch() folds taps
+ * one by one.
+ * 
+ * @note This function is only available if TT_CHANGE is defined.
+ * 
+ * @return 0 on success, -1 if threshold is negative
+ */
+int tt_set_change_detection(tempo_tapper *tapper, float threshold);
+
+/**
+ * @brief Returns the number of detected tempo changes
+ * 
+ * The following function returns how many times the tempo has been restarted by the change
+ * detection (see tt_set_change_detection()) since the tempo tapper has been initialized.
+ * 
+ * @note This function is only available if TT_CHANGE is defined.
+ */
+uint32_t tt_changes(tempo_tapper *tapper);
+
+#endif
+
 /**
  * @brief Resets the tempo tapper
  * 
@@ -199,3 +764,107 @@ void tt_reset(tempo_tapper *tapper);
  * @return Tempo in BPM 
  */
 BPM_t tt_bpm(tempo_tapper *tapper);
+
+/**
+ * @brief Returns the tempo in BPM as fixed-point value
+ * 
+ * The following function returns the tempo of the tempo tapper in BPM,
+ * in unsigned Q16.16 fixed-point format (see BPM_fx_t), rounded to the
+ * nearest 1/65536 BPM. Unlike tt_bpm(), no floating-point arithmetic is
+ * involved: the division is performed by a 32 step shift-and-subtract
+ * loop on 32 bit integers, which avoids soft-float and 64 bit division
+ * routines on platforms without FPU, such as AVR based Arduinos.
+ * 
+ * Tempos of 65536 BPM and above, i.e. periods shorter than 916us, saturate to UINT32_MAX.
+ * 
+ * To convert the result to an integer BPM, shift it right by TT_BPM_FX_SHIFT.
+ * 
+ * @return Tempo in BPM as Q16.16 fixed-point value, 0 if no tempo has been tapped
+ */
+BPM_fx_t tt_bpm_fx(tempo_tapper *tapper);
+
+/**
+ * @brief Returns the period of a tempo in clock ticks
+ * 
+ * The following function returns the period of the current tempo in
+ * tt_time_t ticks (see TT_TICKS_PER_US), without converting it to microseconds.
+ * 
+ * @return Period time in clock ticks
+ */
+tt_time_t tt_period_ticks(tempo_tapper *tapper);
+
+/**
+ * @brief Predicts the clock time of the next beat
+ * 
+ * The following function stores the clock time of the first beat after the
+ * clock time now in beat. The beat grid is fitted to the taps of the sliding
+ * window, or of the last TT_WINDOW_CAP intervals if no window has been set, such
+ * that the squared distance between the taps and their beats is minimal. If
+ * TT_WINDOW_CAP is 0, the grid is anchored at the last tap instead.
+ * 
+ * With a sliding window mean, both period and phase of the grid are fitted, which
+ * lowers the jitter of predictions by about a third compared to the mean period, so the spacing of
+ * beats may slightly differ from tt_period_ticks(). The cumulative mean and the
+ * median only fit the phase, and space beats by tt_period_ticks().
+ * 
+ * Schedulers can use the result as a deadline to sleep until, instead of
+ * polling the clock. The fit is memoized along with the tempo, so repeated
+ * calls between taps only cost a division.
+ * 
+ * @return 0 on success, -1 if no tempo has been tapped yet
+ */
+int tt_next_beat_time(tempo_tapper *tapper, tt_time_t *now, tt_time_t *beat);
+
+/**
+ * @brief Returns the phase of the beat at a given clock time
+ * 
+ * The following function returns how far the clock time now lies within
+ * its beat (see tt_next_beat_time()), ranging from 0 on a beat up to,
+ * but excluding, 1 on the next beat.
+ * 
+ * @return Phase within [0, 1), 0 if no tempo has been tapped yet
+ */
+float tt_phase(tempo_tapper *tapper, tt_time_t *now);
+
+/**
+ * @brief Returns the number of predicted beats up to a given clock time
+ * 
+ * The following function returns the number of beats (see tt_next_beat_time())
+ * after the clock time now, up to and including the clock time t.
+ * 
+ * @return Number of beats, 0 if t is not after now or no tempo has been tapped yet
+ */
+unsigned long tt_beats_until(tempo_tapper *tapper, tt_time_t *now, tt_time_t *t);
+
+#ifdef TT_KALMAN
+
+/**
+ * @brief Reads the uncertainty of the Kalman filter tempo
+ * 
+ * The following function stores the covariance of the beat phase and period
+ * estimated by the Kalman filter (see TT_EST_KALMAN) in cov. The covariance only
+ * depends on the number of taps and on the noise model, and shrinks as taps come in.
+ * 
+ * @note This function is only available if TT_KALMAN is defined.
+ * 
+ * @return 0 on success, -1 if the Kalman filter estimator is not selected or no tempo has been tapped yet
+ */
+int tt_covariance(tempo_tapper *tapper, tt_tempo_cov *cov);
+
+#endif
+
+#ifdef TT_STATS
+
+/**
+ * @brief Reads the statistics of the tapped intervals
+ * 
+ * The following function stores the running statistics of all intervals tapped
+ * since the last reset in stats, ex. to judge whether a tapped tempo can be trusted.
+ * The statistics are updated in constant time on every tap, using Welford's algorithm
+ * for the variance.
+ * 
+ * @note This function is only available if TT_STATS is defined.
+ */
+void tt_stats(tempo_tapper *tapper, tt_tap_stats *stats);
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_analysis.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Offline tempo analysis of audio files
+ *
+ * The following file provides an offline tempo analysis engine, which estimates
+ * the tempo of whole recordings, ex. to tag a music catalog with BPM.
+ *
+ * The novelty function of a recording is computed by the onset detector (see
+ * tt_onset_envelope()). Its autocorrelation is then scored for every lag within
+ * the configured tempo range by a comb filter, which sums the autocorrelation at
+ * the first TT_ANALYSIS_COMB multiples of the lag, so that tempos whose beats line
+ * up with the whole rhythmic pattern score highest. A log-normal prior around
+ * 120 BPM picks between a tempo and its octaves, and the winning lag is refined
+ * by parabolic interpolation. The octave is then checked against the accents of
+ * the onsets: if the onsets one period apart alternate between strong and weak,
+ * like kicks and hi-hats, only the strong ones are taken as beats, and if the
+ * onsets half a period apart are equally strong, all of them are. The period is
+ * finally reported in BPM.
+ *
+ * WAV files are read trough memory mappings. Batches of files are analyzed on
+ * one worker thread per online CPU, using a work-stealing scheduler: every
+ * worker owns a deque of files, takes files from its back and, once it runs dry,
+ * steals files from the front of other workers' deques, so that long files do
+ * not stall a batch.
+ *
+ * @note This file is only available on POSIX platforms.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#include "tempo_tapper.h"
+
+#define TT_ANALYSIS_COMB 4      ///< Number of lag multiples summed by the comb filter
+
+/**
+ * @brief Status of an analysis
+ */
+typedef enum tt_analysis_status
+{
+        TT_ANALYSIS_OK = 0,             ///< Tempo has been estimated
+        TT_ANALYSIS_EIO = -1,           ///< File could not be opened or mapped
+        TT_ANALYSIS_EFORMAT = -2,       ///< File is not a 16 bit PCM WAV file, or has unsupported parameters
+        TT_ANALYSIS_ENOMEM = -3,        ///< Memory allocation failed
+        TT_ANALYSIS_ESHORT = -4,        ///< Recording is too short to span the slowest tempo several times
+} tt_analysis_status;
+
+/**
+ * @brief Analysis configuration
+ */
+typedef struct tt_analysis_cfg
+{
+        BPM_t min_bpm;          ///< Slowest tempo considered
+        BPM_t max_bpm;          ///< Fastest tempo considered
+} tt_analysis_cfg;
+
+/**
+ * @brief Analysis result
+ */
+typedef struct tt_analysis_result
+{
+        tt_analysis_status status;      ///< Outcome of the analysis
+        BPM_t bpm;                      ///< Estimated tempo in BPM (see tt_bpm()), 0 on failure
+        float confidence;               ///< Normalized comb filter score of the tempo, from 0 to 1
+        double duration;                ///< Duration of the recording in seconds
+} tt_analysis_result;
+
+/**
+ * @brief Fills an analysis configuration with defaults
+ *
+ * The default tempo range is 60 to 200 BPM.
+ */
+void tt_analysis_defaults(tt_analysis_cfg *cfg);
+
+/**
+ * @brief Estimates the tempo of a recording in memory
+ *
+ * The following function estimates the tempo of frames of interleaved 16 bit
+ * PCM audio. If cfg is NULL, the defaults are used.
+ *
+ * @return Status of the analysis, also stored in res
+ */
+tt_analysis_status tt_analyze_pcm(const int16_t *pcm, size_t frames, unsigned int rate, unsigned int channels,
+                                  const tt_analysis_cfg *cfg, tt_analysis_result *res);
+
+/**
+ * @brief Estimates the tempo of a WAV file
+ *
+ * The following function maps a 16 bit PCM WAV file into memory and estimates
+ * its tempo (see tt_analyze_pcm()).
+ *
+ * @return Status of the analysis, also stored in res
+ */
+tt_analysis_status tt_analyze_file(const char *path, const tt_analysis_cfg *cfg, tt_analysis_result *res);
+
+/**
+ * @brief Estimates the tempo of a batch of WAV files in parallel
+ *
+ * The following function analyzes n files (see tt_analyze_file()) on the given
+ * number of worker threads, or on one thread per online CPU if threads is 0, and
+ * stores the result of paths[i] in results[i].
+ *
+ * @return 0 on success, -1 if the worker threads could not be started
+ */
+int tt_analyze_batch(const char *const *paths, size_t n, unsigned int threads,
+                     const tt_analysis_cfg *cfg, tt_analysis_result *results);
+
+/**
+ * @brief Writes analysis results as JSON lines
+ *
+ * The following function writes one JSON object per file to f, in the order of
+ * paths, ex:
+ * ```
+ * {"file":"track.wav","status":"ok","bpm":128.00,"confidence":0.71,"duration":183.40}
+ * ```
+ *
+ * @return 0 on success, -1 on write errors
+ */
+int tt_analysis_write_jsonl(FILE *f, const char *const *paths, const tt_analysis_result *results, size_t n);
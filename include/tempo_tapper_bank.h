@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_bank.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Multi-channel tempo tapper bank
+ *
+ * The following file provides a tempo tapper bank, which tracks the tempo
+ * of many independent channels. Instead of an array of tempo tapper structs,
+ * the bank stores the period sums, last tap times and tap counts of all
+ * channels in separate, 32 byte aligned arrays. Tapping a channel only
+ * touches its own entries, while the tempo of all channels is evaluated
+ * in a single pass over the arrays, using AVX2 or SSE2 where available.
+ *
+ * Channels of a bank always use the cumulative mean (see tt_period_us()),
+ * sliding windows and other estimators are only provided by tempo_tapper.
+ */
+
+#pragma once
+
+#include "tempo_tapper.h"
+
+/**
+ * @brief Tempo tapper bank struct
+ *
+ * The following struct represents n tempo tappers, or channels, stored as
+ * struct of arrays. Entry k of every array belongs to channel k.
+ */
+typedef struct tt_bank
+{
+        tt_time_t *prd_sum;     ///< Sum of all tapped periods per channel
+        tt_time_t *lst_t;       ///< Clock time of the last tap per channel
+        int32_t *taps;          ///< Number of taps per channel, -1 after a reset
+        size_t n;               ///< Number of channels
+        void *mem;              ///< Allocation backing all arrays
+} tt_bank;
+
+/**
+ * @brief Creates a new tempo tapper bank
+ *
+ * The following function allocates and resets a tempo tapper bank with n channels.
+ *
+ * @return A initialized tt_bank struct instance or NULL on failure
+ */
+tt_bank* tt_bank_new(size_t n);
+
+/**
+ * @brief Frees a tempo tapper bank created by tt_bank_new()
+ */
+void tt_bank_free(tt_bank *bank);
+
+/**
+ * @brief "Taps" channel k of the tempo tapper bank
+ */
+void tt_bank_tap(tt_bank *bank, size_t k);
+
+/**
+ * @brief "Taps" channel k of the tempo tapper bank at a given clock time (see tt_tap_at())
+ */
+void tt_bank_tap_at(tt_bank *bank, size_t k, tt_time_t *time);
+
+/**
+ * @brief Resets channel k of the tempo tapper bank
+ */
+void tt_bank_reset(tt_bank *bank, size_t k);
+
+/**
+ * @brief Returns the period of channel k in microseconds (see tt_period_us())
+ */
+unsigned long tt_bank_period_us(tt_bank *bank, size_t k);
+
+/**
+ * @brief Returns the tempo of channel k in BPM (see tt_bpm())
+ */
+BPM_t tt_bank_bpm(tt_bank *bank, size_t k);
+
+/**
+ * @brief Evaluates the period and tempo of all channels
+ *
+ * The following function stores the period in microseconds and the tempo in
+ * BPM of every channel in the period_us and bpm arrays, which must hold at least
+ * bank->n elements each. The results are identical to those of tt_bank_period_us()
+ * and tt_bank_bpm(), as long as the period sum of a channel stays below 2^52 ticks.
+ *
+ * On x86-64, the channels are evaluated with AVX2 if supported by the CPU, and
+ * with SSE2 otherwise. Other architectures use a scalar loop.
+ */
+void tt_bank_eval(tt_bank *bank, unsigned long *period_us, BPM_t *bpm);
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_clock.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Real-time beat clock driven by a concurrent tempo tapper
+ *
+ * The following file provides a beat clock, which runs a dedicated thread that
+ * calls user callbacks on every beat, and optionally on subdivisions of a beat,
+ * of the tempo tapped into a @ref tt_conc "concurrent tempo tapper".
+ *
+ * Deadlines are never accumulated from the previous wakeup. Instead, every
+ * deadline is derived from the predicted beat grid (see tt_next_beat_time()),
+ * so wakeup lateness does not add up to drift, and taps re-align the clock
+ * to the tapped phase. The thread sleeps until each deadline with
+ * clock_nanosleep() on an absolute time, and re-reads the beat grid at least
+ * every TT_BEAT_CLOCK_MAX_SLEEP_NS, so that a new tempo takes effect quickly.
+ *
+ * @note This file is only available on POSIX platforms.
+ */
+
+#pragma once
+
+#include <pthread.h>
+
+#include <atomic>
+
+#include "tempo_tapper.h"
+#include "tempo_tapper_conc.h"
+
+#ifndef TT_BEAT_CLOCK_MAX_SLEEP_NS
+#define TT_BEAT_CLOCK_MAX_SLEEP_NS 20000000     ///< Longest sleep before the beat grid is re-read, in nanoseconds
+#endif
+
+/**
+ * @brief Beat clock tick passed to the callbacks
+ */
+typedef struct tt_beat_event
+{
+        uint64_t beat;          ///< Number of beats fired before this tick since the clock has been started
+        unsigned int sub;       ///< Subdivision within the beat, 0 on the beat itself
+        tt_time_t deadline;     ///< Scheduled clock time of the tick (see current_time())
+        int64_t late_ns;        ///< Wakeup lateness in nanoseconds
+} tt_beat_event;
+
+/**
+ * @brief Beat clock callback
+ *
+ * Callbacks run on the beat clock thread and should return quickly, as any
+ * time spent in them delays the following tick.
+ */
+typedef void (*tt_beat_cb)(const tt_beat_event *ev, void *arg);
+
+/**
+ * @brief Beat clock configuration
+ */
+typedef struct tt_beat_clock_cfg
+{
+        unsigned int subdiv;    ///< Ticks per beat, 1 to only tick on beats
+        tt_beat_cb on_beat;     ///< Called on every beat, may be NULL
+        tt_beat_cb on_sub;      ///< Called on every subdivision besides the beat itself, may be NULL
+        void *arg;              ///< Argument passed to the callbacks
+        int priority;           ///< SCHED_FIFO priority of the clock thread, 0 keeps the default scheduling policy
+        int cpu;                ///< CPU the clock thread is pinned to, -1 disables pinning
+} tt_beat_clock_cfg;
+
+/**
+ * @brief Wakeup lateness statistics of a beat clock
+ *
+ * The lateness is the time between a deadline and the wakeup of the clock thread,
+ * measured on the clock the thread sleeps on.
+ */
+typedef struct tt_beat_stats
+{
+        uint64_t ticks;         ///< Number of fired ticks
+        uint64_t missed;        ///< Number of ticks skipped because the thread woke up after the following tick
+        int64_t late_min_ns;    ///< Lowest lateness
+        int64_t late_max_ns;    ///< Highest lateness
+        double late_avg_ns;     ///< Average lateness
+        double late_sd_ns;      ///< Standard deviation of the lateness, i.e. the wakeup jitter
+} tt_beat_stats;
+
+/**
+ * @brief Beat clock struct
+ *
+ * The following struct represents a beat clock. It must be initialized with tt_beat_clock_init()
+ * and destroyed with tt_beat_clock_destroy(). In between, it can be started with tt_beat_clock_start()
+ * and stopped with tt_beat_clock_stop() any number of times. It must be stopped before the concurrent
+ * tempo tapper it reads from goes out of scope.
+ */
+typedef struct tt_beat_clock
+{
+        tt_conc *conc;                  ///< Concurrent tempo tapper providing the beat grid
+        tt_beat_clock_cfg cfg;          ///< Configuration passed to tt_beat_clock_start()
+        pthread_t thread;               ///< Beat clock thread
+        std::atomic<bool> running;      ///< Cleared to stop the beat clock thread
+
+        pthread_mutex_t stats_lock;     ///< Protects the statistics below
+        uint64_t ticks;
+        uint64_t missed;
+        int64_t late_min_ns;
+        int64_t late_max_ns;
+        double late_sum;
+        double late_sq_sum;
+} tt_beat_clock;
+
+/**
+ * @brief Initializes a beat clock
+ *
+ * The following function initializes a stopped beat clock on caller provided storage,
+ * with empty statistics.
+ *
+ * @return 0 on success, otherwise an error number of pthread_mutex_init()
+ */
+int tt_beat_clock_init(tt_beat_clock *clk);
+
+/**
+ * @brief Destroys a beat clock initialized by tt_beat_clock_init()
+ *
+ * The following function stops the beat clock, if it is running, and releases its resources.
+ */
+void tt_beat_clock_destroy(tt_beat_clock *clk);
+
+/**
+ * @brief Starts a beat clock
+ *
+ * The following function starts a thread that fires the callbacks of cfg on every
+ * tick of the tempo tapped into conc. Until a tempo has been tapped, the thread
+ * idles. Ticks are only fired after the clock has been started. The statistics are
+ * cleared on every start.
+ *
+ * If cfg->priority is non-zero, the thread runs with the SCHED_FIFO policy at the
+ * given priority, which usually requires the CAP_SYS_NICE capability. If cfg->cpu
+ * is not negative, the thread is pinned to the given CPU, which is only supported
+ * on Linux.
+ *
+ * @return 0 on success, otherwise an error number, ex. EPERM if the real-time priority
+ * has been denied, ENOTSUP if CPU pinning is not supported, or EBUSY if the beat clock
+ * is already running
+ */
+int tt_beat_clock_start(tt_beat_clock *clk, tt_conc *conc, const tt_beat_clock_cfg *cfg);
+
+/**
+ * @brief Stops a beat clock
+ *
+ * The following function stops the beat clock thread and waits for it to exit,
+ * which takes at most TT_BEAT_CLOCK_MAX_SLEEP_NS plus the duration of a callback.
+ */
+void tt_beat_clock_stop(tt_beat_clock *clk);
+
+/**
+ * @brief Reads the wakeup lateness statistics of a beat clock
+ *
+ * The statistics may be read while the beat clock is running, as well as after it
+ * has been stopped.
+ */
+void tt_beat_clock_stats(tt_beat_clock *clk, tt_beat_stats *stats);
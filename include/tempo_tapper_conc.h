@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_conc.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Concurrent tempo tapper for multi-threaded applications
+ *
+ * The following file provides a tempo tapper that can be tapped, reset and
+ * read from multiple threads without locks.
+ *
+ * Producers push timestamped taps and resets into a bounded lock-free
+ * multi-producer queue. The events are applied to an embedded tempo tapper
+ * by whichever thread manages to drain the queue, which is done by readers
+ * and, once the queue runs full, by producers. After each drain, the
+ * resulting tempo is published trough a sequence lock, so readers always
+ * get a consistent snapshot without blocking producers.
+ *
+ * @note This file is only available on POSIX platforms.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "tempo_tapper.h"
+
+#ifndef TT_CONC_QUEUE_CAP
+#define TT_CONC_QUEUE_CAP 256   ///< Capacity of the event queue, must be a power of two
+#endif
+
+/**
+ * @brief Consistent snapshot of a concurrent tempo tapper
+ */
+typedef struct tt_conc_snapshot
+{
+        int taps;               ///< Number of taps, -1 after a reset (see tempo_tapper)
+        unsigned long period_us;///< Period of the tempo in microseconds (see tt_period_us())
+        BPM_t bpm;              ///< Tempo in BPM (see tt_bpm())
+        tt_time_t lst_t;        ///< Clock time of the last applied tap
+        tt_time_t beat_anchor;  ///< Clock time of a beat of the predicted beat grid (see tt_next_beat_time())
+        tt_time_t beat_prd;     ///< Period of the predicted beat grid in clock ticks, 0 if no tempo has been tapped
+} tt_conc_snapshot;
+
+/**
+ * @brief Concurrent tempo tapper struct
+ *
+ * The following struct represents a tempo tapper that can be shared across threads.
+ * It must be initialized with tt_conc_init(). The embedded tempo tapper may be configured
+ * (ex. with tt_set_window() or tt_set_estimator()) before the struct is shared, but must
+ * not be accessed directly afterwards.
+ */
+typedef struct tt_conc
+{
+        struct event {
+                std::atomic<size_t> seq;        ///< Sequence number of the queue slot
+                tt_time_t time;                 ///< Clock time of the tap
+                bool reset;                     ///< Event is a reset instead of a tap
+        } queue[TT_CONC_QUEUE_CAP];             ///< Bounded multi-producer event queue
+
+        alignas(64) std::atomic<size_t> tail;   ///< Next queue position to be claimed by a producer
+        alignas(64) size_t head;                ///< Next queue position to be drained
+        std::atomic_flag draining;              ///< Held by the thread draining the queue
+
+        tempo_tapper tt;                        ///< Tempo tapper the events are applied to, owned by the draining thread
+
+        alignas(64) std::atomic<unsigned> snap_seq;     ///< Snapshot sequence lock, odd while being written
+        std::atomic<int> snap_taps;
+        std::atomic<unsigned long> snap_period_us;
+        std::atomic<BPM_t> snap_bpm;
+        std::atomic<tt_time_t> snap_lst_t;
+        std::atomic<tt_time_t> snap_beat_anchor;
+        std::atomic<tt_time_t> snap_beat_prd;
+
+        std::atomic<unsigned long> rejected;    ///< Number of taps rejected due to a full queue or out-of-order timestamps
+} tt_conc;
+
+/**
+ * @brief Initializes a concurrent tempo tapper
+ *
+ * The following function initializes a concurrent tempo tapper on caller
+ * provided storage. It must not be called while other threads access the struct.
+ */
+void tt_conc_init(tt_conc *conc);
+
+/**
+ * @brief "Taps" the concurrent tempo tapper
+ *
+ * The following function reads the current clock time and enqueues a tap.
+ * It may be called from any number of threads at once.
+ *
+ * @return 0 on success, -1 if the tap has been rejected because the queue is full
+ */
+int tt_conc_tap(tt_conc *conc);
+
+/**
+ * @brief "Taps" the concurrent tempo tapper at a given clock time (see tt_tap_at())
+ *
+ * Taps that are drained together are applied in chronological order. Taps that are
+ * older than an already applied tap are rejected when drained.
+ *
+ * @return 0 on success, -1 if the tap has been rejected because the queue is full
+ */
+int tt_conc_tap_at(tt_conc *conc, tt_time_t *time);
+
+/**
+ * @brief Resets the concurrent tempo tapper
+ *
+ * The reset is queued along with the taps, so that taps enqueued before the
+ * reset do not count towards the new tempo.
+ *
+ * @return 0 on success, -1 if the queue is full
+ */
+int tt_conc_reset(tt_conc *conc);
+
+/**
+ * @brief Applies queued events
+ *
+ * The following function applies up to TT_CONC_QUEUE_CAP queued events to the
+ * embedded tempo tapper and publishes a new snapshot. If another thread is already draining the queue,
+ * the function returns immediately.
+ *
+ * @return true if the queue has been drained by the calling thread
+ */
+bool tt_conc_drain(tt_conc *conc);
+
+/**
+ * @brief Reads a consistent snapshot of the concurrent tempo tapper
+ *
+ * The following function drains the queue, unless another thread is already
+ * doing so, and reads the most recently published snapshot. It never waits
+ * for producers.
+ */
+void tt_conc_read(tt_conc *conc, tt_conc_snapshot *snap);
+
+/**
+ * @brief Returns the period of the concurrent tempo tapper in microseconds (see tt_period_us())
+ */
+unsigned long tt_conc_period_us(tt_conc *conc);
+
+/**
+ * @brief Returns the tempo of the concurrent tempo tapper in BPM (see tt_bpm())
+ */
+BPM_t tt_conc_bpm(tt_conc *conc);
+
+/**
+ * @brief Returns the number of rejected taps
+ */
+unsigned long tt_conc_rejected(tt_conc *conc);
@@ -39,18 +39,19 @@
  * @brief C++ wrapper for the tempo tapper library
  * 
  * The following class wraps around the C interface
- * of the tempo tapper library.
+ * of the tempo tapper library. The tempo tapper struct is
+ * stored within the object itself, so objects can be freely
+ * placed on the stack, in arrays or in other objects, and be copied.
  * 
  */
 class tempo_tapper_cpp {
 private:
-        tempo_tapper *_tt;
+        tempo_tapper _tt;          ///< Stored by value, no heap allocation is involved
 
 public:
-        tempo_tapper_cpp();        ///< Wraps around tt_new()
-        ~tempo_tapper_cpp();
+        tempo_tapper_cpp();        ///< Wraps around tt_init()
 
-        bool is_init();            ///< Returns if class has been (successfully) initialized
+        bool is_init();            ///< Returns if class has been (successfully) initialized. Always true, kept for compatibility
 
         unsigned long period_us(); ///< Wraps around tt_period_us()
         void tap();                ///< Wraps around tt_tap()
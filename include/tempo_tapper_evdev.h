@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_evdev.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Kernel timestamped tap input from Linux input devices
+ *
+ * The following file provides an input front-end, which taps a tempo tapper on key
+ * presses of Linux input devices (/dev/input/event*), ex. keyboards, foot switches or
+ * MIDI-less drum pads that register as keyboards.
+ *
+ * Reading taps from a terminal timestamps them with the time at which the process
+ * handles the key, after the kernel delivered it to the terminal, the scheduler woke
+ * the process and any previous redraw has finished. All of these delays vary from tap
+ * to tap and thereby add to the interval jitter. Input devices instead timestamp every
+ * event in the kernel, when the driver reports it. The front-end waits for events with
+ * epoll, passes the kernel timestamp of every key press to tt_tap_at(), and records the
+ * delay between the kernel timestamp and the clock time at which the key press has been
+ * handled, i.e. the error that tt_tap() would have added.
+ *
+ * The kernel timestamps are taken from CLOCK_MONOTONIC, or CLOCK_REALTIME if the tempo
+ * tapper reads the wall clock (see tt_clock_init()), and are converted to the clock
+ * source of the tempo tapper by the offset between both clocks.
+ *
+ * For tests and demos without an input device at hand, a virtual keyboard can be
+ * created trough uinput (see tt_evdev_virtual_open()).
+ *
+ * Reading input devices usually requires membership in the input group, and creating
+ * virtual devices write access to /dev/uinput.
+ *
+ * @note This file is only available on Linux.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "tempo_tapper.h"
+
+#define TT_EVDEV_MAX_DEVICES 8          ///< Highest number of input devices read by one front-end
+
+/**
+ * @brief Key press reported by tt_evdev_poll()
+ *
+ * Key codes are defined in linux/input-event-codes.h, ex. KEY_ENTER.
+ */
+typedef struct tt_evdev_key
+{
+        unsigned short code;    ///< Key code of the pressed key
+        tt_time_t time;         ///< Kernel timestamp of the key press, converted to the clock time of the tempo tapper
+        bool tapped;            ///< True if the key press has tapped the tempo tapper
+} tt_evdev_key;
+
+/**
+ * @brief Wake-to-tap delay statistics of an input front-end
+ *
+ * The delay is the time between the kernel timestamp of a tapping key press and the
+ * clock time at which tt_evdev_poll() handled it.
+ */
+typedef struct tt_evdev_delay_stats
+{
+        uint64_t taps;          ///< Number of taps
+        int64_t delay_min_ns;   ///< Lowest delay
+        int64_t delay_max_ns;   ///< Highest delay
+        double delay_avg_ns;    ///< Average delay
+        double delay_sd_ns;     ///< Standard deviation of the delay, i.e. the jitter removed from the taps
+} tt_evdev_delay_stats;
+
+/**
+ * @brief Input front-end struct
+ *
+ * The following struct represents an input front-end. It must be initialized with
+ * tt_evdev_init() and released with tt_evdev_close().
+ */
+typedef struct tt_evdev
+{
+        tempo_tapper *tapper;                   ///< Tempo tapper tapped on key presses
+        unsigned short tap_code;                ///< Key code that taps, 0 to tap on every key
+        clockid_t clock;                        ///< Clock of the kernel timestamps
+        int epfd;                               ///< epoll instance waiting on the devices
+        int fds[TT_EVDEV_MAX_DEVICES];          ///< File descriptors of the opened devices
+        bool dropped[TT_EVDEV_MAX_DEVICES];     ///< Set while events of a device are discarded after a buffer overrun
+        unsigned int n_fds;                     ///< Number of opened devices
+
+        uint64_t taps;
+        int64_t delay_min_ns;
+        int64_t delay_max_ns;
+        double delay_sum;
+        double delay_sq_sum;
+} tt_evdev;
+
+/**
+ * @brief Virtual keyboard struct
+ *
+ * The following struct represents a virtual keyboard created trough uinput.
+ */
+typedef struct tt_evdev_virtual
+{
+        int fd;                 ///< File descriptor of /dev/uinput
+        char path[64];          ///< Path of the input device of the virtual keyboard, ex. /dev/input/event5
+} tt_evdev_virtual;
+
+/**
+ * @brief Initializes an input front-end
+ *
+ * The following function initializes an input front-end that taps the given tempo
+ * tapper whenever the key tap_code is pressed on any of its devices, or on every key
+ * press if tap_code is 0. Devices are added with tt_evdev_open().
+ *
+ * @return 0 on success, otherwise an error number
+ */
+int tt_evdev_init(tt_evdev *ev, tempo_tapper *tapper, unsigned short tap_code);
+
+/**
+ * @brief Adds an input device to an input front-end
+ *
+ * The following function opens the input device at path, ex. /dev/input/event3, and
+ * sets the clock of its timestamps. If grab is true, the device is grabbed, so that
+ * its key presses are no longer delivered to other readers, ex. the terminal.
+ *
+ * @return 0 on success, otherwise an error number, ex. EACCES if the device may not
+ * be read, or ENOSPC if TT_EVDEV_MAX_DEVICES devices have already been opened
+ */
+int tt_evdev_open(tt_evdev *ev, const char *path, bool grab);
+
+/**
+ * @brief Waits for key presses and taps them
+ *
+ * The following function waits up to timeout_ms milliseconds, or indefinitely if
+ * timeout_ms is negative, for events of the opened devices. All pending key presses
+ * are then read, each press of the tap key taps the tempo tapper at its kernel
+ * timestamp, and every key press is stored in keys. Key releases and auto-repeats
+ * are ignored.
+ *
+ * At most cap key presses are read per call, any further presses remain queued in
+ * the kernel until the next call. As they are tapped at their kernel timestamps,
+ * this does not affect the tempo. If keys is NULL, all pending presses are read.
+ *
+ * @return Number of key presses stored in keys, 0 on timeout, or a negative error number
+ */
+int tt_evdev_poll(tt_evdev *ev, int timeout_ms, tt_evdev_key *keys, size_t cap);
+
+/**
+ * @brief Reads the wake-to-tap delay statistics of an input front-end
+ */
+void tt_evdev_stats(tt_evdev *ev, tt_evdev_delay_stats *stats);
+
+/**
+ * @brief Closes all devices of an input front-end
+ */
+void tt_evdev_close(tt_evdev *ev);
+
+/**
+ * @brief Creates a virtual keyboard
+ *
+ * The following function creates a virtual keyboard trough uinput and waits up to a
+ * second for its input device to appear, whose path is stored in vd->path and can be
+ * passed to tt_evdev_open().
+ *
+ * @return 0 on success, otherwise an error number, ex. ENOENT if uinput is not available
+ * or the input device did not appear
+ */
+int tt_evdev_virtual_open(tt_evdev_virtual *vd);
+
+/**
+ * @brief Presses and releases a key of a virtual keyboard
+ *
+ * @return 0 on success, otherwise an error number
+ */
+int tt_evdev_virtual_press(tt_evdev_virtual *vd, unsigned short code);
+
+/**
+ * @brief Destroys a virtual keyboard
+ */
+void tt_evdev_virtual_close(tt_evdev_virtual *vd);
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_log.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Tap log recorder and replay engine
+ *
+ * The following file provides an append-only binary log of the taps and resets of
+ * one or many tempo tappers, ex. to capture a live show, and a replay engine that
+ * feeds a recorded log back into tempo tappers as fast as possible, ex. to reproduce
+ * tempo complaints or to run a regression corpus.
+ *
+ * A log consists of a 32 byte header, which holds the configuration of the recorded
+ * tempo tappers, followed by one 16 byte record per event, holding its clock time,
+ * channel and type. All fields are stored in little-endian byte order with fixed widths.
+ *
+ * The recorder preallocates the log file and maps it into memory, so that events are
+ * appended by storing a record into the mapping, without system calls or allocation.
+ * Several threads may append to the same log at once. Records reach the file even if
+ * the process crashes, as the kernel writes back the mapping. Records whose type is
+ * still 0 have not been written, trailing ones mark the end of the log.
+ *
+ * The replay engine applies every event to the tempo tapper of its channel through
+ * tt_tap_at() and tt_reset(). As taps carry their recorded clock times, no clock is
+ * read, and replaying a log always yields the same tempos, in the same order. To compare
+ * replays, the engine folds the tempo after every event into a digest.
+ *
+ * To record the exact time of a tap, read the clock once and pass the time to both
+ * the tempo tapper and the log:
+ * ```
+ *      tt_time_t t;
+ *      current_time(&t);
+ *      tt_tap_at(&tt[ch], &t);
+ *      tt_log_tap(&log, ch, &t);
+ * ```
+ *
+ * @note This file is only available on POSIX platforms.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "tempo_tapper.h"
+
+#define TT_LOG_MAGIC "TTLG"     ///< Magic bytes at the start of every log
+#define TT_LOG_VERSION 1        ///< Version of the log format written by this library
+
+/**
+ * @brief Log event types
+ */
+typedef enum tt_log_type
+{
+        TT_LOG_END = 0,         ///< Unwritten record, skipped on replay
+        TT_LOG_TAP = 1,         ///< Tap, see tt_tap_at()
+        TT_LOG_RESET = 2,       ///< Reset, see tt_reset()
+} tt_log_type;
+
+/**
+ * @brief Log header, little-endian
+ */
+typedef struct tt_log_header
+{
+        char magic[4];          ///< TT_LOG_MAGIC
+        uint16_t version;       ///< Format version, TT_LOG_VERSION
+        uint16_t record_size;   ///< Size of a record in bytes, sizeof(tt_log_record)
+        uint32_t ticks_per_us;  ///< Clock ticks per microsecond of the recorded clock times (see TT_TICKS_PER_US)
+        uint8_t est;            ///< Estimator of the recorded tempo tappers (see tt_set_estimator())
+        uint8_t reserved;       ///< 0
+        uint16_t win_len;       ///< Window length of the recorded tempo tappers (see tt_set_window())
+        uint32_t chg_h;         ///< Change detection threshold of the recorded tempo tappers, bits of an IEEE 754 float
+        uint32_t reserved2;     ///< 0
+        uint64_t reserved3;     ///< 0
+} tt_log_header;
+
+/**
+ * @brief Log record, little-endian
+ */
+typedef struct tt_log_record
+{
+        uint64_t time;          ///< Clock time of the event
+        uint32_t channel;       ///< Channel, i.e. index of the tempo tapper
+        uint8_t type;           ///< Event type (see tt_log_type), written last
+        uint8_t reserved[3];    ///< 0
+} tt_log_record;
+
+/**
+ * @brief Log recorder struct
+ *
+ * The following struct represents a log that is being recorded. It must be
+ * created with tt_log_create().
+ */
+typedef struct tt_log
+{
+        int fd;                         ///< Log file
+        void *map;                      ///< Mapping of the whole preallocated file
+        size_t map_len;                 ///< Length of the mapping in bytes
+        tt_log_record *records;         ///< Records within the mapping
+        size_t cap;                     ///< Number of records the file has been preallocated for
+        std::atomic<size_t> next;       ///< Index of the next record to be claimed
+        std::atomic<size_t> dropped;    ///< Number of events dropped due to a full log
+} tt_log;
+
+/**
+ * @brief Mapped log
+ *
+ * The following struct represents a recorded log opened by tt_log_map().
+ */
+typedef struct tt_log_view
+{
+        void *map;                      ///< Mapping of the whole file
+        size_t map_len;                 ///< Length of the mapping in bytes
+        const tt_log_header *hdr;       ///< Header within the mapping
+        const tt_log_record *records;   ///< Records within the mapping
+        size_t count;                   ///< Number of records up to the end of the log
+} tt_log_view;
+
+/**
+ * @brief Result of a replay
+ */
+typedef struct tt_replay_result
+{
+        uint64_t events;        ///< Number of applied events
+        uint64_t skipped;       ///< Number of events of channels beyond the replayed tempo tappers
+        uint64_t digest;        ///< FNV-1a hash of the channel and tt_bpm() after every applied event
+} tt_replay_result;
+
+/**
+ * @brief Callback invoked after every replayed event
+ *
+ * The callback receives the event, the tempo tapper it has been applied to
+ * and the user data passed to tt_replay().
+ */
+typedef void (*tt_replay_cb)(const tt_log_record *rec, tempo_tapper *tapper, void *arg);
+
+/**
+ * @brief Creates a log file for recording
+ *
+ * The following function creates the log file at path, replacing an existing file,
+ * preallocates it for capacity records and maps it into memory. The configuration of
+ * the recorded tempo tappers, i.e. their estimator, window length and change detection
+ * threshold, is taken from cfg, which may be NULL for the defaults (see tt_init()).
+ *
+ * @return 0 on success, -1 on errors, with errno set
+ */
+int tt_log_create(tt_log *log, const char *path, size_t capacity, const tempo_tapper *cfg);
+
+/**
+ * @brief Appends a tap to a log
+ *
+ * The following function appends a tap of the given channel at the given clock time.
+ * It may be called from any number of threads at once.
+ *
+ * @return 0 on success, -1 if the log is full
+ */
+int tt_log_tap(tt_log *log, uint32_t channel, tt_time_t *time);
+
+/**
+ * @brief Appends a reset to a log
+ *
+ * @return 0 on success, -1 if the log is full
+ */
+int tt_log_reset(tt_log *log, uint32_t channel, tt_time_t *time);
+
+/**
+ * @brief Returns the number of events appended to a log
+ */
+size_t tt_log_count(tt_log *log);
+
+/**
+ * @brief Closes a log
+ *
+ * The following function unmaps the log and truncates the file to the appended
+ * records. It must not be called while other threads append to the log.
+ *
+ * @return 0 on success, -1 on errors, with errno set
+ */
+int tt_log_close(tt_log *log);
+
+/**
+ * @brief Maps a recorded log
+ *
+ * The following function maps the log file at path into memory, validates its header
+ * and finds the end of the log. Logs that have not been closed, ex. after a crash, can
+ * be mapped as well.
+ *
+ * @return 0 on success, -1 on errors, with errno set (EINVAL for invalid logs)
+ */
+int tt_log_map(tt_log_view *view, const char *path);
+
+/**
+ * @brief Unmaps a recorded log
+ */
+void tt_log_unmap(tt_log_view *view);
+
+/**
+ * @brief Replays a recorded log
+ *
+ * The following function initializes the given number of tempo tappers with the
+ * configuration of the log, and applies every event of the log to the tempo tapper of
+ * its channel, converting clock times recorded on a platform with a different tick length.
+ * Events of channels beyond the number of tempo tappers are skipped. If cb is not NULL,
+ * it is invoked after every applied event. Logs of tempo tappers with change detection
+ * (see tt_set_change_detection()) can only be replayed if TT_CHANGE is defined, logs of the
+ * median estimator (see TT_EST_MEDIAN) only if TT_MEDIAN is defined, and logs of the
+ * Kalman filter estimator (see TT_EST_KALMAN) only if TT_KALMAN is defined.
+ *
+ * @return 0 on success, -1 if the configuration of the log is invalid
+ */
+int tt_replay(const tt_log_view *view, tempo_tapper *tappers, size_t channels,
+              tt_replay_cb cb, void *arg, tt_replay_result *res);
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_metrics.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Optional instrumentation of the tap and query paths
+ *
+ * The following file provides process-wide metrics of all tempo tappers, which are
+ * collected if TT_METRICS is defined in the compiler flags:
+ *
+ *      - Histograms of the duration of tt_tap() and tt_tap_at(), of the intervals
+ *        between taps, and of the staleness of queries, i.e. the time between the
+ *        last tap and a call to tt_bpm(), tt_bpm_fx() or tt_period_us()
+ *      - Counters of taps, resets, queries and taps rejected by concurrent tempo tappers
+ *
+ * Histograms are log-bucketed like HDR histograms: values below 16ns are counted
+ * exactly, larger values in TT_METRICS_SUB_BUCKETS buckets per power of two, so every
+ * value is recorded with a relative error below 1 / TT_METRICS_SUB_BUCKETS over the
+ * whole 64 bit range, at a fixed size and without allocation. All buckets and counters
+ * are relaxed atomics, so tempo tappers on different threads may record concurrently.
+ *
+ * The metrics can be written to a file descriptor in the Prometheus text exposition
+ * format, or as JSON with percentiles (see tt_metrics_dump()).
+ *
+ * Without TT_METRICS, the hooks in the tap and query paths are not compiled, and
+ * neither are the functions below, so instrumentation costs nothing.
+ *
+ * @note This file is only available on POSIX platforms.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "tempo_tapper.h"
+
+#ifdef TT_METRICS
+
+#ifndef TT_TARGET_PLATFORM_POSIX
+#error TT_METRICS is only supported on POSIX platforms
+#endif
+
+#define TT_METRICS_SUB_BITS 3                                   ///< Log2 of the number of buckets per power of two
+#define TT_METRICS_SUB_BUCKETS (1 << TT_METRICS_SUB_BITS)       ///< Number of buckets per power of two
+#define TT_METRICS_BUCKETS ((65 - TT_METRICS_SUB_BITS) * TT_METRICS_SUB_BUCKETS) ///< Number of buckets per histogram
+
+/**
+ * @brief Histograms, all values are in nanoseconds
+ */
+typedef enum tt_metrics_hist
+{
+        TT_METRICS_TAP_DURATION,        ///< Time spent in tt_tap() and tt_tap_at(), including one clock read
+        TT_METRICS_TAP_INTERVAL,        ///< Interval between two taps of a tempo tapper
+        TT_METRICS_STALENESS,           ///< Time since the last tap of a tempo tapper when its tempo is queried
+        TT_METRICS_HISTS,               ///< Number of histograms
+} tt_metrics_hist;
+
+/**
+ * @brief Counters
+ */
+typedef enum tt_metrics_counter
+{
+        TT_METRICS_TAPS,                ///< Taps, including those of tt_tap_batch()
+        TT_METRICS_RESETS,              ///< Calls to tt_reset()
+        TT_METRICS_QUERIES,             ///< Calls to tt_bpm(), tt_bpm_fx() and tt_period_us()
+        TT_METRICS_REJECTED,            ///< Taps rejected by concurrent tempo tappers (see tt_conc_rejected())
+        TT_METRICS_COUNTERS,            ///< Number of counters
+} tt_metrics_counter;
+
+/**
+ * @brief Output formats of tt_metrics_dump()
+ */
+typedef enum tt_metrics_format
+{
+        TT_METRICS_PROMETHEUS,          ///< Prometheus text exposition format, values in seconds
+        TT_METRICS_JSON,                ///< Single JSON object, values in nanoseconds
+} tt_metrics_format;
+
+/**
+ * @brief Records a value in a histogram
+ */
+void tt_metrics_record(tt_metrics_hist hist, uint64_t ns);
+
+/**
+ * @brief Adds to a counter
+ */
+void tt_metrics_add(tt_metrics_counter counter, uint64_t n);
+
+/**
+ * @brief Returns the value of a counter
+ */
+uint64_t tt_metrics_count(tt_metrics_counter counter);
+
+/**
+ * @brief Returns a percentile of a histogram
+ *
+ * The following function returns the highest value that falls into the same bucket
+ * as the given percentile, ranging from 0 to 100, of the values recorded in hist.
+ *
+ * @return Percentile in nanoseconds, 0 if no values have been recorded
+ */
+uint64_t tt_metrics_percentile(tt_metrics_hist hist, double percentile);
+
+/**
+ * @brief Writes all metrics to a file descriptor
+ *
+ * The following function writes all histograms and counters to fd in the given format.
+ * In the Prometheus format, histograms are reported with cumulative buckets at every
+ * power of two nanoseconds from 128ns to about 137s. In JSON, histograms are reported
+ * by their count, sum, 50th, 90th, 99th and 99.9th percentile and maximum.
+ *
+ * Metrics recorded while dumping may or may not be included.
+ *
+ * @return 0 on success, -1 on write errors, with errno set
+ */
+int tt_metrics_dump(int fd, tt_metrics_format fmt);
+
+/**
+ * @brief Clears all histograms and counters
+ */
+void tt_metrics_reset();
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_onset.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Streaming audio onset detector tapping a tempo tapper
+ *
+ * The following file provides an onset detector that consumes blocks of
+ * interleaved 16 bit PCM audio and "taps" a tempo tapper on every detected
+ * onset, i.e. on the start of every note or drum hit.
+ *
+ * The audio is split into hops of TT_ONSET_HOP frames. For each hop, the energy
+ * of the signal and the energy of its first difference, which emphasizes
+ * percussive transients, are computed with SSE2 where available. The novelty
+ * of a hop is the sum of the rectified increases of both log energies over the
+ * loudest of the TT_ONSET_LAG previous hops. A hop is picked as onset if its novelty is the maximum of its
+ * neighbourhood and exceeds the recent average novelty by a threshold.
+ *
+ * Onsets are timestamped by their position in the stream, counted in samples,
+ * rather than by current_time(). The position is refined to the sub-block of
+ * TT_ONSET_SUB frames with the steepest rise of transient energy, so onsets are
+ * located within TT_ONSET_SUB frames regardless of how the audio is buffered.
+ * Peak picking looks TT_ONSET_POST hops ahead, so onsets are tapped with a delay,
+ * but at their true stream time.
+ *
+ * @note This file is only available on POSIX platforms.
+ */
+
+#pragma once
+
+#include "tempo_tapper.h"
+
+#ifndef TT_ONSET_HOP
+#define TT_ONSET_HOP 512                ///< Frames per hop of the novelty function, must be a multiple of TT_ONSET_SUB
+#endif
+
+#define TT_ONSET_SUB 64                 ///< Frames per sub-block, used to locate onsets within a hop
+#define TT_ONSET_MAX_CHANNELS 8         ///< Highest supported number of interleaved channels
+#define TT_ONSET_PRE 16                 ///< Hops before a candidate averaged by the adaptive threshold
+#define TT_ONSET_POST 2                 ///< Hops after a candidate considered by peak picking
+#define TT_ONSET_LAG 2                  ///< Previous hops whose highest energy a hop is compared against
+#define TT_ONSET_HISTORY 32             ///< Size of the novelty history, a power of two above TT_ONSET_PRE + TT_ONSET_POST
+
+/**
+ * @brief Onset detector struct
+ *
+ * The following struct holds the state of an onset detector. It must be
+ * initialized with tt_onset_init().
+ */
+typedef struct tt_onset
+{
+        tempo_tapper *tapper;           ///< Tempo tapper tapped on every onset
+        unsigned int rate;              ///< Sample rate in Hz
+        unsigned int channels;          ///< Number of interleaved channels
+        tt_time_t start;                ///< Clock time of the first frame of the stream
+
+        int16_t buf[(TT_ONSET_HOP + 1) * TT_ONSET_MAX_CHANNELS];       ///< Last frame of the previous hop followed by the current hop
+        size_t buf_frames;              ///< Number of frames of the current hop buffered so far
+        uint64_t hops;                  ///< Number of processed hops
+
+        float prev_e[TT_ONSET_LAG];     ///< Log energy of the previous hops
+        float prev_d[TT_ONSET_LAG];     ///< Log transient energy of the previous hops
+        uint64_t prev_sub_d;            ///< Transient energy of the last sub-block of the previous hop
+
+        float nov[TT_ONSET_HISTORY];    ///< Novelty of the most recent hops
+        uint64_t pos[TT_ONSET_HISTORY]; ///< Onset position in frames of the most recent hops
+
+        float threshold;                ///< Novelty above the recent average required for an onset
+        unsigned int min_gap;           ///< Minimal number of hops between two onsets
+        uint64_t last_onset;            ///< Hop of the last onset
+        unsigned long onsets;           ///< Number of detected onsets
+} tt_onset;
+
+/**
+ * @brief Initializes an onset detector
+ *
+ * The following function initializes an onset detector for a stream with the given
+ * sample rate and number of interleaved channels, which taps the given tempo tapper.
+ * The tempo tapper may be NULL if only tt_onset_envelope() is used.
+ * Onsets are timestamped relative to the clock time start of the first frame, which
+ * may be NULL to start the stream at clock time 0.
+ *
+ * The threshold defaults to 0.3 and the minimal gap between onsets to 100ms (see
+ * tt_onset_set_threshold()).
+ *
+ * @return 0 on success, -1 if the rate or number of channels is not supported
+ */
+int tt_onset_init(tt_onset *od, tempo_tapper *tapper, unsigned int rate, unsigned int channels, tt_time_t *start);
+
+/**
+ * @brief Configures the sensitivity of an onset detector
+ *
+ * The following function sets the novelty above the recent average that is
+ * required for an onset, where the novelty is the rise of the log energy per hop,
+ * and the minimal gap between two onsets in milliseconds.
+ */
+void tt_onset_set_threshold(tt_onset *od, float threshold, unsigned int min_gap_ms);
+
+/**
+ * @brief Processes a block of audio
+ *
+ * The following function consumes frames of interleaved 16 bit PCM audio and taps
+ * the tempo tapper for every detected onset. Blocks may be of any size, frames
+ * that do not complete a hop are buffered until the next call.
+ *
+ * @return Number of onsets detected within the block
+ */
+size_t tt_onset_process(tt_onset *od, const int16_t *pcm, size_t frames);
+
+/**
+ * @brief Computes the novelty function of a block of audio
+ *
+ * The following function consumes frames of interleaved 16 bit PCM audio like
+ * tt_onset_process(), but instead of picking onsets, it stores the novelty of
+ * every completed hop in env, ex. for offline tempo analysis (see tempo_tapper_analysis.h).
+ * The tempo tapper is not tapped and may be NULL. At most cap values are stored,
+ * a block yields at most frames / TT_ONSET_HOP + 1 values.
+ *
+ * @return Number of novelty values stored in env
+ */
+size_t tt_onset_envelope(tt_onset *od, const int16_t *pcm, size_t frames, float *env, size_t cap);
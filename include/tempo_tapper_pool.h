@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_pool.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Fixed-capacity pool allocator for tempo tapper instances
+ *
+ * The following file provides a pool allocator that hands out and recycles
+ * tempo tapper instances from a caller provided array, without involving
+ * the system allocator. Acquiring and releasing an instance are O(1), as
+ * released instances are chained into an intrusive free list.
+ *
+ * Example:
+ * ```
+ *      static tempo_tapper slots[64];
+ *      static tt_pool pool;
+ *
+ *      tt_pool_init(&pool, slots, 64);
+ *      tempo_tapper *tt = tt_pool_acquire(&pool);
+ *      ...
+ *      tt_pool_release(&pool, tt);
+ * ```
+ */
+
+#pragma once
+
+#include "tempo_tapper.h"
+
+/**
+ * @brief Tempo tapper pool struct
+ *
+ * The following struct represents a pool of tempo tapper instances.
+ * Slots that have never been handed out are taken in order from the
+ * storage array, released slots are recycled trough the free list.
+ */
+typedef struct tt_pool
+{
+        tempo_tapper *slots;    ///< Caller provided storage
+        size_t cap;             ///< Number of slots in the storage
+        size_t fresh;           ///< Number of slots that have been handed out at least once
+        size_t used;            ///< Number of slots currently handed out
+        size_t peak;            ///< Highest number of slots handed out at once
+        tempo_tapper *free_lst; ///< Most recently released slot, the next one is stored within the slot itself
+} tt_pool;
+
+/**
+ * @brief Initializes a tempo tapper pool
+ *
+ * The following function initializes a pool that hands out the n
+ * tempo tapper instances stored in the slots array. The storage must
+ * outlive the pool. Initialization does not touch the storage.
+ */
+void tt_pool_init(tt_pool *pool, tempo_tapper *slots, size_t n);
+
+/**
+ * @brief Acquires a tempo tapper instance from the pool
+ *
+ * The following function hands out an initialized (see tt_init())
+ * tempo tapper instance from the pool.
+ *
+ * @return A initialized tempo_tapper struct instance or NULL if the pool is exhausted
+ */
+tempo_tapper* tt_pool_acquire(tt_pool *pool);
+
+/**
+ * @brief Releases a tempo tapper instance back to the pool
+ *
+ * The following function returns a tempo tapper instance, previously
+ * acquired from the same pool, so that it can be handed out again.
+ */
+void tt_pool_release(tt_pool *pool, tempo_tapper *tapper);
+
+/**
+ * @brief Returns the number of tempo tapper instances currently handed out
+ */
+size_t tt_pool_used(tt_pool *pool);
+
+/**
+ * @brief Returns the highest number of tempo tapper instances handed out at once
+ */
+size_t tt_pool_peak(tt_pool *pool);
+
+/**
+ * @brief Returns the number of tempo tapper instances the pool can hand out
+ */
+size_t tt_pool_capacity(tt_pool *pool);
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_registry.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Concurrent registry of tempo tappers keyed by channel ID
+ *
+ * The following file provides a registry that maps external channel IDs, ex. MIDI
+ * ports and channels, OSC addresses or user IDs, to tempo tappers, and can be
+ * tapped and read from many threads at once.
+ *
+ * The registry is split into shards, by default four per CPU, which are picked by
+ * the hash of the channel ID. Every shard is a fixed size open-addressing table with
+ * linear probing, whose slots map channel IDs to tempo tappers, which are taken from
+ * a pool of the shard (see tempo_tapper_pool.h). Taps, resets and
+ * evictions lock only the shard of their channel, so threads tapping different channels
+ * rarely contend. After each change, the tempo of the channel is published trough a
+ * per-slot sequence lock, so reads never lock and never wait for writers.
+ *
+ * Tempo tappers are created on the first tap of their channel, as copies of a template
+ * configuration, and are evicted once they have not been tapped for a configurable time.
+ *
+ * @note This file is only available on POSIX platforms.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "tempo_tapper.h"
+#include "tempo_tapper_pool.h"
+
+#ifndef TT_REGISTRY_MAX_SHARDS
+#define TT_REGISTRY_MAX_SHARDS 256      ///< Highest number of shards of a registry
+#endif
+
+/**
+ * @brief Consistent snapshot of a registered channel
+ */
+typedef struct tt_registry_entry
+{
+        uint64_t id;            ///< Channel ID
+        int taps;               ///< Number of taps, -1 after a reset (see tempo_tapper)
+        unsigned long period_us;///< Period of the tempo in microseconds (see tt_period_us())
+        BPM_t bpm;              ///< Tempo in BPM (see tt_bpm())
+        tt_time_t lst_t;        ///< Clock time of the last tap
+} tt_registry_entry;
+
+/**
+ * @brief Registry slot struct
+ *
+ * The following struct maps a channel to its tempo tapper and holds its published tempo.
+ * All fields are written only while the shard is locked, and read without locks
+ * trough the sequence lock.
+ */
+typedef struct alignas(64) tt_registry_slot
+{
+        std::atomic<unsigned> seq;              ///< Sequence lock, odd while the slot is being written
+        std::atomic<uint8_t> state;             ///< Empty, used or evicted (see tempo_tapper_registry.cxx)
+        std::atomic<uint64_t> id;               ///< Channel ID, valid while the slot is used
+        std::atomic<int> taps;
+        std::atomic<unsigned long> period_us;
+        std::atomic<BPM_t> bpm;
+        std::atomic<tt_time_t> lst_t;
+        tempo_tapper *tt;                       ///< Tempo tapper of the channel, owned by the shard lock holder
+} tt_registry_slot;
+
+/**
+ * @brief Registry shard struct
+ */
+typedef struct alignas(64) tt_registry_shard
+{
+        std::atomic_flag lock;                  ///< Held while the shard is being written
+        std::atomic<size_t> used;               ///< Number of used slots
+        size_t evicted;                         ///< Number of evicted slots that still lie within probe sequences
+        tt_registry_slot *slots;                ///< Open-addressing table
+        tt_pool pool;                           ///< Tempo tappers of the channels of the shard
+} tt_registry_shard;
+
+/**
+ * @brief Tempo tapper registry struct
+ *
+ * The following struct represents a registry created by tt_registry_new().
+ */
+typedef struct tt_registry
+{
+        tt_registry_shard *shards;              ///< Shards, picked by the upper bits of the channel ID hash
+        unsigned shard_bits;                    ///< Base 2 logarithm of the number of shards
+        size_t shard_mask;                      ///< Number of slots per shard, minus one
+        size_t shard_max;                       ///< Highest number of channels per shard
+        tt_time_t idle;                         ///< Time in clock ticks after which idle channels are evicted, 0 to never evict
+        tempo_tapper cfg;                       ///< Template of newly created tempo tappers
+        std::atomic<unsigned long> rejected;    ///< Number of taps rejected due to full shards or out-of-order timestamps
+        void *mem;                              ///< Allocation backing all shards and slots
+} tt_registry;
+
+/**
+ * @brief Creates a new tempo tapper registry
+ *
+ * The following function allocates a registry for up to capacity channels, split into
+ * the given number of shards, which is rounded up to a power of two. If shards is 0, four
+ * shards per online CPU are used. Every shard holds at most its share of the capacity, plus
+ * some headroom for unevenly hashed channel IDs.
+ *
+ * Channels that have not been tapped for idle_us microseconds are evicted, either by
+ * tt_registry_evict(), or when a shard runs full. If idle_us is 0, channels are only removed
+ * trough tt_registry_remove().
+ *
+ * If cfg is not NULL, newly created tempo tappers copy its configuration (see tt_set_window(),
+ * tt_set_estimator() and, with TT_CHANGE, tt_set_change_detection()).
+ *
+ * @return A initialized tt_registry struct instance or NULL on failure
+ */
+tt_registry* tt_registry_new(size_t capacity, size_t shards, unsigned long idle_us, const tempo_tapper *cfg);
+
+/**
+ * @brief Frees a registry created by tt_registry_new()
+ *
+ * The registry must no longer be accessed by other threads.
+ */
+void tt_registry_free(tt_registry *reg);
+
+/**
+ * @brief "Taps" the tempo tapper of a channel
+ *
+ * The following function reads the current clock time and taps the tempo tapper
+ * of the channel, which is created if the channel has not been tapped before.
+ *
+ * @return 0 on success, -1 if the tap has been rejected (see tt_registry_tap_at())
+ */
+int tt_registry_tap(tt_registry *reg, uint64_t id);
+
+/**
+ * @brief "Taps" the tempo tapper of a channel at a given clock time (see tt_tap_at())
+ *
+ * Taps that are older than the last applied tap of the channel, ex. because another
+ * thread tapped the channel in between reading the clock and applying its tap, are rejected.
+ *
+ * @return 0 on success, -1 if the channel could not be created because its shard is full,
+ *         or if the tap is older than the last tap of the channel
+ */
+int tt_registry_tap_at(tt_registry *reg, uint64_t id, tt_time_t *time);
+
+/**
+ * @brief Taps many channels at once
+ *
+ * The following function taps the n channels in ids, the i-th one at times[i], or, if times
+ * is NULL, all of them at the current clock time. The channels are grouped by shard, so that
+ * each shard is locked once per group rather than once per tap. Taps of the same channel are
+ * applied in the order in which they appear in ids.
+ *
+ * @return The number of applied taps, the remaining ones have been rejected (see tt_registry_tap_at())
+ */
+size_t tt_registry_tap_batch(tt_registry *reg, const uint64_t *ids, const tt_time_t *times, size_t n);
+
+/**
+ * @brief Resets the tempo tapper of a channel (see tt_reset())
+ *
+ * @return 0 on success, -1 if the channel is not registered
+ */
+int tt_registry_reset(tt_registry *reg, uint64_t id);
+
+/**
+ * @brief Removes a channel from the registry
+ *
+ * @return 0 on success, -1 if the channel is not registered
+ */
+int tt_registry_remove(tt_registry *reg, uint64_t id);
+
+/**
+ * @brief Evicts idle channels
+ *
+ * The following function removes all channels whose last tap lies more than the idle
+ * time of the registry before now, or, if now is NULL, before the current clock time.
+ * Shards are locked one after another.
+ *
+ * @return The number of evicted channels
+ */
+size_t tt_registry_evict(tt_registry *reg, tt_time_t *now);
+
+/**
+ * @brief Reads a consistent snapshot of a channel
+ *
+ * The following function reads the most recently published tempo of a channel,
+ * without locking and without waiting for writers.
+ *
+ * @return 0 on success, -1 if the channel is not registered
+ */
+int tt_registry_read(tt_registry *reg, uint64_t id, tt_registry_entry *entry);
+
+/**
+ * @brief Returns the tempo of a channel in BPM (see tt_bpm()), or 0 if the channel is not registered
+ */
+BPM_t tt_registry_bpm(tt_registry *reg, uint64_t id);
+
+/**
+ * @brief Reads all registered channels
+ *
+ * The following function stores a consistent snapshot of up to max registered channels
+ * into entries, in no particular order, without locking. Channels that are created or
+ * evicted while the registry is being read may or may not be included.
+ *
+ * @return The number of stored entries
+ */
+size_t tt_registry_read_all(tt_registry *reg, tt_registry_entry *entries, size_t max);
+
+/**
+ * @brief Returns the number of registered channels
+ */
+size_t tt_registry_count(tt_registry *reg);
+
+/**
+ * @brief Returns the number of taps rejected due to full shards or out-of-order timestamps
+ */
+unsigned long tt_registry_rejected(tt_registry *reg);
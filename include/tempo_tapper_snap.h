@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_snap.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Binary snapshots of tempo tapper populations
+ *
+ * The following file provides a compact, versioned binary format to persist the
+ * tempo of one or many tempo tappers, ex. across restarts of a service, along with
+ * functions to save and restore snapshots.
+ *
+ * A snapshot consists of a 32 byte header, followed by one 32 byte record per tempo
+ * tapper. All fields are stored in little-endian byte order with fixed widths, so
+ * snapshots are independent of the platform, its word size and its layout of the
+ * tempo_tapper struct. On little-endian hosts, the records of a memory mapped snapshot
+ * are read in place, so opening a snapshot only validates its header, and tempo
+ * tappers are restored individually when they are needed.
+ *
+ * A record holds the tempo rather than the tapped intervals: the clock time of the last
+ * tap, the estimated period, the number of taps and the configuration of the tempo
+ * tapper. A restored tempo tapper reports the same tempo, as if all of its intervals
+ * had been equal to the period. The beat phase is only kept by the Kalman filter
+ * estimator, other estimators restart their beat grid at the last tap. Tap statistics
+ * (see TT_STATS) restart as well.
+ *
+ * Clock times are stored as they are, so the restoring process must read the same
+ * clock, ex. a service restarted without a reboot.
+ *
+ * Example:
+ * ```
+ *      tt_snap_save("tempo.snap", tappers, n);
+ *      ...
+ *      tt_snap snap;
+ *
+ *      if (tt_snap_open(&snap, "tempo.snap") == 0) {
+ *              tt_snap_restore_all(&snap, tappers, n);
+ *              tt_snap_close(&snap);
+ *      }
+ * ```
+ *
+ * @note Saving and opening snapshot files is only available on POSIX platforms.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "tempo_tapper.h"
+
+#define TT_SNAP_MAGIC "TTSN"    ///< Magic bytes at the start of every snapshot
+#define TT_SNAP_VERSION 1       ///< Version of the snapshot format written by this library
+
+/**
+ * @brief Snapshot header, little-endian
+ */
+typedef struct tt_snap_header
+{
+        char magic[4];          ///< TT_SNAP_MAGIC
+        uint16_t version;       ///< Format version, TT_SNAP_VERSION
+        uint16_t record_size;   ///< Size of a record in bytes, sizeof(tt_snap_record)
+        uint32_t ticks_per_us;  ///< Clock ticks per microsecond of the clock times in the records (see TT_TICKS_PER_US)
+        uint32_t reserved;      ///< 0
+        uint64_t count;         ///< Number of records
+        uint64_t reserved2;     ///< 0
+} tt_snap_header;
+
+/**
+ * @brief Snapshot record of a tempo tapper, little-endian
+ */
+typedef struct tt_snap_record
+{
+        uint64_t lst_t;         ///< Clock time of the last tap
+        uint64_t period;        ///< Estimated period in clock ticks (see tt_period_ticks())
+        int32_t phase;          ///< Kalman filter beat phase in clock ticks relative to the last tap, 0 for other estimators
+        int32_t taps;           ///< Number of taps, -1 after a reset
+        uint16_t win_len;       ///< Sliding window length (see tt_set_window())
+        uint8_t est;            ///< Estimator (see tt_estimator)
+        uint8_t reserved;       ///< 0
+        uint32_t chg_h;         ///< Change detection threshold (see tt_set_change_detection()), bits of an IEEE 754 float
+} tt_snap_record;
+
+/**
+ * @brief Fills a snapshot header
+ *
+ * The following function fills a header for a snapshot of count records,
+ * whose clock times are taken from current_time().
+ */
+void tt_snap_header_init(tt_snap_header *hdr, uint64_t count);
+
+/**
+ * @brief Checks a snapshot header
+ *
+ * The following function checks whether a header describes a snapshot this library
+ * can restore, i.e. whose magic, version and record size match, and whose clock ticks
+ * can be converted to those of current_time().
+ *
+ * @return 0 if the snapshot can be restored, -1 otherwise
+ */
+int tt_snap_header_check(const tt_snap_header *hdr);
+
+/**
+ * @brief Encodes the state of a tempo tapper into a snapshot record
+ */
+void tt_snap_encode(tempo_tapper *tapper, tt_snap_record *rec);
+
+/**
+ * @brief Restores a tempo tapper from a snapshot record
+ *
+ * The following function initializes a tempo tapper (see tt_init()) with the state
+ * of a record, whose clock times are counted in ticks_per_us ticks per microsecond
+ * (see tt_snap_header::ticks_per_us).
+ *
+ * As the tempo tapper may be uninitialized storage, it is initialized from scratch:
+ * observers registered on it (see tt_observe()) are unregistered and must be registered
+ * again after restoring. The same applies to tt_snap_restore() and tt_snap_restore_all().
+ *
+ * Records of tempo tappers with change detection (see tt_set_change_detection()) can
+ * only be restored if TT_CHANGE is defined, records of the median estimator (see
+ * TT_EST_MEDIAN) only if TT_MEDIAN is defined, and records of the Kalman filter estimator
+ * (see TT_EST_KALMAN) only if TT_KALMAN is defined.
+ *
+ * @return 0 on success, -1 if the record holds an invalid configuration
+ */
+int tt_snap_decode(tempo_tapper *tapper, const tt_snap_record *rec, uint32_t ticks_per_us);
+
+/**
+ * @brief Returns the tempo of a snapshot record in BPM
+ *
+ * The following function returns the tempo that a tempo tapper restored from the
+ * record would report (see tt_bpm()), without restoring it.
+ */
+BPM_t tt_snap_bpm(const tt_snap_record *rec, uint32_t ticks_per_us);
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+
+/**
+ * @brief Memory mapped snapshot
+ *
+ * The following struct represents a snapshot file opened by tt_snap_open().
+ */
+typedef struct tt_snap
+{
+        void *map;                      ///< Mapping of the whole file
+        size_t map_len;                 ///< Length of the mapping in bytes
+        const tt_snap_record *records;  ///< Records within the mapping
+        size_t count;                   ///< Number of records
+        uint32_t ticks_per_us;          ///< Clock ticks per microsecond of the records
+} tt_snap;
+
+/**
+ * @brief Saves a snapshot of an array of tempo tappers
+ *
+ * The following function writes a snapshot of the n tempo tappers of the tappers
+ * array to the file at path. The snapshot is written to a temporary file next to it,
+ * which then replaces the file at once, so readers never see a partial snapshot. The
+ * file is not flushed to disk.
+ *
+ * @return 0 on success, -1 on errors, with errno set
+ * @note This function is only available on POSIX platforms.
+ */
+int tt_snap_save(const char *path, tempo_tapper *tappers, size_t n);
+
+/**
+ * @brief Opens a snapshot file
+ *
+ * The following function maps the snapshot file at path into memory and validates
+ * its header (see tt_snap_header_check()) and length. Records are not read.
+ *
+ * @return 0 on success, -1 on errors, with errno set (EINVAL for invalid snapshots)
+ * @note This function is only available on POSIX platforms.
+ */
+int tt_snap_open(tt_snap *snap, const char *path);
+
+/**
+ * @brief Restores the i-th tempo tapper of a snapshot
+ *
+ * @return 0 on success, -1 if i is out of range or the record is invalid (see tt_snap_decode())
+ * @note This function is only available on POSIX platforms.
+ */
+int tt_snap_restore(const tt_snap *snap, size_t i, tempo_tapper *tapper);
+
+/**
+ * @brief Restores an array of tempo tappers from a snapshot
+ *
+ * The following function restores the first n tempo tappers of a snapshot into
+ * the tappers array, or all of them if the snapshot holds fewer. Tempo tappers
+ * with invalid records are initialized instead (see tt_init()).
+ *
+ * @return Number of tempo tappers restored from valid records
+ * @note This function is only available on POSIX platforms.
+ */
+size_t tt_snap_restore_all(const tt_snap *snap, tempo_tapper *tappers, size_t n);
+
+/**
+ * @brief Closes a snapshot file
+ *
+ * @note This function is only available on POSIX platforms.
+ */
+void tt_snap_close(tt_snap *snap);
+
+#endif
@@ -0,0 +1,1578 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_tpl.h
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Header-only, policy based C++ tempo tapper
+ *
+ * The following file provides the tt::tempo_tapper class template, along with the
+ * clock and estimator policies it is composed of. The whole tap path is defined in
+ * this header, so that it can be inlined into the caller, and the clock and estimator
+ * are selected at compile time:
+ *
+ * ```
+ *      tt::tempo_tapper<tt::monotonic_raw_clock, tt::median<8> > tt;
+ *
+ *      tt.tap();
+ *      BPM_t bpm = tt.bpm();
+ * ```
+ *
+ * Instances are plain values: they neither allocate memory nor own resources, and
+ * can be copied and moved freely.
+ *
+ * The C interface in tempo_tapper.h is implemented on top of this header. It operates
+ * on the tempo_tapper struct trough tt::core, using the tt::platform_clock and the
+ * tt::runtime_estimator policies, which select the estimator at runtime.
+ *
+ * Clock policies provide:
+ *      - `rep` - The type of their time values
+ *      - `static rep now()` - The current clock time
+ *      - `static constexpr unsigned long ticks_per_us()` - Number of ticks per microsecond
+ *
+ * Estimator policies provide:
+ *      - `template <class Rep> using state` - The state of a tempo tapper using the estimator,
+ *        which must hold the `prd_sum`, `lst_t` and `taps` members of the tempo_tapper struct
+ *      - `reset()`, `push()`, `store()` and `rebuild()` - Reset the estimator, add an interval,
+ *        add an interval without updating the estimate and update the estimate from all stored intervals
+ *      - `reseed(n)` - Drop all but the n most recent intervals, after a detected tempo change
+ *      - `period()` - The estimated period in ticks
+ *      - `static constexpr unsigned history()` - The number of most recent intervals the estimator uses
+ *      - `sequential()` - Whether every interval has to be pushed in turn, rather than refitting
+ *        batches from the most recent intervals
+ */
+
+#pragma once
+
+#include <string.h>
+#include <math.h>
+
+#include "tempo_tapper.h"
+
+namespace tt {
+
+// Clock policies
+
+/**
+ * @brief Clock policy reading the platform clock trough current_time()
+ *
+ * On POSIX platforms, this is the clock selected by tt_clock_init().
+ */
+struct platform_clock
+{
+        typedef tt_time_t rep;
+
+        static rep now()
+        {
+                tt_time_t t;
+                current_time(&t);
+                return t;
+        }
+
+        static constexpr unsigned long ticks_per_us() { return TT_TICKS_PER_US; }
+};
+
+#if defined(TT_TARGET_PLATFORM_POSIX)
+
+/**
+ * @brief Clock policy reading CLOCK_MONOTONIC in nanoseconds, inlined into the caller
+ */
+struct monotonic_clock
+{
+        typedef uint64_t rep;
+
+        static rep now()
+        {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return (rep) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+
+        static constexpr unsigned long ticks_per_us() { return 1000; }
+};
+
+#ifdef CLOCK_MONOTONIC_RAW
+
+/**
+ * @brief Clock policy reading CLOCK_MONOTONIC_RAW in nanoseconds, inlined into the caller
+ */
+struct monotonic_raw_clock
+{
+        typedef uint64_t rep;
+
+        static rep now()
+        {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+                return (rep) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+
+        static constexpr unsigned long ticks_per_us() { return 1000; }
+};
+
+#endif
+
+#elif defined(TT_TARGET_PLATFORM_ARDUINO)
+
+/**
+ * @brief Clock policy reading micros(), inlined into the caller
+ *
+ * Unlike platform_clock, the 32 bit tick count is not extended, so sums of
+ * intervals, ex. of the cumulative estimator, wrap after about 71 minutes.
+ */
+struct micros_clock
+{
+        typedef unsigned long rep;
+
+        static rep now() { return micros(); }
+
+        static constexpr unsigned long ticks_per_us() { return 1; }
+};
+
+#endif
+
+namespace detail {
+
+// Returns the k-th most recent interval of a ring buffer (k = 1 being the latest)
+template <class Rep, size_t N, class I>
+inline Rep &ring_back(Rep (&ring)[N], I head, unsigned int k)
+{
+        unsigned int i = head >= k ? head - k : head + N - k;
+        return ring[i];
+}
+
+template <class Rep, size_t N, class I>
+inline const Rep &ring_back(const Rep (&ring)[N], I head, unsigned int k)
+{
+        unsigned int i = head >= k ? head - k : head + N - k;
+        return ring[i];
+}
+
+// Stores an interval in a ring buffer, overwriting the oldest one once full
+template <class Rep, size_t N, class I>
+inline void ring_store(Rep (&ring)[N], I &head, I &cnt, Rep val)
+{
+        ring[head] = val;
+
+        if (++head == N)
+                head = 0;
+
+        if (cnt < N)
+                cnt++;
+}
+
+// Returns the sum of the len most recent intervals of a ring buffer
+template <class Rep, size_t N, class I>
+inline Rep ring_sum(Rep (&ring)[N], I head, I cnt, unsigned int len)
+{
+        unsigned int n = cnt < len ? cnt : len;
+        Rep sum = 0;
+
+        for (unsigned int k = 1; k <= n; k++)
+                sum += ring_back(ring, head, k);
+
+        return sum;
+}
+
+// Returns the index of the first sorted interval that is not less than val
+template <class Rep, class I>
+inline unsigned int srt_lower_bound(const Rep *srt, I cnt, Rep val)
+{
+        unsigned int lo = 0, hi = cnt;
+
+        while (lo < hi) {
+                unsigned int mid = (lo + hi) / 2;
+
+                if (srt[mid] < val)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        return lo;
+}
+
+template <class Rep, class I>
+inline void srt_insert(Rep *srt, I &cnt, Rep val)
+{
+        unsigned int i = srt_lower_bound(srt, cnt, val);
+        memmove(&srt[i + 1], &srt[i], (cnt - i) * sizeof(Rep));
+        srt[i] = val;
+        cnt++;
+}
+
+template <class Rep, class I>
+inline void srt_remove(Rep *srt, I &cnt, Rep val)
+{
+        unsigned int i = srt_lower_bound(srt, cnt, val);
+        cnt--;
+        memmove(&srt[i], &srt[i + 1], (cnt - i) * sizeof(Rep));
+}
+
+// Rebuilds the sorted intervals from the len most recent intervals of a ring buffer
+template <class Rep, size_t N, class I>
+inline void srt_rebuild(Rep *srt, I &srt_cnt, Rep (&ring)[N], I head, I cnt, unsigned int len)
+{
+        unsigned int n = cnt < len ? cnt : len;
+
+        srt_cnt = 0;
+        for (unsigned int k = 1; k <= n; k++)
+                srt_insert(srt, srt_cnt, ring_back(ring, head, k));
+}
+
+// Returns the median of the sorted intervals, both middle intervals are averaged on even counts
+template <class Rep, class I>
+inline Rep srt_median(const Rep *srt, I cnt)
+{
+        if (cnt < 1)
+                return 0;
+
+        Rep med = srt[cnt / 2];
+
+        if (cnt % 2 == 0) {
+                Rep lo = srt[cnt / 2 - 1];
+                med = lo + (med - lo) / 2;
+        }
+
+        return med;
+}
+
+/*
+ * Returns the mean of n intervals summing up to sum. On Arduino platforms, the 64 bit
+ * sum is divided by the same 32 step shift-and-subtract loop as in bpm_fx_from_us(),
+ * as a mean interval fits in 32 bits, which keeps the 64 bit division routine out of
+ * tt_period_us() and tt_bpm(). Means of 2^32 ticks (about 71 minutes) and above saturate.
+ */
+template <class Rep>
+inline Rep mean(Rep sum, uint32_t n)
+{
+        return sum / n;
+}
+
+#ifdef TT_TARGET_PLATFORM_ARDUINO
+
+inline uint64_t mean(uint64_t sum, uint32_t n)
+{
+        uint32_t lo = (uint32_t) sum;
+        uint32_t rem = (uint32_t) (sum >> 32);
+
+        if (rem >= n)
+                return UINT32_MAX;
+
+        for (uint8_t i = 0; i < 32; i++) {
+                uint32_t carry = rem >> 31;
+                rem = (rem << 1) | (lo >> 31);
+                lo <<= 1;
+
+                if (carry || rem >= n) {
+                        rem -= n;
+                        lo |= 1;
+                }
+        }
+
+        return lo;
+}
+
+#endif
+
+/*
+ * Returns 60 * S_TO_US / us in Q16.16 format, rounded to the nearest value.
+ * The 64 bit numerator is split into two 32 bit halves, and the quotient
+ * bits are produced one at a time by shifting the numerator into the remainder.
+ */
+inline BPM_fx_t bpm_fx_from_us(unsigned long us)
+{
+        const uint64_t num = (uint64_t) 60 * S_TO_US << TT_BPM_FX_SHIFT;
+
+        if (us == 0)
+                return 0;
+
+        // Quotient would not fit in 32 bits
+        if (us <= (uint32_t) (num >> 32))
+                return UINT32_MAX;
+
+        // Quotients of periods above 32 bits are below 1 BPM and rare enough to use plain division
+        if (us > UINT32_MAX)
+                return (BPM_fx_t) ((num + us / 2) / us);
+
+        uint32_t d = us;
+        uint32_t lo = (uint32_t) num + (d >> 1);                // Adds half the divisor for rounding
+        uint32_t rem = (uint32_t) (num >> 32) + (lo < (d >> 1)); // Carry of the rounding addition
+
+        for (uint8_t i = 0; i < 32; i++) {
+                uint32_t carry = rem >> 31;
+                rem = (rem << 1) | (lo >> 31);
+                lo <<= 1;
+
+                if (carry || rem >= d) {
+                        rem -= d;
+                        lo |= 1;
+                }
+        }
+
+        return lo;
+}
+
+/*
+ * Returns the time of the beat closest to the last tap, such that a beat grid
+ * of the given period has the least squared distance to the last n + 1 taps.
+ * With the grid anchored at the last tap, the residual of the k-th previous tap
+ * is the sum of (prd - d) over the k latest intervals d, and the optimal anchor
+ * is shifted by the mean of all residuals.
+ */
+template <class Rep, size_t N, class I>
+inline Rep fit_anchor(const Rep (&ring)[N], I head, unsigned int n, Rep lst_t, Rep prd)
+{
+        int64_t res = 0, res_sum = 0;
+
+        for (unsigned int k = 1; k <= n; k++) {
+                res += (int64_t) prd - (int64_t) ring_back(ring, head, k);
+                res_sum += res;
+        }
+
+        return lst_t + (Rep) (res_sum / (int64_t) (n + 1));
+}
+
+/*
+ * Fits a beat grid to the last n + 1 taps by least squares and returns its
+ * period, storing the time of the fitted beat closest to the last tap in anchor.
+ * Tap times are taken relative to the last tap, where the j-th previous tap lies
+ * at y_j = -(sum of the j latest intervals). The slope is computed with doubled,
+ * centered indices 2j - n to stay in integer arithmetic.
+ */
+template <class Rep, size_t N, class I>
+inline Rep fit_grid(const Rep (&ring)[N], I head, unsigned int n, Rep lst_t, Rep &anchor)
+{
+        int64_t y = 0, y_sum = 0, cov = 0;
+
+        for (unsigned int j = 1; j <= n; j++) {
+                y -= (int64_t) ring_back(ring, head, j);
+                y_sum += y;
+                cov += (2 * (int64_t) j - n) * y;
+        }
+
+        int64_t var = (int64_t) n * (n + 1) * (n + 2) / 3;
+        int64_t prd = -2 * cov / var;
+
+        if (prd < 0)
+                prd = 0;
+
+        anchor = lst_t + (Rep) (y_sum / (int64_t) (n + 1) + prd * n / 2);
+        return (Rep) prd;
+}
+
+// Returns true if time a lies before time b, taking clock wrap-around into account
+template <class Rep>
+inline bool time_before(Rep a, Rep b)
+{
+        return (Rep) (b - a) != 0 && (Rep) (b - a) <= (Rep) ~(Rep) 0 / 2;
+}
+
+// Memoized result flags
+enum {
+        MEMO_PERIOD_US = 1 << 0,
+        MEMO_BPM = 1 << 1,
+        MEMO_BPM_FX = 1 << 2,
+        MEMO_BEAT = 1 << 3,
+};
+
+// Starts a new generation and invalidates all memoized results
+template <class S>
+inline void invalidate(S &s)
+{
+        s.gen++;
+        s.memo = 0;
+}
+
+#ifdef TT_KALMAN
+
+// Kalman filter arithmetic, see tt_kf_t
+
+#ifdef TT_KALMAN_FIXED
+
+constexpr tt_kf_t kf_const(float v) { return (tt_kf_t) (v * ((int32_t) 1 << TT_KF_SHIFT)); }
+inline tt_kf_t kf_mul(tt_kf_t a, tt_kf_t b) { return (tt_kf_t) (((int64_t) a * b) >> TT_KF_SHIFT); }
+inline tt_kf_t kf_div(tt_kf_t a, tt_kf_t b) { return (tt_kf_t) (((int64_t) a << TT_KF_SHIFT) / b); }
+inline float kf_float(tt_kf_t v) { return (float) v / ((int32_t) 1 << TT_KF_SHIFT); }
+
+// Returns k * y in ticks, y is split so that neither product overflows for |y| below 2^38 ticks
+inline int64_t kf_scale(tt_kf_t k, int64_t y)
+{
+        const int64_t mask = ((int64_t) 1 << TT_KF_SHIFT) - 1;
+        return (y >> TT_KF_SHIFT) * k + (((y & mask) * k) >> TT_KF_SHIFT);
+}
+
+#else
+
+constexpr tt_kf_t kf_const(float v) { return v; }
+inline tt_kf_t kf_mul(tt_kf_t a, tt_kf_t b) { return a * b; }
+inline tt_kf_t kf_div(tt_kf_t a, tt_kf_t b) { return a / b; }
+inline float kf_float(tt_kf_t v) { return v; }
+inline int64_t kf_scale(tt_kf_t k, int64_t y) { return (int64_t) (k * (float) y); }
+
+#endif
+
+template <class S>
+inline void kf_reset(S &s)
+{
+        s.kf_e = 0;
+        s.kf_p = 0;
+        s.kf_p00 = 0;
+        s.kf_p01 = 0;
+        s.kf_p11 = 0;
+}
+
+/*
+ * Updates the Kalman filter with the interval d. The state is the time of the
+ * beat closest to the last tap, held relative to it in kf_e, and the period kf_p.
+ * Each beat, the phase advances by the period (F = [1 1; 0 1]) and the period
+ * drifts (Q = [0 0; 0 q]), and each tap measures the phase (H = [1 0]). The
+ * covariance P is held relative to the squared tap jitter R, so the measurement
+ * noise is 1, and the gains are K = P'H^T / (P'00 + 1). The first interval seeds
+ * the period, with the covariance of two independent taps.
+ */
+template <class S, class Rep>
+inline void kf_push(S &s, Rep d)
+{
+        const tt_kf_t one = kf_const(1);
+        const tt_kf_t q = kf_const(TT_KALMAN_DRIFT * TT_KALMAN_DRIFT);
+
+        if (s.kf_p == 0) {
+                s.kf_e = 0;
+                s.kf_p = d > 0 ? d : 1;
+                s.kf_p00 = one;
+                s.kf_p01 = one;
+                s.kf_p11 = 2 * one;
+                return;
+        }
+
+        // Predict
+        tt_kf_t p00 = s.kf_p00 + 2 * s.kf_p01 + s.kf_p11;
+        tt_kf_t p01 = s.kf_p01 + s.kf_p11;
+        tt_kf_t p11 = s.kf_p11 + q;
+
+        // Update, with P00 = K0 and P01 = K1 after the update
+        tt_kf_t sum = p00 + one;
+        tt_kf_t k0 = kf_div(p00, sum);
+        tt_kf_t k1 = kf_div(p01, sum);
+        int64_t y = (int64_t) d - (s.kf_e + (int64_t) s.kf_p);
+        int64_t p = (int64_t) s.kf_p + kf_scale(k1, y);
+
+        s.kf_e = kf_scale(k0, y) - y;
+        s.kf_p = (Rep) (p > 0 ? p : 1);
+        s.kf_p00 = k0;
+        s.kf_p01 = k1;
+        s.kf_p11 = p11 - kf_mul(k1, p01);
+}
+
+// Refits the Kalman filter to the cnt most recent intervals of a ring buffer
+template <class S, class Rep, size_t N, class I>
+inline void kf_rebuild(S &s, const Rep (&ring)[N], I head, I cnt)
+{
+        kf_reset(s);
+
+        for (unsigned int k = cnt; k >= 1; k--)
+                kf_push(s, ring_back(ring, head, k));
+}
+
+// Converts the Kalman filter covariance to square microseconds
+template <class S>
+inline void kf_cov(const S &s, unsigned long ticks_per_us, tt_tempo_cov *cov)
+{
+        const float r = (float) TT_KALMAN_JITTER_US * TT_KALMAN_JITTER_US;
+        float prd_us = (float) s.kf_p / ticks_per_us;
+
+        cov->phase_var_us2 = kf_float(s.kf_p00) * r;
+        cov->period_var_us2 = kf_float(s.kf_p11) * r;
+        cov->cov_us2 = kf_float(s.kf_p01) * r;
+
+        // d(60 * S_TO_US / p) / dp = -60 * S_TO_US / p^2
+        cov->bpm_sd = prd_us > 0 ? 60.0f * S_TO_US / (prd_us * prd_us) * sqrtf(cov->period_var_us2) : 0;
+}
+
+#endif
+
+#ifdef TT_CHANGE
+
+template <class S>
+inline void change_reset(S &s)
+{
+        s.chg_slow = 0;
+        s.chg_fast = 0;
+        s.chg_slow_n = 0;
+        s.chg_fast_n = 0;
+        s.chg_slow_sum = 0;
+        s.chg_fast_sum = 0;
+        s.chg_var = TT_CHANGE_JITTER * TT_CHANGE_JITTER;
+        s.chg_ref = 0;
+        s.chg_ref_n = 0;
+        s.chg_short = 0;
+}
+
+// Adds an interval to one side of the CUSUM, or restarts the side once its sum drops to 0
+template <class Rep>
+inline void change_side(float &g, uint32_t &n, Rep &sum, float inc, Rep d)
+{
+        g += inc;
+
+        if (g > 0) {
+                n++;
+                sum += d;
+        } else {
+                g = 0;
+                n = 0;
+                sum = 0;
+        }
+}
+
+/*
+ * Folds the interval d into a two-sided CUSUM of its deviation from the reference
+ * period, in units of the running tap jitter. Deviations are clipped to a third of the
+ * threshold plus the drift, so that at least three deviating intervals are needed to
+ * signal a change. A missed tap makes a single long interval. A doubled tap makes two
+ * short intervals, which add up to the reference period, so the second one is not
+ * counted again. Neither can thus signal a change on its own.
+ *
+ * The reference period and the tap jitter are averaged over the regular intervals
+ * only, rather than following the estimator, whose window mean is skewed for as many
+ * taps as it spans after a doubled or missed tap.
+ *
+ * If either side reaches the threshold, the CUSUM restarts, and the number and sum of the
+ * intervals that have accumulated on that side, i.e. the intervals of the new tempo,
+ * are returned. Otherwise, 0 is returned.
+ */
+template <class S, class Rep>
+inline uint32_t change_push(S &s, Rep d, Rep &sum)
+{
+        // The first interval only sets the reference period
+        if (s.chg_ref_n == 0) {
+                s.chg_ref = (float) d;
+                s.chg_ref_n = 1;
+                return 0;
+        }
+
+        float sd = sqrtf(s.chg_var);
+
+        if (sd < TT_CHANGE_MIN_JITTER)
+                sd = TT_CHANGE_MIN_JITTER;
+
+        float lim = s.chg_h / 3 + TT_CHANGE_DRIFT;
+        float z = ((float) d - s.chg_ref) / (s.chg_ref * sd);
+
+        bool regular = z >= -TT_CHANGE_OUTLIER && z <= TT_CHANGE_OUTLIER;
+
+        // During the warmup, every interval is averaged, so that an inaccurate reference period is corrected
+        if (regular || s.chg_ref_n < TT_CHANGE_WARMUP) {
+                if (s.chg_ref_n < TT_CHANGE_SPAN)
+                        s.chg_ref_n++;
+
+                s.chg_ref += ((float) d - s.chg_ref) / s.chg_ref_n;
+        }
+
+        /*
+         * Outliers only count as deviations of TT_CHANGE_OUTLIER standard deviations towards the
+         * tap jitter, so that a glitch barely affects it, while an underestimated jitter still grows.
+         * The assumed tap jitter weighs as much as TT_CHANGE_WARMUP measured intervals.
+         */
+        float r = (regular ? z : TT_CHANGE_OUTLIER) * sd;
+        uint32_t w = s.chg_ref_n + TT_CHANGE_WARMUP;
+        s.chg_var += (r * r - s.chg_var) / (w < TT_CHANGE_SPAN ? w : TT_CHANGE_SPAN);
+
+        bool doubled = z < -lim && s.chg_short > 0 &&
+                       fabsf((float) (s.chg_short + d) - s.chg_ref) <= 2 * TT_CHANGE_OUTLIER * sd * s.chg_ref;
+
+        s.chg_short = z < -lim && !doubled ? d : 0;
+
+        // Until enough intervals have been averaged, the error of the reference period itself would accumulate
+        if (s.chg_ref_n < TT_CHANGE_WARMUP)
+                return 0;
+
+        if (doubled)
+                z = -TT_CHANGE_DRIFT;   // Neutral for chg_fast, which has already counted the first half
+        else if (z > lim)
+                z = lim;
+        else if (z < -lim)
+                z = -lim;
+
+        change_side(s.chg_slow, s.chg_slow_n, s.chg_slow_sum, z - TT_CHANGE_DRIFT, d);
+        change_side(s.chg_fast, s.chg_fast_n, s.chg_fast_sum, -z - TT_CHANGE_DRIFT, d);
+
+        uint32_t n = 0;
+        float h = s.chg_h * 0.9999f;    // Three clipped deviations reach the threshold despite rounding
+
+        if (s.chg_slow >= h) {
+                n = s.chg_slow_n;
+                sum = s.chg_slow_sum;
+        } else if (s.chg_fast >= h) {
+                n = s.chg_fast_n;
+                sum = s.chg_fast_sum;
+        }
+
+        if (n == 0)
+                return 0;
+
+        float var = s.chg_var;
+        change_reset(s);
+        s.chg_var = var;        // The jitter is a property of the tapping, not of the tempo
+        s.chg_ref = (float) sum / n;
+        s.chg_ref_n = n;
+        return n;
+}
+
+#endif
+
+#ifdef TT_STATS
+
+template <class S>
+inline void stats_reset(S &s)
+{
+        s.st_n = 0;
+        s.st_mean = 0;
+        s.st_m2 = 0;
+        s.st_min = 0;
+        s.st_max = 0;
+}
+
+// Folds an interval into the running statistics, using Welford's algorithm
+template <class S, class Rep>
+inline void stats_push(S &s, Rep d)
+{
+        float x = (float) d;
+        float delta = x - s.st_mean;
+
+        s.st_n++;
+        s.st_mean += delta / s.st_n;
+        s.st_m2 += delta * (x - s.st_mean);
+
+        if (s.st_n == 1 || d < s.st_min)
+                s.st_min = d;
+
+        if (s.st_n == 1 || d > s.st_max)
+                s.st_max = d;
+}
+
+#endif
+
+} // namespace detail
+
+// Estimator policies
+
+/**
+ * @brief State shared by all compile-time estimators
+ *
+ * The following struct holds the members of the tempo_tapper struct that
+ * every tempo tapper needs, along with the members required by the estimator.
+ */
+template <class Rep, class Fields>
+struct basic_state : Fields
+{
+        Rep prd_sum;    ///< Sum of all tapped periods
+        Rep lst_t;      ///< Clock time of the last tap
+        int taps;       ///< Number of taps, -1 after a reset
+
+        uint32_t gen;                   ///< Generation counter, incremented whenever the tempo may have changed
+        uint8_t memo;                   ///< Flags of the memoized results that are valid for the current generation
+        unsigned long memo_period_us;   ///< Memoized period_us() result
+        BPM_t memo_bpm;                 ///< Memoized bpm() result
+        BPM_fx_t memo_bpm_fx;           ///< Memoized bpm_fx() result
+        Rep memo_prd;                   ///< Memoized period of the beat grid
+        Rep memo_anchor;                ///< Memoized time of the fitted beat closest to the last tap
+
+#ifdef TT_CHANGE
+        float chg_h;                    ///< Change detection threshold in jitter standard deviations, 0 disables it
+        float chg_var;                  ///< Running variance of the interval deviations relative to the period
+        float chg_slow;                 ///< CUSUM of lengthening intervals
+        float chg_fast;                 ///< CUSUM of shortening intervals
+        float chg_ref;                  ///< Reference period, the mean of the recent intervals that have not been clipped
+        uint32_t chg_ref_n;             ///< Number of intervals averaged by chg_ref, up to TT_CHANGE_SPAN
+        Rep chg_short;                  ///< Last interval if it was short enough to be the first half of a doubled tap, 0 otherwise
+        uint32_t chg_slow_n;            ///< Number of intervals accumulated by chg_slow
+        uint32_t chg_fast_n;            ///< Number of intervals accumulated by chg_fast
+        Rep chg_slow_sum;               ///< Sum of the intervals accumulated by chg_slow
+        Rep chg_fast_sum;               ///< Sum of the intervals accumulated by chg_fast
+        uint32_t chg_cnt;               ///< Number of detected tempo changes
+#endif
+
+#ifdef TT_STATS
+        uint32_t st_n;                  ///< Number of intervals of the statistics
+        float st_mean;                  ///< Running mean of the intervals
+        float st_m2;                    ///< Running sum of squared deviations from the mean
+        Rep st_min;                     ///< Shortest interval
+        Rep st_max;                     ///< Longest interval
+#endif
+};
+
+/**
+ * @brief Estimator policy averaging all intervals since the last reset
+ */
+struct cumulative_mean
+{
+        struct fields {};
+
+        template <class Rep>
+        using state = basic_state<Rep, fields>;
+
+        static constexpr unsigned int history() { return 0; }
+        template <class S> static bool sequential(const S &) { return false; }
+
+        template <class S> static void reset(S &) {}
+        template <class S, class Rep> static void push(S &, Rep) {}
+        template <class S, class Rep> static void store(S &, Rep) {}
+        template <class S> static void rebuild(S &) {}
+        template <class S> static void reseed(S &, unsigned int) {}
+
+        template <class S>
+        static auto period(const S &s) -> decltype(s.prd_sum)
+        {
+                return s.taps < 1 ? 0 : detail::mean(s.prd_sum, s.taps);
+        }
+
+        // No intervals are kept, so the beat grid is anchored at the last tap
+        template <class S, class Rep>
+        static Rep grid(const S &s, Rep &anchor)
+        {
+                anchor = s.lst_t;
+                return period(s);
+        }
+};
+
+/**
+ * @brief Estimator policy averaging the N most recent intervals
+ */
+template <unsigned int N>
+struct window_mean
+{
+        template <class Rep>
+        struct fields
+        {
+                Rep ring[N];            ///< Ring buffer of the most recent intervals
+                uint16_t ring_head;     ///< Index of the next ring buffer slot to be written
+                uint16_t ring_cnt;      ///< Number of intervals stored in the ring buffer
+                Rep win_sum;            ///< Running sum of the intervals in the ring buffer
+        };
+
+        template <class Rep>
+        using state = basic_state<Rep, fields<Rep> >;
+
+        static constexpr unsigned int history() { return N; }
+        template <class S> static bool sequential(const S &) { return false; }
+
+        template <class S>
+        static void reset(S &s)
+        {
+                s.ring_head = 0;
+                s.ring_cnt = 0;
+                s.win_sum = 0;
+        }
+
+        template <class S, class Rep>
+        static void push(S &s, Rep d)
+        {
+                if (s.ring_cnt >= N)
+                        s.win_sum -= detail::ring_back(s.ring, s.ring_head, N);
+
+                s.win_sum += d;
+                detail::ring_store(s.ring, s.ring_head, s.ring_cnt, d);
+        }
+
+        template <class S, class Rep>
+        static void store(S &s, Rep d)
+        {
+                detail::ring_store(s.ring, s.ring_head, s.ring_cnt, d);
+        }
+
+        template <class S>
+        static void rebuild(S &s)
+        {
+                s.win_sum = detail::ring_sum(s.ring, s.ring_head, s.ring_cnt, N);
+        }
+
+        template <class S>
+        static void reseed(S &s, unsigned int n)
+        {
+                if (s.ring_cnt > n)
+                        s.ring_cnt = n;
+
+                rebuild(s);
+        }
+
+        template <class S>
+        static auto period(const S &s) -> decltype(s.prd_sum)
+        {
+                return s.ring_cnt < 1 ? 0 : detail::mean(s.win_sum, s.ring_cnt);
+        }
+
+        template <class S, class Rep>
+        static Rep grid(const S &s, Rep &anchor)
+        {
+                return detail::fit_grid(s.ring, s.ring_head, s.ring_cnt, s.lst_t, anchor);
+        }
+};
+
+/**
+ * @brief Estimator policy returning the median of the N most recent intervals
+ */
+template <unsigned int N>
+struct median
+{
+        template <class Rep>
+        struct fields
+        {
+                Rep ring[N];            ///< Ring buffer of the most recent intervals
+                uint16_t ring_head;     ///< Index of the next ring buffer slot to be written
+                uint16_t ring_cnt;      ///< Number of intervals stored in the ring buffer
+                uint16_t srt_cnt;       ///< Number of intervals in srt
+                Rep srt[N];             ///< Intervals of the ring buffer in ascending order
+        };
+
+        template <class Rep>
+        using state = basic_state<Rep, fields<Rep> >;
+
+        static constexpr unsigned int history() { return N; }
+        template <class S> static bool sequential(const S &) { return false; }
+
+        template <class S>
+        static void reset(S &s)
+        {
+                s.ring_head = 0;
+                s.ring_cnt = 0;
+                s.srt_cnt = 0;
+        }
+
+        template <class S, class Rep>
+        static void push(S &s, Rep d)
+        {
+                if (s.ring_cnt >= N)
+                        detail::srt_remove(s.srt, s.srt_cnt, detail::ring_back(s.ring, s.ring_head, N));
+
+                detail::srt_insert(s.srt, s.srt_cnt, d);
+                detail::ring_store(s.ring, s.ring_head, s.ring_cnt, d);
+        }
+
+        template <class S, class Rep>
+        static void store(S &s, Rep d)
+        {
+                detail::ring_store(s.ring, s.ring_head, s.ring_cnt, d);
+        }
+
+        template <class S>
+        static void rebuild(S &s)
+        {
+                detail::srt_rebuild(s.srt, s.srt_cnt, s.ring, s.ring_head, s.ring_cnt, N);
+        }
+
+        template <class S>
+        static void reseed(S &s, unsigned int n)
+        {
+                if (s.ring_cnt > n)
+                        s.ring_cnt = n;
+
+                rebuild(s);
+        }
+
+        template <class S>
+        static auto period(const S &s) -> decltype(s.prd_sum)
+        {
+                return detail::srt_median(s.srt, s.srt_cnt);
+        }
+
+        // The period is kept robust against outliers, only the phase is fitted
+        template <class S, class Rep>
+        static Rep grid(const S &s, Rep &anchor)
+        {
+                Rep prd = period(s);
+                anchor = detail::fit_anchor(s.ring, s.ring_head, s.ring_cnt, s.lst_t, prd);
+                return prd;
+        }
+};
+
+#ifdef TT_KALMAN
+
+/**
+ * @brief Estimator policy tracking beat phase and period with a Kalman filter
+ *
+ * The N most recent intervals are kept to refit the filter after detected tempo
+ * changes. Only available if TT_KALMAN is defined.
+ */
+template <unsigned int N>
+struct kalman
+{
+        template <class Rep>
+        struct fields
+        {
+                Rep ring[N];            ///< Ring buffer of the most recent intervals
+                uint16_t ring_head;     ///< Index of the next ring buffer slot to be written
+                uint16_t ring_cnt;      ///< Number of intervals stored in the ring buffer
+                int64_t kf_e;           ///< Beat phase, in clock ticks relative to the last tap
+                Rep kf_p;               ///< Period in clock ticks, 0 until the first interval
+                tt_kf_t kf_p00;         ///< Phase variance, relative to the squared tap jitter
+                tt_kf_t kf_p01;         ///< Phase and period covariance, relative to the squared tap jitter
+                tt_kf_t kf_p11;         ///< Period variance, relative to the squared tap jitter
+        };
+
+        template <class Rep>
+        using state = basic_state<Rep, fields<Rep> >;
+
+        static constexpr unsigned int history() { return N; }
+        template <class S> static bool sequential(const S &) { return true; }
+
+        template <class S>
+        static void reset(S &s)
+        {
+                s.ring_head = 0;
+                s.ring_cnt = 0;
+                detail::kf_reset(s);
+        }
+
+        template <class S, class Rep>
+        static void push(S &s, Rep d)
+        {
+                detail::kf_push(s, d);
+                detail::ring_store(s.ring, s.ring_head, s.ring_cnt, d);
+        }
+
+        template <class S, class Rep>
+        static void store(S &s, Rep d)
+        {
+                detail::ring_store(s.ring, s.ring_head, s.ring_cnt, d);
+        }
+
+        template <class S>
+        static void rebuild(S &s)
+        {
+                detail::kf_rebuild(s, s.ring, s.ring_head, s.ring_cnt);
+        }
+
+        template <class S>
+        static void reseed(S &s, unsigned int n)
+        {
+                if (s.ring_cnt > n)
+                        s.ring_cnt = n;
+
+                rebuild(s);
+        }
+
+        template <class S>
+        static auto period(const S &s) -> decltype(s.prd_sum)
+        {
+                return s.kf_p;
+        }
+
+        template <class S, class Rep>
+        static Rep grid(const S &s, Rep &anchor)
+        {
+                anchor = s.lst_t + (Rep) s.kf_e;
+                return s.kf_p;
+        }
+};
+
+#endif
+
+/**
+ * @brief Estimator policy of the C interface
+ *
+ * The following estimator operates on the tempo_tapper struct and selects
+ * between the cumulative mean, the sliding window mean, the median and the
+ * Kalman filter at runtime, according to the win_len and est members (see
+ * tt_set_window() and tt_set_estimator()).
+ */
+struct runtime_estimator
+{
+        template <class Rep>
+        using state = ::tempo_tapper;
+
+        static constexpr unsigned int history() { return TT_WINDOW_CAP; }
+
+        static bool sequential(const ::tempo_tapper &s)
+        {
+#ifdef TT_KALMAN
+                return s.est == TT_EST_KALMAN;
+#else
+                (void) s;
+                return false;
+#endif
+        }
+
+        // Whether est is compiled in and can be selected
+        static bool available(unsigned int est)
+        {
+                switch (est) {
+                case TT_EST_MEAN:
+#ifdef TT_MEDIAN
+                case TT_EST_MEDIAN:
+#endif
+#ifdef TT_KALMAN
+                case TT_EST_KALMAN:
+#endif
+                        return true;
+                default:
+                        return false;
+                }
+        }
+
+#if TT_WINDOW_CAP > 0
+
+        // Number of intervals considered by the median
+        static unsigned int med_len(const ::tempo_tapper &s)
+        {
+                return s.win_len > 0 ? s.win_len : TT_WINDOW_CAP;
+        }
+
+        static void reset(::tempo_tapper &s)
+        {
+                s.ring_head = 0;
+                s.ring_cnt = 0;
+                s.win_sum = 0;
+#ifdef TT_MEDIAN
+                s.srt_cnt = 0;
+#endif
+#ifdef TT_KALMAN
+                detail::kf_reset(s);
+#endif
+        }
+
+        static void push(::tempo_tapper &s, tt_time_t d)
+        {
+                if (s.win_len > 0) {
+                        if (s.ring_cnt >= s.win_len)
+                                s.win_sum -= detail::ring_back(s.ring, s.ring_head, s.win_len);
+
+                        s.win_sum += d;
+                }
+
+#ifdef TT_MEDIAN
+                if (s.est == TT_EST_MEDIAN) {
+                        if (s.ring_cnt >= med_len(s))
+                                detail::srt_remove(s.srt, s.srt_cnt, detail::ring_back(s.ring, s.ring_head, med_len(s)));
+
+                        detail::srt_insert(s.srt, s.srt_cnt, d);
+                }
+#endif
+
+#ifdef TT_KALMAN
+                if (s.est == TT_EST_KALMAN)
+                        detail::kf_push(s, d);
+#endif
+
+                detail::ring_store(s.ring, s.ring_head, s.ring_cnt, d);
+        }
+
+        static void store(::tempo_tapper &s, tt_time_t d)
+        {
+                detail::ring_store(s.ring, s.ring_head, s.ring_cnt, d);
+        }
+
+        static void rebuild(::tempo_tapper &s)
+        {
+                if (s.win_len > 0)
+                        s.win_sum = detail::ring_sum(s.ring, s.ring_head, s.ring_cnt, s.win_len);
+
+#ifdef TT_MEDIAN
+                if (s.est == TT_EST_MEDIAN)
+                        detail::srt_rebuild(s.srt, s.srt_cnt, s.ring, s.ring_head, s.ring_cnt, med_len(s));
+#endif
+
+#ifdef TT_KALMAN
+                if (s.est == TT_EST_KALMAN)
+                        detail::kf_rebuild(s, s.ring, s.ring_head, s.ring_cnt);
+#endif
+        }
+
+        static void reseed(::tempo_tapper &s, unsigned int n)
+        {
+                if (s.ring_cnt > n)
+                        s.ring_cnt = n;
+
+                rebuild(s);
+        }
+
+        static tt_time_t period(const ::tempo_tapper &s)
+        {
+#ifdef TT_KALMAN
+                if (s.est == TT_EST_KALMAN)
+                        return s.kf_p;
+#endif
+
+#ifdef TT_MEDIAN
+                if (s.est == TT_EST_MEDIAN)
+                        return detail::srt_median(s.srt, s.srt_cnt);
+#endif
+
+                if (s.win_len > 0) {
+                        unsigned int n = s.ring_cnt < s.win_len ? s.ring_cnt : s.win_len;
+                        return n < 1 ? 0 : detail::mean(s.win_sum, n);
+                }
+
+                return s.taps < 1 ? 0 : detail::mean(s.prd_sum, s.taps);
+        }
+
+        /*
+         * The sliding window mean fits both period and phase to the window, the cumulative
+         * mean and the median only fit the phase to the last med_len() intervals, as the
+         * ring buffer is maintained regardless of the estimator. The Kalman filter tracks
+         * the phase itself.
+         */
+        static tt_time_t grid(const ::tempo_tapper &s, tt_time_t &anchor)
+        {
+                unsigned int n = s.ring_cnt < med_len(s) ? s.ring_cnt : med_len(s);
+
+#ifdef TT_KALMAN
+                if (s.est == TT_EST_KALMAN) {
+                        anchor = s.lst_t + (tt_time_t) s.kf_e;
+                        return s.kf_p;
+                }
+#endif
+
+                if (s.est == TT_EST_MEAN && s.win_len > 0)
+                        return detail::fit_grid(s.ring, s.ring_head, n, s.lst_t, anchor);
+
+                tt_time_t prd = period(s);
+                anchor = detail::fit_anchor(s.ring, s.ring_head, n, s.lst_t, prd);
+                return prd;
+        }
+
+#else
+
+        /*
+         * Without the ring buffer, only the cumulative mean and the Kalman filter are
+         * available. The Kalman filter cannot be refitted to past intervals, so after
+         * being selected or reseeded, it restarts from their mean.
+         */
+        static void reset(::tempo_tapper &s)
+        {
+#ifdef TT_KALMAN
+                detail::kf_reset(s);
+#else
+                (void) s;
+#endif
+        }
+
+        static void push(::tempo_tapper &s, tt_time_t d)
+        {
+#ifdef TT_KALMAN
+                if (s.est == TT_EST_KALMAN)
+                        detail::kf_push(s, d);
+#else
+                (void) s;
+                (void) d;
+#endif
+        }
+
+        static void store(::tempo_tapper &, tt_time_t) {}
+
+        static void rebuild(::tempo_tapper &s)
+        {
+#ifdef TT_KALMAN
+                if (s.est == TT_EST_KALMAN) {
+                        detail::kf_reset(s);
+
+                        if (s.taps > 0)
+                                detail::kf_push(s, detail::mean(s.prd_sum, s.taps));
+                }
+#else
+                (void) s;
+#endif
+        }
+
+        static void reseed(::tempo_tapper &s, unsigned int)
+        {
+                rebuild(s);
+        }
+
+        static tt_time_t period(const ::tempo_tapper &s)
+        {
+#ifdef TT_KALMAN
+                if (s.est == TT_EST_KALMAN)
+                        return s.kf_p;
+#endif
+
+                return s.taps < 1 ? 0 : detail::mean(s.prd_sum, s.taps);
+        }
+
+        // The beat grid is anchored at the last tap, unless the Kalman filter tracks the phase
+        static tt_time_t grid(const ::tempo_tapper &s, tt_time_t &anchor)
+        {
+#ifdef TT_KALMAN
+                if (s.est == TT_EST_KALMAN) {
+                        anchor = s.lst_t + (tt_time_t) s.kf_e;
+                        return s.kf_p;
+                }
+#endif
+
+                anchor = s.lst_t;
+                return period(s);
+        }
+
+#endif
+
+        static int set_window(::tempo_tapper &s, unsigned int n)
+        {
+                if (n > TT_WINDOW_CAP)
+                        return -1;
+
+                s.win_len = n;
+                rebuild(s);
+                detail::invalidate(s);
+                return 0;
+        }
+
+        static int set_estimator(::tempo_tapper &s, tt_estimator est)
+        {
+                if (!available(est))
+                        return -1;
+
+                s.est = est;
+                rebuild(s);
+                detail::invalidate(s);
+                return 0;
+        }
+};
+
+// Core
+
+/**
+ * @brief Tap path shared by tt::tempo_tapper and the C interface
+ *
+ * The following struct implements the tempo tapper operations on any
+ * state type provided by the Estimator policy.
+ */
+template <class Clock, class Estimator>
+struct core
+{
+        template <class S>
+        static void reset(S &s)
+        {
+                s.taps = -1;
+                s.prd_sum = 0;
+                s.lst_t = 0;    // Not read until the next tap, but copied by snapshots
+                Estimator::reset(s);
+#ifdef TT_CHANGE
+                detail::change_reset(s);
+#endif
+#ifdef TT_STATS
+                detail::stats_reset(s);
+#endif
+                detail::invalidate(s);
+        }
+
+        template <class S, class Rep>
+        static void tap_at(S &s, Rep t)
+        {
+                Rep d = 0;
+
+                // lst_t is only valid once the tempo tapper has been tapped
+                if (s.taps >= 0) {
+                        d = t - s.lst_t;
+                        s.prd_sum += d;
+                        Estimator::push(s, d);
+#ifdef TT_STATS
+                        detail::stats_push(s, d);
+#endif
+                }
+
+                s.taps++;
+                s.lst_t = t;
+
+#ifdef TT_CHANGE
+                if (s.chg_h > 0 && s.taps > 0)
+                        change(s, d);
+#endif
+
+                detail::invalidate(s);
+        }
+
+#ifdef TT_CHANGE
+
+        /*
+         * Feeds an interval to the change detection and, on a detected change,
+         * restarts the estimate from the intervals of the new tempo, as if the
+         * tempo tapper had been reset just before them
+         */
+        template <class S, class Rep>
+        static void change(S &s, Rep d)
+        {
+                Rep sum = 0;
+                uint32_t n = detail::change_push(s, d, sum);
+
+                if (n == 0)
+                        return;
+
+                s.prd_sum = sum;
+                s.taps = (int) n;
+                Estimator::reseed(s, n);
+                s.chg_cnt++;
+        }
+
+        template <class S>
+        static int set_change_detection(S &s, float threshold)
+        {
+                if (!(threshold >= 0))
+                        return -1;
+
+                s.chg_h = threshold;
+                detail::change_reset(s);
+                return 0;
+        }
+#endif
+
+        template <class S>
+        static void tap(S &s)
+        {
+                tap_at(s, Clock::now());
+        }
+
+        /*
+         * The sum of all intervals telescopes to last - lst_t, so only the
+         * intervals that can still be used by the estimator are computed.
+         */
+        template <class S, class Rep>
+        static void tap_batch(S &s, const Rep *times, size_t n)
+        {
+                if (n == 0)
+                        return;
+
+                bool sequential = Estimator::sequential(s);
+
+#ifdef TT_CHANGE
+                // Change detection needs to see every interval
+                sequential |= s.chg_h > 0;
+#endif
+
+                if (sequential) {
+                        for (size_t i = 0; i < n; i++)
+                                tap_at(s, times[i]);
+
+                        return;
+                }
+
+                // The first tap after a reset only sets the reference time
+                if (s.taps < 0) {
+                        s.taps = 0;
+                        s.lst_t = times[0];
+                        times++;
+                        n--;
+
+                        if (n == 0) {
+                                detail::invalidate(s);
+                                return;
+                        }
+                }
+
+                Rep last = times[n - 1];
+                s.prd_sum += last - s.lst_t;
+
+#ifdef TT_STATS
+                // Unlike the sum, the statistics need every interval
+                for (size_t j = 0; j < n; j++)
+                        detail::stats_push(s, (Rep) (times[j] - (j == 0 ? s.lst_t : times[j - 1])));
+#endif
+
+                size_t i = n > Estimator::history() ? n - Estimator::history() : 0;
+                Rep prev = i == 0 ? s.lst_t : times[i - 1];
+
+                for (; i < n; i++) {
+                        Estimator::store(s, (Rep) (times[i] - prev));
+                        prev = times[i];
+                }
+
+                Estimator::rebuild(s);
+
+                s.taps += n;
+                s.lst_t = last;
+                detail::invalidate(s);
+        }
+
+        // The following getters recompute their result only once per generation
+
+        template <class S>
+        static unsigned long period_us(S &s)
+        {
+                if (!(s.memo & detail::MEMO_PERIOD_US)) {
+                        s.memo_period_us = (unsigned long) (Estimator::period(s) / Clock::ticks_per_us());
+                        s.memo |= detail::MEMO_PERIOD_US;
+                }
+
+                return s.memo_period_us;
+        }
+
+        template <class S>
+        static BPM_t bpm(S &s)
+        {
+                if (!(s.memo & detail::MEMO_BPM)) {
+                        unsigned long us = period_us(s);
+                        s.memo_bpm = us == 0 ? 0 : (60 * S_TO_US)/(BPM_t)us;
+                        s.memo |= detail::MEMO_BPM;
+                }
+
+                return s.memo_bpm;
+        }
+
+        template <class S>
+        static BPM_fx_t bpm_fx(S &s)
+        {
+                if (!(s.memo & detail::MEMO_BPM_FX)) {
+                        s.memo_bpm_fx = detail::bpm_fx_from_us(period_us(s));
+                        s.memo |= detail::MEMO_BPM_FX;
+                }
+
+                return s.memo_bpm_fx;
+        }
+
+        /*
+         * Returns the period of the beat grid and stores its anchor in anchor,
+         * the period is 0 if no tempo has been tapped yet
+         */
+        template <class S, class Rep>
+        static Rep beat_grid(S &s, Rep &anchor)
+        {
+                if (!(s.memo & detail::MEMO_BEAT)) {
+                        s.memo_anchor = s.lst_t;
+                        s.memo_prd = s.taps < 1 ? 0 : Estimator::grid(s, s.memo_anchor);
+                        s.memo |= detail::MEMO_BEAT;
+                }
+
+                anchor = s.memo_anchor;
+                return s.memo_prd;
+        }
+
+        // Returns the time of the first beat after now, or now if no tempo has been tapped yet
+        template <class S, class Rep>
+        static Rep next_beat(S &s, Rep now)
+        {
+                Rep anchor;
+                Rep prd = beat_grid(s, anchor);
+
+                if (prd == 0)
+                        return now;
+
+                // The fitted anchor may lie slightly after now
+                if (detail::time_before(now, anchor)) {
+                        Rep ahead = anchor - now;
+                        return anchor - (ahead - 1) / prd * prd;
+                }
+
+                return anchor + ((Rep) (now - anchor) / prd + 1) * prd;
+        }
+
+        template <class S, class Rep>
+        static float phase(S &s, Rep now)
+        {
+                Rep anchor;
+                Rep prd = beat_grid(s, anchor);
+
+                if (prd == 0)
+                        return 0;
+
+                Rep left = next_beat(s, now) - now;
+                return (float) (prd - left) / (float) prd;
+        }
+
+#ifdef TT_STATS
+        template <class S>
+        static void stats(const S &s, tt_tap_stats *st)
+        {
+                const float tpu = Clock::ticks_per_us();
+                float var = s.st_n > 1 ? s.st_m2 / (s.st_n - 1) : 0;
+                float sd = sqrtf(var);
+
+                st->intervals = s.st_n;
+                st->mean_us = s.st_mean / tpu;
+                st->variance_us2 = var / (tpu * tpu);
+                st->stddev_us = sd / tpu;
+                st->min_us = (unsigned long) (s.st_min / Clock::ticks_per_us());
+                st->max_us = (unsigned long) (s.st_max / Clock::ticks_per_us());
+                st->cv = s.st_mean > 0 ? sd / s.st_mean : 0;
+
+                float rse = s.st_n > 1 ? st->cv / sqrtf((float) s.st_n) : TT_STATS_MAX_RSE;
+                st->confidence = rse < TT_STATS_MAX_RSE ? 1 - rse / TT_STATS_MAX_RSE : 0;
+        }
+#endif
+
+        template <class S, class Rep>
+        static unsigned long beats_until(S &s, Rep now, Rep t)
+        {
+                Rep anchor;
+                Rep prd = beat_grid(s, anchor);
+
+                if (prd == 0 || !detail::time_before(now, t))
+                        return 0;
+
+                Rep next = next_beat(s, now);
+
+                if (detail::time_before(t, next))
+                        return 0;
+
+                return (unsigned long) ((Rep) (t - next) / prd) + 1;
+        }
+};
+
+/**
+ * @brief Header-only, policy based tempo tapper
+ *
+ * The following class template implements a tempo tapper whose clock, estimator
+ * and time representation are selected at compile time. For a functional
+ * understanding of its methods, please refer to the corresponding functions
+ * of the C interface in tempo_tapper.h.
+ */
+template <class Clock = platform_clock, class Estimator = cumulative_mean, class TimeRep = typename Clock::rep>
+class tempo_tapper
+{
+public:
+        typedef TimeRep rep;
+        typedef typename Estimator::template state<TimeRep> state_type;
+
+        tempo_tapper() : _s() { reset(); }
+
+        void tap() { impl::tap_at(_s, (TimeRep) Clock::now()); }                ///< See tt_tap()
+        void tap_at(TimeRep t) { impl::tap_at(_s, t); }                         ///< See tt_tap_at()
+        void tap_batch(const TimeRep *times, size_t n) { impl::tap_batch(_s, times, n); } ///< See tt_tap_batch()
+        void reset() { impl::reset(_s); }                                       ///< See tt_reset()
+#ifdef TT_CHANGE
+        int set_change_detection(float threshold) { return impl::set_change_detection(_s, threshold); } ///< See tt_set_change_detection()
+#endif
+
+        TimeRep period() const { return Estimator::period(_s); }                ///< Period of the tempo in clock ticks
+        unsigned long period_us() const { return impl::period_us(_s); }         ///< See tt_period_us()
+        BPM_t bpm() const { return impl::bpm(_s); }                             ///< See tt_bpm()
+        BPM_fx_t bpm_fx() const { return impl::bpm_fx(_s); }                    ///< See tt_bpm_fx()
+        int taps() const { return _s.taps; }                                    ///< Number of taps, -1 after a reset
+        uint32_t generation() const { return _s.gen; }                          ///< See tt_generation()
+#ifdef TT_CHANGE
+        uint32_t changes() const { return _s.chg_cnt; }                         ///< See tt_changes()
+#endif
+        TimeRep next_beat_time(TimeRep now) const { return impl::next_beat(_s, now); }  ///< See tt_next_beat_time(), returns now if no tempo has been tapped
+        float phase(TimeRep now) const { return impl::phase(_s, now); }         ///< See tt_phase()
+        unsigned long beats_until(TimeRep now, TimeRep t) const { return impl::beats_until(_s, now, t); } ///< See tt_beats_until()
+#ifdef TT_KALMAN
+        void covariance(tt_tempo_cov &cov) const { detail::kf_cov(_s, Clock::ticks_per_us(), &cov); } ///< See tt_covariance(), only available with the tt::kalman estimator
+#endif
+#ifdef TT_STATS
+        void stats(tt_tap_stats &st) const { impl::stats(_s, &st); }           ///< See tt_stats()
+#endif
+
+        const state_type &state() const { return _s; }                          ///< Underlying state
+
+private:
+        typedef core<Clock, Estimator> impl;
+
+        mutable state_type _s;  // Mutable, as the getters memoize their results
+};
+
+} // namespace tt
@@ -0,0 +1,566 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_analysis.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the offline tempo analysis engine
+ *
+ * The following file defines the functions of the offline tempo analysis engine.
+ * Lags are measured in hops of the novelty function (see TT_ONSET_HOP).
+ *
+ * The work-stealing deques of the batch scheduler are index ranges guarded by a
+ * mutex each. Since analyzing a file takes milliseconds, the lock is taken rarely
+ * enough that a lock-free deque would not pay off.
+ *
+ * All function descriptions can be found in the tempo_tapper_analysis.h file.
+ */
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <tempo_tapper_analysis.h>
+#include <tempo_tapper_onset.h>
+
+#define PRIOR_BPM 120.0f        ///< Center of the tempo prior
+#define PRIOR_OCTAVES 1.0f      ///< Standard deviation of the tempo prior in octaves
+#define SMOOTH_PASSES 2         ///< Passes of the smoothing kernel over the novelty function
+#define ACCENT_RATIO 1.2f       ///< Strength ratio of alternating onsets above which only the stronger ones are taken as beats
+#define ACCENT_SPREAD 3         ///< Hops on either side of a phase that are summed into its strength
+
+// WAV parsing
+
+static uint32_t le32(const uint8_t *p)
+{
+        return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+        return p[0] | p[1] << 8;
+}
+
+// Locates the samples of a 16 bit PCM WAV file in memory
+static int parse_wav(const uint8_t *p, size_t len, unsigned int *rate, unsigned int *channels,
+                     const int16_t **data, size_t *frames)
+{
+        bool fmt = false;
+        size_t off = 12;
+
+        if (len < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4))
+                return -1;
+
+        while (off + 8 <= len) {
+                uint32_t chunk_len = le32(p + off + 4);
+                const uint8_t *body = p + off + 8;
+                size_t avail = len - off - 8;
+
+                if (!memcmp(p + off, "fmt ", 4)) {
+                        if (chunk_len < 16 || avail < 16)
+                                return -1;
+
+                        uint16_t format = le16(body);
+                        *channels = le16(body + 2);
+                        *rate = le32(body + 4);
+
+                        // Plain PCM or WAVE_FORMAT_EXTENSIBLE, 16 bit only
+                        if ((format != 1 && format != 0xFFFE) || le16(body + 14) != 16)
+                                return -1;
+
+                        fmt = true;
+                } else if (!memcmp(p + off, "data", 4)) {
+                        if (!fmt || *channels == 0)
+                                return -1;
+
+                        // Streamed WAV files may carry a bogus data length
+                        size_t bytes = chunk_len < avail ? chunk_len : avail;
+
+                        *data = (const int16_t *) body;
+                        *frames = bytes / (*channels * sizeof(int16_t));
+                        return 0;
+                }
+
+                // Chunks are padded to an even length
+                off += 8 + (size_t) chunk_len + (chunk_len & 1);
+        }
+
+        return -1;
+}
+
+// Tempo estimation
+
+// Returns the highest autocorrelation within r lags of lag, along with its position
+static float ac_peak(const float *ac, size_t len, size_t lag, size_t r, size_t *at)
+{
+        size_t lo = lag > r ? lag - r : 0;
+        size_t hi = lag + r < len ? lag + r : len - 1;
+        float best = ac[lo];
+
+        *at = lo;
+        for (size_t j = lo + 1; j <= hi; j++) {
+                if (ac[j] > best) {
+                        best = ac[j];
+                        *at = j;
+                }
+        }
+
+        return best;
+}
+
+static float comb_score(const float *ac, size_t len, size_t lag)
+{
+        float score = 0;
+        size_t at;
+
+        // The peak of the k-th multiple may deviate by k/2 lags from k * lag due to the fractional period
+        for (size_t k = 1; k <= TT_ANALYSIS_COMB; k++)
+                score += ac_peak(ac, len, k * lag, k / 2, &at);
+
+        return score / TT_ANALYSIS_COMB;
+}
+
+/*
+ * Smooths the novelty function with a [1 2 1] / 4 kernel, so that onsets spread
+ * over a few hops and periods that are not a whole number of hops still line up
+ * in the autocorrelation
+ */
+static void smooth(float *env, size_t n)
+{
+        float prev = env[0];
+
+        for (size_t i = 1; i + 1 < n; i++) {
+                float cur = env[i];
+                env[i] = (prev + 2 * cur + env[i + 1]) / 4;
+                prev = cur;
+        }
+}
+
+/*
+ * Folds the novelty function env of n hops over two periods of prd hops into fold,
+ * and returns how much stronger the onsets at the strongest phase are than those
+ * one period later, both summed over a few hops and taken above the weakest phase.
+ * Onsets that alternate between strong and weak, like kicks and hi-hats, give a
+ * ratio above 1, equally strong onsets give about 1.
+ */
+static float accent(const float *env, size_t n, float prd, float *fold)
+{
+        size_t bins = (size_t) (2 * prd);
+        double width = 2.0 * prd / bins;
+
+        // Periods of a few hops cannot be told apart
+        if (bins <= 2 * ACCENT_SPREAD)
+                return 1;
+
+        for (size_t b = 0; b < bins; b++)
+                fold[b] = 0;
+
+        for (size_t i = 0; i < n; i++)
+                fold[(size_t) (fmod((double) i, 2.0 * prd) / width) % bins] += env[i];
+
+        size_t strong = 0, weak = 0;
+
+        for (size_t b = 1; b < bins; b++) {
+                if (fold[b] > fold[strong])
+                        strong = b;
+
+                if (fold[b] < fold[weak])
+                        weak = b;
+        }
+
+        size_t opp = strong + bins / 2;
+        float here = 0, there = 0;
+
+        for (size_t k = bins - ACCENT_SPREAD; k <= bins + ACCENT_SPREAD; k++) {
+                here += fold[(strong + k) % bins] - fold[weak];
+                there += fold[(opp + k) % bins] - fold[weak];
+        }
+
+        return there > 0 ? here / there : INFINITY;
+}
+
+static float prior(float bpm)
+{
+        float oct = log2f(bpm / PRIOR_BPM) / PRIOR_OCTAVES;
+        return expf(-0.5f * oct * oct);
+}
+
+/*
+ * Estimates the tempo from the novelty function env of n hops at hop_rate
+ * hops per second, returns the period in hops or 0 if env is too short
+ */
+static float estimate(float *env, size_t n, float hop_rate, const tt_analysis_cfg *cfg, float *confidence)
+{
+        size_t lag_min = (size_t) floorf(60 * hop_rate / cfg->max_bpm);
+        size_t lag_max = (size_t) ceilf(60 * hop_rate / cfg->min_bpm);
+        size_t len = TT_ANALYSIS_COMB * lag_max + TT_ANALYSIS_COMB / 2 + 2;
+
+        if (lag_min < 1)
+                lag_min = 1;
+
+        if (n < 2 * len)
+                return 0;
+
+        for (unsigned int i = 0; i < SMOOTH_PASSES; i++)
+                smooth(env, n);
+
+        float mean = 0;
+        for (size_t i = 0; i < n; i++)
+                mean += env[i];
+        mean /= n;
+
+        for (size_t i = 0; i < n; i++)
+                env[i] -= mean;
+
+        float e0 = 0;
+        for (size_t i = 0; i < n; i++)
+                e0 += env[i] * env[i];
+        e0 /= n;
+
+        if (e0 <= 0)
+                return 0;
+
+        // The autocorrelation is followed by room to fold the novelty over two periods
+        float *ac = (float *) malloc((len + 2 * lag_max + 1) * sizeof(float));
+        if (ac == NULL)
+                return -1;
+
+        // The autocorrelation is normalized to 1 at lag 0
+        for (size_t l = 0; l < len; l++) {
+                float sum = 0;
+
+                for (size_t i = 0; i + l < n; i++)
+                        sum += env[i] * env[i + l];
+
+                ac[l] = sum / (n - l) / e0;
+        }
+
+        size_t best_lag = 0;
+        float best = -INFINITY, best_comb = 0;
+
+        for (size_t l = lag_min; l <= lag_max; l++) {
+                float comb = comb_score(ac, len, l);
+                float score = comb * prior(60 * hop_rate / l);
+
+                if (score > best) {
+                        best = score;
+                        best_comb = comb;
+                        best_lag = l;
+                }
+        }
+
+        // Refines the period on the last comb multiple, where one lag of error weighs least
+        size_t at;
+        ac_peak(ac, len, TT_ANALYSIS_COMB * best_lag, TT_ANALYSIS_COMB / 2, &at);
+
+        float peak = at;
+        if (at > 0 && at + 1 < len) {
+                float a = ac[at - 1], b = ac[at], c = ac[at + 1];
+                float den = a - 2 * b + c;
+
+                if (den < 0)
+                        peak += 0.5f * (a - c) / den;
+        }
+
+        float prd = peak / TT_ANALYSIS_COMB;
+
+        /*
+         * The prior may have settled on the tempo of all onsets while only every other
+         * one is a beat, or on every other beat of equally strong onsets
+         */
+        if (2 * prd <= lag_max && accent(env, n, prd, ac + len) > ACCENT_RATIO)
+                prd *= 2;
+        else if (prd / 2 >= lag_min && accent(env, n, prd / 2, ac + len) <= ACCENT_RATIO)
+                prd /= 2;
+
+        if (prd != peak / TT_ANALYSIS_COMB)
+                best_comb = comb_score(ac, len, (size_t) lrintf(prd));
+
+        free(ac);
+
+        *confidence = best_comb < 0 ? 0 : best_comb > 1 ? 1 : best_comb;
+        return prd;
+}
+
+void tt_analysis_defaults(tt_analysis_cfg *cfg)
+{
+        cfg->min_bpm = 60;
+        cfg->max_bpm = 200;
+}
+
+tt_analysis_status tt_analyze_pcm(const int16_t *pcm, size_t frames, unsigned int rate, unsigned int channels,
+                                  const tt_analysis_cfg *cfg, tt_analysis_result *res)
+{
+        tt_analysis_cfg def;
+        tt_onset od;
+
+        if (cfg == NULL) {
+                tt_analysis_defaults(&def);
+                cfg = &def;
+        }
+
+        res->bpm = 0;
+        res->confidence = 0;
+        res->duration = rate ? (double) frames / rate : 0;
+
+        if (tt_onset_init(&od, NULL, rate, channels, NULL) < 0 || cfg->min_bpm <= 0 || cfg->max_bpm <= cfg->min_bpm)
+                return res->status = TT_ANALYSIS_EFORMAT;
+
+        size_t cap = frames / TT_ONSET_HOP + 1;
+        float *env = (float *) malloc(cap * sizeof(float));
+
+        if (env == NULL)
+                return res->status = TT_ANALYSIS_ENOMEM;
+
+        size_t n = tt_onset_envelope(&od, pcm, frames, env, cap);
+        float hop_rate = (float) rate / TT_ONSET_HOP;
+        float prd = estimate(env, n, hop_rate, cfg, &res->confidence);
+
+        free(env);
+
+        if (prd < 0)
+                return res->status = TT_ANALYSIS_ENOMEM;
+
+        if (prd == 0)
+                return res->status = TT_ANALYSIS_ESHORT;
+
+        res->bpm = 60 * hop_rate / prd;
+        return res->status = TT_ANALYSIS_OK;
+}
+
+tt_analysis_status tt_analyze_file(const char *path, const tt_analysis_cfg *cfg, tt_analysis_result *res)
+{
+        struct stat st;
+        int fd = open(path, O_RDONLY);
+
+        res->bpm = 0;
+        res->confidence = 0;
+        res->duration = 0;
+
+        if (fd < 0)
+                return res->status = TT_ANALYSIS_EIO;
+
+        if (fstat(fd, &st) < 0 || st.st_size == 0) {
+                close(fd);
+                return res->status = TT_ANALYSIS_EIO;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (map == MAP_FAILED)
+                return res->status = TT_ANALYSIS_EIO;
+
+        // The file is read once from front to back
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+        unsigned int rate = 0, channels = 0;
+        const int16_t *data;
+        size_t frames;
+
+        if (parse_wav((const uint8_t *) map, st.st_size, &rate, &channels, &data, &frames) < 0)
+                res->status = TT_ANALYSIS_EFORMAT;
+        else
+                tt_analyze_pcm(data, frames, rate, channels, cfg, res);
+
+        munmap(map, st.st_size);
+        return res->status;
+}
+
+// Batch scheduler
+
+typedef struct worker
+{
+        pthread_mutex_t lock;
+        size_t head;            ///< Next file to be stolen
+        size_t tail;            ///< One past the next file to be taken by the owner
+} worker;
+
+typedef struct batch
+{
+        const char *const *paths;
+        const tt_analysis_cfg *cfg;
+        tt_analysis_result *results;
+        worker *workers;
+        unsigned int n_workers;
+} batch;
+
+typedef struct worker_arg
+{
+        batch *b;
+        unsigned int id;
+} worker_arg;
+
+// Takes a file from the back of the own deque, or steals one from the front of another
+static bool next_file(batch *b, unsigned int id, size_t *file)
+{
+        for (unsigned int i = 0; i < b->n_workers; i++) {
+                worker *w = &b->workers[(id + i) % b->n_workers];
+                bool found = false;
+
+                pthread_mutex_lock(&w->lock);
+
+                if (w->head < w->tail) {
+                        *file = i == 0 ? --w->tail : w->head++;
+                        found = true;
+                }
+
+                pthread_mutex_unlock(&w->lock);
+
+                if (found)
+                        return true;
+        }
+
+        return false;
+}
+
+static void *run_worker(void *arg)
+{
+        worker_arg *wa = (worker_arg *) arg;
+        batch *b = wa->b;
+        size_t file;
+
+        // Files are never added, so a worker is done once all deques are empty
+        while (next_file(b, wa->id, &file))
+                tt_analyze_file(b->paths[file], b->cfg, &b->results[file]);
+
+        return NULL;
+}
+
+int tt_analyze_batch(const char *const *paths, size_t n, unsigned int threads,
+                     const tt_analysis_cfg *cfg, tt_analysis_result *results)
+{
+        if (threads == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                threads = cpus > 0 ? cpus : 1;
+        }
+
+        if (threads > n)
+                threads = n > 0 ? n : 1;
+
+        batch b;
+        b.paths = paths;
+        b.cfg = cfg;
+        b.results = results;
+        b.n_workers = threads;
+        b.workers = (worker *) malloc(threads * sizeof(worker));
+
+        worker_arg *args = (worker_arg *) malloc(threads * sizeof(worker_arg));
+        pthread_t *tids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+        bool *started = (bool *) calloc(threads, sizeof(bool));
+
+        if (b.workers == NULL || args == NULL || tids == NULL || started == NULL) {
+                free(b.workers);
+                free(args);
+                free(tids);
+                free(started);
+                return -1;
+        }
+
+        // Every worker starts with a contiguous range of files
+        for (unsigned int i = 0; i < threads; i++) {
+                pthread_mutex_init(&b.workers[i].lock, NULL);
+                b.workers[i].head = n * i / threads;
+                b.workers[i].tail = n * (i + 1) / threads;
+                args[i].b = &b;
+                args[i].id = i;
+        }
+
+        // Files of workers that fail to start are stolen by the others
+        for (unsigned int i = 1; i < threads; i++)
+                started[i] = pthread_create(&tids[i], NULL, run_worker, &args[i]) == 0;
+
+        run_worker(&args[0]);
+
+        for (unsigned int i = 1; i < threads; i++) {
+                if (started[i])
+                        pthread_join(tids[i], NULL);
+        }
+
+        for (unsigned int i = 0; i < threads; i++)
+                pthread_mutex_destroy(&b.workers[i].lock);
+
+        free(b.workers);
+        free(args);
+        free(tids);
+        free(started);
+        return 0;
+}
+
+// Results
+
+static const char *status_str(tt_analysis_status status)
+{
+        switch (status) {
+        case TT_ANALYSIS_OK:
+                return "ok";
+        case TT_ANALYSIS_EIO:
+                return "io_error";
+        case TT_ANALYSIS_EFORMAT:
+                return "format_error";
+        case TT_ANALYSIS_ENOMEM:
+                return "out_of_memory";
+        case TT_ANALYSIS_ESHORT:
+                return "too_short";
+        }
+
+        return "unknown";
+}
+
+static void write_json_str(FILE *f, const char *s)
+{
+        fputc('"', f);
+
+        for (; *s; s++) {
+                unsigned char c = *s;
+
+                if (c == '"' || c == '\\')
+                        fprintf(f, "\\%c", c);
+                else if (c < 0x20)
+                        fprintf(f, "\\u%04x", c);
+                else
+                        fputc(c, f);
+        }
+
+        fputc('"', f);
+}
+
+int tt_analysis_write_jsonl(FILE *f, const char *const *paths, const tt_analysis_result *results, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                fputs("{\"file\":", f);
+                write_json_str(f, paths[i]);
+                fprintf(f, ",\"status\":\"%s\",\"bpm\":%.2f,\"confidence\":%.2f,\"duration\":%.2f}\n",
+                        status_str(results[i].status), results[i].bpm, results[i].confidence, results[i].duration);
+        }
+
+        return ferror(f) ? -1 : 0;
+}
+
+#endif
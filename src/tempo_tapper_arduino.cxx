@@ -38,29 +38,19 @@
 
 #include <tempo_tapper.h>
 
-void current_time(tt_time_t *time)
-{
-        *time = micros();
-}
-
-void add_time(tt_time_t *a, tt_time_t *b, tt_time_t *res)
-{
-        *res = *a + *b;
-}
+static uint32_t last_us;        // micros() value of the previous call
+static uint32_t wraps;          // Number of micros() wraps observed so far
 
-void sub_time(tt_time_t *a, tt_time_t *b, tt_time_t *res)
+void current_time(tt_time_t *time)
 {
-        *res = *a - *b;
-}
+        uint32_t us = micros();
 
-unsigned long time_to_us(tt_time_t *time)
-{
-        return *time;
-}
+        // micros() wraps every 2^32us, which is detected as a decrease since the previous call
+        if (us < last_us)
+                wraps++;
 
-void reset_time(tt_time_t *time)
-{
-        *time = 0;
+        last_us = us;
+        *time = (tt_time_t) wraps << 32 | us;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_bank.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the multi-channel tempo tapper bank
+ *
+ * The following file defines the functions of the multi-channel tempo tapper bank,
+ * including the SSE2 and AVX2 kernels used by tt_bank_eval() on x86-64.
+ *
+ * All function descriptions can be found in the tempo_tapper_bank.h file.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tempo_tapper_bank.h>
+
+#if defined(__x86_64__) && defined(TT_TARGET_PLATFORM_POSIX)
+#include <immintrin.h>
+#define TT_BANK_SIMD
+#endif
+
+#define BANK_ALIGN 32
+#define ALIGN_UP(p) ((void *) (((uintptr_t) (p) + BANK_ALIGN - 1) & ~(uintptr_t) (BANK_ALIGN - 1)))
+
+tt_bank* tt_bank_new(size_t n)
+{
+        tt_bank *bank = (tt_bank *) malloc(sizeof(tt_bank));
+
+        if (bank == NULL)
+                return NULL;
+
+        bank->mem = malloc(n * (2 * sizeof(tt_time_t) + sizeof(int32_t)) + 3 * BANK_ALIGN);
+
+        if (bank->mem == NULL) {
+                free(bank);
+                return NULL;
+        }
+
+        bank->n = n;
+        bank->prd_sum = (tt_time_t *) ALIGN_UP(bank->mem);
+        bank->lst_t = (tt_time_t *) ALIGN_UP(bank->prd_sum + n);
+        bank->taps = (int32_t *) ALIGN_UP(bank->lst_t + n);
+
+        for (size_t k = 0; k < n; k++)
+                tt_bank_reset(bank, k);
+
+        return bank;
+}
+
+void tt_bank_free(tt_bank *bank)
+{
+        if (bank == NULL)
+                return;
+
+        free(bank->mem);
+        free(bank);
+}
+
+void tt_bank_tap(tt_bank *bank, size_t k)
+{
+        tt_time_t c_time;
+        current_time(&c_time);
+        tt_bank_tap_at(bank, k, &c_time);
+}
+
+void tt_bank_tap_at(tt_bank *bank, size_t k, tt_time_t *time)
+{
+        if (bank->taps[k] >= 0) {
+                tt_time_t tdiff;
+                sub_time(time, &bank->lst_t[k], &tdiff);
+                add_time(&bank->prd_sum[k], &tdiff, &bank->prd_sum[k]);
+        }
+
+        bank->taps[k]++;
+        bank->lst_t[k] = *time;
+}
+
+void tt_bank_reset(tt_bank *bank, size_t k)
+{
+        bank->taps[k] = -1;
+        reset_time(&bank->prd_sum[k]);
+}
+
+unsigned long tt_bank_period_us(tt_bank *bank, size_t k)
+{
+        if (bank->taps[k] < 1)
+                return 0;
+
+        return time_to_us(&bank->prd_sum[k])/bank->taps[k];
+}
+
+BPM_t tt_bank_bpm(tt_bank *bank, size_t k)
+{
+        unsigned long us = tt_bank_period_us(bank, k);
+
+        if (us == 0)
+                return 0;
+
+        return (60 * S_TO_US)/(BPM_t)us;
+}
+
+#ifdef TT_BANK_SIMD
+
+/*
+ * Both kernels compute floor(prd_sum / (taps * TT_TICKS_PER_US)) in double precision,
+ * which equals the integer division of tt_bank_period_us() as long as prd_sum stays
+ * below 2^52. Integers below 2^52 are converted from and to doubles by adding 2^52,
+ * so that the integer ends up in the mantissa.
+ */
+
+#define TWO_52 4503599627370496.0
+#define TWO_32 4294967296.0
+#define TWO_52_BITS 0x4330000000000000LL
+
+// Evaluates 2 channels per iteration, returns the number of evaluated channels
+static size_t eval_sse2(tt_bank *bank, unsigned long *period_us, BPM_t *bpm)
+{
+        const __m128d two52 = _mm_set1_pd(TWO_52);
+        const __m128d two32 = _mm_set1_pd(TWO_32);
+        const __m128d one = _mm_set1_pd(1.0);
+        const __m128d zero = _mm_setzero_pd();
+        const __m128d ticks = _mm_set1_pd(TT_TICKS_PER_US);
+        const __m128i magic = _mm_set1_epi64x(TWO_52_BITS);
+        const __m128i lo_mask = _mm_set1_epi64x(0xffffffffLL);
+        const __m128 bpm_us = _mm_set1_ps(60 * S_TO_US);
+
+        size_t k;
+        for (k = 0; k + 2 <= bank->n; k += 2) {
+                __m128i sum = _mm_load_si128((const __m128i *) &bank->prd_sum[k]);
+                __m128d taps = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *) &bank->taps[k]));
+
+                // Convert the 64 bit sums in two 32 bit halves
+                __m128d lo = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_and_si128(sum, lo_mask), magic)), two52);
+                __m128d hi = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(sum, 32), magic)), two52);
+                __m128d sum_d = _mm_add_pd(_mm_mul_pd(hi, two32), lo);
+
+                // floor() by rounding to nearest and correcting results that were rounded up
+                __m128d q = _mm_div_pd(sum_d, _mm_mul_pd(taps, ticks));
+                __m128d r = _mm_sub_pd(_mm_add_pd(q, two52), two52);
+                r = _mm_sub_pd(r, _mm_and_pd(_mm_cmpgt_pd(r, q), one));
+                r = _mm_andnot_pd(_mm_cmple_pd(taps, zero), r);
+
+                _mm_storeu_si128((__m128i *) &period_us[k], _mm_xor_si128(_mm_castpd_si128(_mm_add_pd(r, two52)), magic));
+
+                __m128 p = _mm_cvtpd_ps(r);
+                __m128 b = _mm_andnot_ps(_mm_cmpeq_ps(p, _mm_setzero_ps()), _mm_div_ps(bpm_us, p));
+                _mm_storel_pi((__m64 *) &bpm[k], b);
+        }
+
+        return k;
+}
+
+// Evaluates 4 channels per iteration, returns the number of evaluated channels
+__attribute__((target("avx2")))
+static size_t eval_avx2(tt_bank *bank, unsigned long *period_us, BPM_t *bpm)
+{
+        const __m256d two52 = _mm256_set1_pd(TWO_52);
+        const __m256d two32 = _mm256_set1_pd(TWO_32);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d ticks = _mm256_set1_pd(TT_TICKS_PER_US);
+        const __m256i magic = _mm256_set1_epi64x(TWO_52_BITS);
+        const __m256i lo_mask = _mm256_set1_epi64x(0xffffffffLL);
+        const __m128 bpm_us = _mm_set1_ps(60 * S_TO_US);
+
+        size_t k;
+        for (k = 0; k + 4 <= bank->n; k += 4) {
+                __m256i sum = _mm256_load_si256((const __m256i *) &bank->prd_sum[k]);
+                __m256d taps = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *) &bank->taps[k]));
+
+                __m256d lo = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(sum, lo_mask), magic)), two52);
+                __m256d hi = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(sum, 32), magic)), two52);
+                __m256d sum_d = _mm256_add_pd(_mm256_mul_pd(hi, two32), lo);
+
+                __m256d r = _mm256_floor_pd(_mm256_div_pd(sum_d, _mm256_mul_pd(taps, ticks)));
+                r = _mm256_andnot_pd(_mm256_cmp_pd(taps, zero, _CMP_LE_OQ), r);
+
+                _mm256_storeu_si256((__m256i *) &period_us[k], _mm256_xor_si256(_mm256_castpd_si256(_mm256_add_pd(r, two52)), magic));
+
+                __m128 p = _mm256_cvtpd_ps(r);
+                __m128 b = _mm_andnot_ps(_mm_cmpeq_ps(p, _mm_setzero_ps()), _mm_div_ps(bpm_us, p));
+                _mm_storeu_ps(&bpm[k], b);
+        }
+
+        return k;
+}
+
+#endif
+
+void tt_bank_eval(tt_bank *bank, unsigned long *period_us, BPM_t *bpm)
+{
+        size_t k = 0;
+
+#ifdef TT_BANK_SIMD
+        if (__builtin_cpu_supports("avx2"))
+                k = eval_avx2(bank, period_us, bpm);
+        else
+                k = eval_sse2(bank, period_us, bpm);
+#endif
+
+        // Remaining channels
+        for (; k < bank->n; k++) {
+                period_us[k] = tt_bank_period_us(bank, k);
+                bpm[k] = tt_bank_bpm(bank, k);
+        }
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_clock.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the beat clock
+ *
+ * The following file defines the functions of the beat clock.
+ * Ticks lie at anchor + floor(q * prd / subdiv) on the beat grid of the
+ * concurrent tempo tapper, where q is the position of the tick. The clock
+ * thread always sleeps on CLOCK_MONOTONIC, or CLOCK_REALTIME if the tempo
+ * tapper reads the wall clock, so deadlines of other clock sources are
+ * converted by the offset between both clocks before every sleep.
+ *
+ * All function descriptions can be found in the tempo_tapper_clock.h file.
+ */
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <time.h>
+
+#include <tempo_tapper_clock.h>
+
+#define S_TO_NS 1000000000LL
+
+static clockid_t sleep_clock()
+{
+        return tt_clock_source() == TT_CLOCK_REALTIME ? CLOCK_REALTIME : CLOCK_MONOTONIC;
+}
+
+static int64_t read_ns(clockid_t id)
+{
+        struct timespec ts;
+        clock_gettime(id, &ts);
+        return (int64_t) ts.tv_sec * S_TO_NS + ts.tv_nsec;
+}
+
+static void sleep_until(clockid_t id, int64_t ns)
+{
+        struct timespec ts;
+        ts.tv_sec = ns / S_TO_NS;
+        ts.tv_nsec = ns % S_TO_NS;
+
+        while (clock_nanosleep(id, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+// Returns the offset that converts tempo tapper clock times to the sleep clock
+static int64_t clock_offset(clockid_t id)
+{
+        tt_clock_src src = tt_clock_source();
+
+        if (src == TT_CLOCK_MONOTONIC || src == TT_CLOCK_REALTIME)
+                return 0;
+
+        tt_time_t a, b;
+        current_time(&a);
+        int64_t ns = read_ns(id);
+        current_time(&b);
+
+        return ns - (int64_t) (a + (b - a) / 2);
+}
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+        int64_t q = a / b;
+
+        if (a % b != 0 && (a < 0) != (b < 0))
+                q--;
+
+        return q;
+}
+
+static tt_time_t tick_time(const tt_conc_snapshot *snap, int64_t q, unsigned int subdiv)
+{
+        return snap->beat_anchor + (tt_time_t) floor_div(q * (int64_t) snap->beat_prd, subdiv);
+}
+
+// Returns the position of the first tick after the clock time t
+static int64_t tick_after(const tt_conc_snapshot *snap, tt_time_t t, unsigned int subdiv)
+{
+        int64_t d = (int64_t) (t - snap->beat_anchor);
+        int64_t q = floor_div(d * subdiv, snap->beat_prd) + 1;
+
+        // The tick of q may still be rounded down onto t
+        if (tick_time(snap, q, subdiv) == t)
+                q++;
+
+        return q;
+}
+
+static void record(tt_beat_clock *clk, int64_t late_ns, uint64_t missed)
+{
+        pthread_mutex_lock(&clk->stats_lock);
+
+        clk->ticks++;
+        clk->missed += missed;
+        clk->late_sum += late_ns;
+        clk->late_sq_sum += (double) late_ns * late_ns;
+
+        if (late_ns < clk->late_min_ns)
+                clk->late_min_ns = late_ns;
+
+        if (late_ns > clk->late_max_ns)
+                clk->late_max_ns = late_ns;
+
+        pthread_mutex_unlock(&clk->stats_lock);
+}
+
+static void *run(void *arg)
+{
+        tt_beat_clock *clk = (tt_beat_clock *) arg;
+        unsigned int subdiv = clk->cfg.subdiv > 0 ? clk->cfg.subdiv : 1;
+        clockid_t id = sleep_clock();
+
+        tt_time_t last = 0;     // Deadline of the last fired tick
+        bool fired = false;
+        uint64_t beats = 0;
+
+        while (clk->running.load(std::memory_order_relaxed)) {
+                tt_conc_snapshot snap;
+                tt_conc_read(clk->conc, &snap);
+
+                int64_t off = clock_offset(id);
+                tt_time_t now;
+                current_time(&now);
+
+                if (snap.beat_prd == 0) {
+                        sleep_until(id, (int64_t) now + off + TT_BEAT_CLOCK_MAX_SLEEP_NS);
+                        continue;
+                }
+
+                /*
+                 * Ticks closer than half a tick to the last fired one are skipped,
+                 * as a tap may shift the beat grid just past the last tick. Ticks
+                 * that passed while the clock was idle are not fired retroactively.
+                 */
+                tt_time_t from = fired ? last + snap.beat_prd / subdiv / 2 : now;
+
+                if ((int64_t) (from - now) < 0)
+                        from = now;
+                int64_t q = tick_after(&snap, from, subdiv);
+                tt_time_t dl = tick_time(&snap, q, subdiv);
+
+                // Re-read the beat grid before long sleeps
+                if ((int64_t) (dl - now) > TT_BEAT_CLOCK_MAX_SLEEP_NS) {
+                        sleep_until(id, (int64_t) now + off + TT_BEAT_CLOCK_MAX_SLEEP_NS);
+                        continue;
+                }
+
+                sleep_until(id, (int64_t) dl + off);
+                int64_t wake = read_ns(id);
+
+                // Skip to the most recent tick if the following ticks have already passed
+                int64_t q_now = tick_after(&snap, (tt_time_t) (wake - off), subdiv) - 1;
+                uint64_t missed = 0;
+
+                if (q_now > q) {
+                        missed = q_now - q;
+                        q = q_now;
+                        dl = tick_time(&snap, q, subdiv);
+                }
+
+                tt_beat_event ev;
+                ev.beat = beats;
+                ev.sub = (unsigned int) (q - floor_div(q, subdiv) * subdiv);
+                ev.deadline = dl;
+                ev.late_ns = wake - ((int64_t) dl + off);
+
+                record(clk, ev.late_ns, missed);
+
+                if (ev.sub == 0) {
+                        if (clk->cfg.on_beat)
+                                clk->cfg.on_beat(&ev, clk->cfg.arg);
+
+                        beats++;
+                } else if (clk->cfg.on_sub) {
+                        clk->cfg.on_sub(&ev, clk->cfg.arg);
+                }
+
+                last = dl;
+                fired = true;
+        }
+
+        return NULL;
+}
+
+static void clear_stats(tt_beat_clock *clk)
+{
+        clk->ticks = 0;
+        clk->missed = 0;
+        clk->late_min_ns = INT64_MAX;
+        clk->late_max_ns = INT64_MIN;
+        clk->late_sum = 0;
+        clk->late_sq_sum = 0;
+}
+
+int tt_beat_clock_init(tt_beat_clock *clk)
+{
+        int ret = pthread_mutex_init(&clk->stats_lock, NULL);
+
+        if (ret != 0)
+                return ret;
+
+        clk->conc = NULL;
+        clk->running.store(false);
+        clear_stats(clk);
+        return 0;
+}
+
+void tt_beat_clock_destroy(tt_beat_clock *clk)
+{
+        tt_beat_clock_stop(clk);
+        pthread_mutex_destroy(&clk->stats_lock);
+}
+
+int tt_beat_clock_start(tt_beat_clock *clk, tt_conc *conc, const tt_beat_clock_cfg *cfg)
+{
+        pthread_attr_t attr;
+        int ret;
+
+        if (clk->running.load())
+                return EBUSY;
+
+        clk->conc = conc;
+        clk->cfg = *cfg;
+
+        pthread_mutex_lock(&clk->stats_lock);
+        clear_stats(clk);
+        pthread_mutex_unlock(&clk->stats_lock);
+
+        pthread_attr_init(&attr);
+
+        if (cfg->priority != 0) {
+                struct sched_param param;
+                param.sched_priority = cfg->priority;
+
+                pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+                pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+
+                if ((ret = pthread_attr_setschedparam(&attr, &param)) != 0) {
+                        pthread_attr_destroy(&attr);
+                        return ret;
+                }
+        }
+
+        if (cfg->cpu >= 0) {
+#ifdef __linux__
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cfg->cpu, &set);
+
+                if ((ret = pthread_attr_setaffinity_np(&attr, sizeof(set), &set)) != 0) {
+                        pthread_attr_destroy(&attr);
+                        return ret;
+                }
+#else
+                pthread_attr_destroy(&attr);
+                return ENOTSUP;
+#endif
+        }
+
+        clk->running.store(true);
+
+        ret = pthread_create(&clk->thread, &attr, run, clk);
+        pthread_attr_destroy(&attr);
+
+        if (ret != 0)
+                clk->running.store(false);
+
+        return ret;
+}
+
+void tt_beat_clock_stop(tt_beat_clock *clk)
+{
+        if (!clk->running.exchange(false))
+                return;
+
+        pthread_join(clk->thread, NULL);
+}
+
+void tt_beat_clock_stats(tt_beat_clock *clk, tt_beat_stats *stats)
+{
+        pthread_mutex_lock(&clk->stats_lock);
+
+        stats->ticks = clk->ticks;
+        stats->missed = clk->missed;
+
+        if (clk->ticks > 0) {
+                double avg = clk->late_sum / clk->ticks;
+                double var = clk->late_sq_sum / clk->ticks - avg * avg;
+
+                stats->late_min_ns = clk->late_min_ns;
+                stats->late_max_ns = clk->late_max_ns;
+                stats->late_avg_ns = avg;
+                stats->late_sd_ns = var > 0 ? sqrt(var) : 0;
+        } else {
+                stats->late_min_ns = 0;
+                stats->late_max_ns = 0;
+                stats->late_avg_ns = 0;
+                stats->late_sd_ns = 0;
+        }
+
+        pthread_mutex_unlock(&clk->stats_lock);
+}
+
+#endif
@@ -26,6 +26,10 @@
  * The following file defines tempo tapper functions that are shared
  * across all target platforms.
  * 
+ * The tap path itself is defined in tempo_tapper_tpl.h, the functions below
+ * instantiate it for the tempo_tapper struct, using the platform clock and
+ * the runtime selectable estimator.
+ * 
  * All function descriptions can be found in the tempo_tapper.h file.
  */
 
@@ -33,29 +37,147 @@
 #include <stddef.h>
 
 #include <tempo_tapper.h>
+#include <tempo_tapper_tpl.h>
+#include <tempo_tapper_metrics.h>
 
-unsigned long tt_period_us(tempo_tapper *tapper)
+typedef tt::core<tt::platform_clock, tt::runtime_estimator> tt_core;
+
+#ifdef TT_METRICS
+
+// Records the query count, and the time since the last tap
+static void query_metrics(tempo_tapper *tapper)
 {
-        if (tapper->taps < 1)
-                return 0;
+        tt_metrics_add(TT_METRICS_QUERIES, 1);
+
+        if (tapper->taps >= 0) {
+                tt_time_t now;
+                current_time(&now);
+
+                // Taps passed to tt_tap_at() may lie ahead of the clock
+                if (now > tapper->lst_t)
+                        tt_metrics_record(TT_METRICS_STALENESS, (now - tapper->lst_t) * (1000 / TT_TICKS_PER_US));
+                else
+                        tt_metrics_record(TT_METRICS_STALENESS, 0);
+        }
+}
+
+#define QUERY_METRICS(tapper) query_metrics(tapper)
+
+#else
+
+#define QUERY_METRICS(tapper) ((void) 0)
+
+#endif
+
+#if TT_OBSERVERS > 0
+
+static_assert(TT_OBSERVERS <= 8, "TT_OBSERVERS must fit into the 8 bit slot mask");
+
+// Reports the tempo to every observer it has moved away from by more than its hysteresis
+static void notify_tempo(tempo_tapper *tapper)
+{
+        if (tapper->obs_mask == 0 || tapper->taps < 1)
+                return;
+
+        BPM_t bpm = tt_core::bpm(*tapper);
+
+        for (int i = 0; i < TT_OBSERVERS; i++) {
+                tt_observer *obs = &tapper->obs[i];
+
+                if (!(tapper->obs_mask & (1 << i)))
+                        continue;
+
+                BPM_t d = bpm > obs->reported ? bpm - obs->reported : obs->reported - bpm;
+
+                if (obs->reported == 0 || d > obs->hysteresis) {
+                        obs->reported = bpm;
+                        obs->cb(tapper, TT_EVENT_TEMPO, bpm, obs->arg);
+                }
+        }
+}
+
+static void notify_reset(tempo_tapper *tapper)
+{
+        for (int i = 0; i < TT_OBSERVERS; i++) {
+                tt_observer *obs = &tapper->obs[i];
+
+                if (!(tapper->obs_mask & (1 << i)))
+                        continue;
 
-        unsigned long us = time_to_us(&tapper->prd_sum);
-        return us/tapper->taps;
+                obs->reported = 0;
+                obs->cb(tapper, TT_EVENT_RESET, 0, obs->arg);
+        }
+}
+
+#define NOTIFY_TEMPO(tapper) notify_tempo(tapper)
+#define NOTIFY_RESET(tapper) notify_reset(tapper)
+
+#else
+
+#define NOTIFY_TEMPO(tapper) ((void) 0)
+#define NOTIFY_RESET(tapper) ((void) 0)
+
+#endif
+
+unsigned long tt_period_us(tempo_tapper *tapper)
+{
+        QUERY_METRICS(tapper);
+        return tt_core::period_us(*tapper);
 }
 
 void tt_tap(tempo_tapper *tapper)
 {
-        tt_time_t c_time;
-        current_time(&c_time);
+#ifdef TT_METRICS
+        tt_time_t t;
+        current_time(&t);
+        tt_tap_at(tapper, &t);
+#else
+        tt_core::tap(*tapper);
+        NOTIFY_TEMPO(tapper);
+#endif
+}
 
-        if (tapper->taps >= 0) {
-                tt_time_t tdiff;
-                sub_time(&c_time, &tapper->lst_t, &tdiff);
-                add_time(&tapper->prd_sum, &tdiff, &tapper->prd_sum);
+void tt_tap_at(tempo_tapper *tapper, tt_time_t *time)
+{
+#ifdef TT_METRICS
+        const tt_time_t ns_per_tick = 1000 / TT_TICKS_PER_US;
+        bool tapped = tapper->taps >= 0;
+        tt_time_t prev = 0;
+        tt_time_t start, end;
+
+        // lst_t is only valid once the tempo tapper has been tapped
+        if (tapped)
+                prev = tapper->lst_t;
+
+        current_time(&start);
+        tt_core::tap_at(*tapper, *time);
+        current_time(&end);
+
+        tt_metrics_add(TT_METRICS_TAPS, 1);
+        tt_metrics_record(TT_METRICS_TAP_DURATION, (end - start) * ns_per_tick);
+
+        if (tapped)
+                tt_metrics_record(TT_METRICS_TAP_INTERVAL, (*time - prev) * ns_per_tick);
+#else
+        tt_core::tap_at(*tapper, *time);
+#endif
+        NOTIFY_TEMPO(tapper);
+}
+
+void tt_tap_batch(tempo_tapper *tapper, const tt_time_t *times, size_t n)
+{
+#ifdef TT_METRICS
+        for (size_t i = 0; i < n; i++) {
+                if (i > 0 || tapper->taps >= 0) {
+                        tt_time_t prev = i > 0 ? times[i - 1] : tapper->lst_t;
+                        tt_metrics_record(TT_METRICS_TAP_INTERVAL, (times[i] - prev) * (1000 / TT_TICKS_PER_US));
+                }
         }
 
-        tapper->taps++;
-        tapper->lst_t = c_time;
+        tt_metrics_add(TT_METRICS_TAPS, n);
+#endif
+        tt_core::tap_batch(*tapper, times, n);
+        NOTIFY_TEMPO(tapper);
 }
 
 tempo_tapper* tt_new()
@@ -65,23 +187,149 @@ tempo_tapper* tt_new()
         if (tapper == NULL)
                 return NULL;
         
-        tt_reset(tapper);
+        tt_init(tapper);
         return tapper;
 }
 
+void tt_init(tempo_tapper *tapper)
+{
+        tapper->gen = 0;
+        tapper->win_len = 0;
+        tapper->est = TT_EST_MEAN;
+#ifdef TT_CHANGE
+        tapper->chg_h = 0;
+        tapper->chg_cnt = 0;
+#endif
+#if TT_OBSERVERS > 0
+        tapper->obs_mask = 0;
+#endif
+        tt_core::reset(*tapper);
+}
+
 BPM_t tt_bpm(tempo_tapper *tapper)
 {
-        unsigned long us = tt_period_us(tapper);
-        
-        if (us == 0)
-                return 0;
+        QUERY_METRICS(tapper);
+        return tt_core::bpm(*tapper);
+}
 
-        
-        return (60 * S_TO_US)/(BPM_t)tt_period_us(tapper);
+BPM_fx_t tt_bpm_fx(tempo_tapper *tapper)
+{
+        QUERY_METRICS(tapper);
+        return tt_core::bpm_fx(*tapper);
+}
+
+tt_time_t tt_period_ticks(tempo_tapper *tapper)
+{
+        return tt::runtime_estimator::period(*tapper);
+}
+
+uint32_t tt_generation(tempo_tapper *tapper)
+{
+        return tapper->gen;
+}
+
+int tt_set_window(tempo_tapper *tapper, unsigned int n)
+{
+        return tt::runtime_estimator::set_window(*tapper, n);
+}
+
+int tt_set_estimator(tempo_tapper *tapper, tt_estimator est)
+{
+        return tt::runtime_estimator::set_estimator(*tapper, est);
+}
+
+#ifdef TT_CHANGE
+
+int tt_set_change_detection(tempo_tapper *tapper, float threshold)
+{
+        return tt_core::set_change_detection(*tapper, threshold);
+}
+
+uint32_t tt_changes(tempo_tapper *tapper)
+{
+        return tapper->chg_cnt;
+}
+
+#endif
+
+#if TT_OBSERVERS > 0
+
+int tt_observe(tempo_tapper *tapper, BPM_t hysteresis, tt_observer_cb cb, void *arg)
+{
+        if (cb == NULL || hysteresis < 0)
+                return -1;
+
+        for (int i = 0; i < TT_OBSERVERS; i++) {
+                if (tapper->obs_mask & (1 << i))
+                        continue;
+
+                tapper->obs[i].cb = cb;
+                tapper->obs[i].arg = arg;
+                tapper->obs[i].hysteresis = hysteresis;
+                tapper->obs[i].reported = 0;
+                tapper->obs_mask |= 1 << i;
+                return i;
+        }
+
+        return -1;
 }
 
+void tt_unobserve(tempo_tapper *tapper, int slot)
+{
+        if (slot >= 0 && slot < TT_OBSERVERS)
+                tapper->obs_mask &= ~(1 << slot);
+}
+
+#endif
+
 void tt_reset(tempo_tapper *tapper)
 {
-        tapper->taps = -1;
-        reset_time(&tapper->prd_sum);
-}
\ No newline at end of file
+#ifdef TT_METRICS
+        tt_metrics_add(TT_METRICS_RESETS, 1);
+#endif
+        tt_core::reset(*tapper);
+        NOTIFY_RESET(tapper);
+}
+
+int tt_next_beat_time(tempo_tapper *tapper, tt_time_t *now, tt_time_t *beat)
+{
+        tt_time_t anchor;
+
+        if (tt_core::beat_grid(*tapper, anchor) == 0)
+                return -1;
+
+        *beat = tt_core::next_beat(*tapper, *now);
+        return 0;
+}
+
+float tt_phase(tempo_tapper *tapper, tt_time_t *now)
+{
+        return tt_core::phase(*tapper, *now);
+}
+
+unsigned long tt_beats_until(tempo_tapper *tapper, tt_time_t *now, tt_time_t *t)
+{
+        return tt_core::beats_until(*tapper, *now, *t);
+}
+
+#ifdef TT_KALMAN
+
+int tt_covariance(tempo_tapper *tapper, tt_tempo_cov *cov)
+{
+        if (tapper->est != TT_EST_KALMAN || tapper->kf_p == 0)
+                return -1;
+
+        tt::detail::kf_cov(*tapper, TT_TICKS_PER_US, cov);
+        return 0;
+}
+
+#endif
+
+#ifdef TT_STATS
+
+void tt_stats(tempo_tapper *tapper, tt_tap_stats *stats)
+{
+        tt_core::stats(*tapper, stats);
+}
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_conc.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the concurrent tempo tapper
+ *
+ * The following file defines the functions of the concurrent tempo tapper.
+ * The event queue is a bounded queue in the style of Dmitry Vyukov's MPMC queue,
+ * in which every slot carries a sequence number telling producers and the
+ * consumer whether the slot is free or holds an event.
+ *
+ * All function descriptions can be found in the tempo_tapper_conc.h file.
+ */
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <sched.h>
+
+#include <tempo_tapper_conc.h>
+#include <tempo_tapper_tpl.h>
+#include <tempo_tapper_metrics.h>
+
+#define QUEUE_MASK (TT_CONC_QUEUE_CAP - 1)
+#define FULL_RETRIES 8  ///< Number of attempts to free up space in a full queue before a tap is rejected
+
+typedef tt::core<tt::platform_clock, tt::runtime_estimator> tt_core;
+
+static_assert((TT_CONC_QUEUE_CAP & QUEUE_MASK) == 0, "TT_CONC_QUEUE_CAP must be a power of two");
+
+typedef struct drained_event {
+        tt_time_t time;
+        bool reset;
+} drained_event;
+
+// Claims a queue slot and stores the event, returns false if the queue is full
+static bool push(tt_conc *conc, tt_time_t time, bool reset)
+{
+        size_t pos = conc->tail.load(std::memory_order_relaxed);
+        tt_conc::event *ev;
+
+        while (1) {
+                ev = &conc->queue[pos & QUEUE_MASK];
+                size_t seq = ev->seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+                if (diff == 0) {
+                        if (conc->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                                break;
+                } else if (diff < 0) {
+                        return false; // Slot still holds an event from the previous lap
+                } else {
+                        pos = conc->tail.load(std::memory_order_relaxed);
+                }
+        }
+
+        ev->time = time;
+        ev->reset = reset;
+        ev->seq.store(pos + 1, std::memory_order_release);
+        return true;
+}
+
+/*
+ * Pushes an event, draining the queue if it is full. If another thread is
+ * currently draining, the CPU is yielded so that the drain can complete.
+ */
+static bool push_or_drain(tt_conc *conc, tt_time_t time, bool reset)
+{
+        for (int i = 0; i < FULL_RETRIES; i++) {
+                if (push(conc, time, reset))
+                        return true;
+
+                if (!tt_conc_drain(conc))
+                        sched_yield();
+        }
+
+        return push(conc, time, reset);
+}
+
+// Sorts taps by time, taps arrive nearly sorted, so insertion sort is used
+static void sort_taps(drained_event *ev, size_t n)
+{
+        for (size_t i = 1; i < n; i++) {
+                drained_event cur = ev[i];
+                size_t j = i;
+
+                while (j > 0 && ev[j - 1].time > cur.time) {
+                        ev[j] = ev[j - 1];
+                        j--;
+                }
+
+                ev[j] = cur;
+        }
+}
+
+static void publish(tt_conc *conc)
+{
+        tt_time_t anchor;
+        tt_time_t prd = tt_core::beat_grid(conc->tt, anchor);
+        unsigned seq = conc->snap_seq.load(std::memory_order_relaxed);
+
+        conc->snap_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        conc->snap_taps.store(conc->tt.taps, std::memory_order_relaxed);
+        conc->snap_period_us.store(tt_period_us(&conc->tt), std::memory_order_relaxed);
+        conc->snap_bpm.store(tt_bpm(&conc->tt), std::memory_order_relaxed);
+        conc->snap_lst_t.store(conc->tt.lst_t, std::memory_order_relaxed);
+        conc->snap_beat_anchor.store(anchor, std::memory_order_relaxed);
+        conc->snap_beat_prd.store(prd, std::memory_order_relaxed);
+
+        conc->snap_seq.store(seq + 2, std::memory_order_release);
+}
+
+void tt_conc_init(tt_conc *conc)
+{
+        for (size_t i = 0; i < TT_CONC_QUEUE_CAP; i++)
+                conc->queue[i].seq.store(i, std::memory_order_relaxed);
+
+        conc->tail.store(0, std::memory_order_relaxed);
+        conc->head = 0;
+        conc->draining.clear();
+        conc->rejected.store(0, std::memory_order_relaxed);
+
+        tt_init(&conc->tt);
+
+        conc->snap_seq.store(0, std::memory_order_relaxed);
+        publish(conc);
+}
+
+int tt_conc_tap(tt_conc *conc)
+{
+        tt_time_t c_time;
+        current_time(&c_time);
+        return tt_conc_tap_at(conc, &c_time);
+}
+
+int tt_conc_tap_at(tt_conc *conc, tt_time_t *time)
+{
+        if (push_or_drain(conc, *time, false))
+                return 0;
+
+        conc->rejected.fetch_add(1, std::memory_order_relaxed);
+#ifdef TT_METRICS
+        tt_metrics_add(TT_METRICS_REJECTED, 1);
+#endif
+        return -1;
+}
+
+int tt_conc_reset(tt_conc *conc)
+{
+        tt_time_t none;
+        reset_time(&none);
+        return push_or_drain(conc, none, true) ? 0 : -1;
+}
+
+bool tt_conc_drain(tt_conc *conc)
+{
+        if (conc->draining.test_and_set(std::memory_order_acquire))
+                return false;
+
+        drained_event ev[TT_CONC_QUEUE_CAP];
+        size_t n = 0;
+
+        // Pop at most one queue length of events, so producers cannot starve the drain
+        while (n < TT_CONC_QUEUE_CAP) {
+                tt_conc::event *slot = &conc->queue[conc->head & QUEUE_MASK];
+
+                if (slot->seq.load(std::memory_order_acquire) != conc->head + 1)
+                        break;
+
+                ev[n].time = slot->time;
+                ev[n].reset = slot->reset;
+                n++;
+
+                slot->seq.store(conc->head + TT_CONC_QUEUE_CAP, std::memory_order_release);
+                conc->head++;
+        }
+
+        // Apply resets in queue order and taps in between them in chronological order
+        size_t i = 0;
+        while (i < n) {
+                if (ev[i].reset) {
+                        tt_reset(&conc->tt);
+                        i++;
+                        continue;
+                }
+
+                size_t j = i;
+                while (j < n && !ev[j].reset)
+                        j++;
+
+                sort_taps(&ev[i], j - i);
+
+                for (; i < j; i++) {
+                        if (conc->tt.taps >= 0 && ev[i].time < conc->tt.lst_t) {
+                                conc->rejected.fetch_add(1, std::memory_order_relaxed);
+#ifdef TT_METRICS
+                                tt_metrics_add(TT_METRICS_REJECTED, 1);
+#endif
+                                continue;
+                        }
+
+                        tt_tap_at(&conc->tt, &ev[i].time);
+                }
+        }
+
+        if (n > 0)
+                publish(conc);
+
+        conc->draining.clear(std::memory_order_release);
+        return true;
+}
+
+void tt_conc_read(tt_conc *conc, tt_conc_snapshot *snap)
+{
+        tt_conc_drain(conc);
+
+        unsigned seq0, seq1;
+
+        do {
+                seq0 = conc->snap_seq.load(std::memory_order_acquire);
+
+                snap->taps = conc->snap_taps.load(std::memory_order_relaxed);
+                snap->period_us = conc->snap_period_us.load(std::memory_order_relaxed);
+                snap->bpm = conc->snap_bpm.load(std::memory_order_relaxed);
+                snap->lst_t = conc->snap_lst_t.load(std::memory_order_relaxed);
+                snap->beat_anchor = conc->snap_beat_anchor.load(std::memory_order_relaxed);
+                snap->beat_prd = conc->snap_beat_prd.load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                seq1 = conc->snap_seq.load(std::memory_order_relaxed);
+        } while (seq0 != seq1 || (seq0 & 1));
+}
+
+unsigned long tt_conc_period_us(tt_conc *conc)
+{
+        tt_conc_snapshot snap;
+        tt_conc_read(conc, &snap);
+        return snap.period_us;
+}
+
+BPM_t tt_conc_bpm(tt_conc *conc)
+{
+        tt_conc_snapshot snap;
+        tt_conc_read(conc, &snap);
+        return snap.bpm;
+}
+
+unsigned long tt_conc_rejected(tt_conc *conc)
+{
+        return conc->rejected.load(std::memory_order_relaxed);
+}
+
+#endif
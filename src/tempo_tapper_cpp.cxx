@@ -33,35 +33,30 @@
 
 tempo_tapper_cpp::tempo_tapper_cpp()
 {
-        _tt = tt_new();
-}
-
-tempo_tapper_cpp::~tempo_tapper_cpp()
-{
-        free(_tt);
+        tt_init(&_tt);
 }
 
 bool tempo_tapper_cpp::is_init()
 {
-        return _tt != NULL;
+        return true;
 }
 
 unsigned long tempo_tapper_cpp::period_us()
 {
-        return tt_period_us(_tt);
+        return tt_period_us(&_tt);
 }
 
 void tempo_tapper_cpp::tap()
 {
-        tt_tap(_tt);
+        tt_tap(&_tt);
 }
 
 void tempo_tapper_cpp::reset()
 {
-        tt_reset(_tt);
+        tt_reset(&_tt);
 }
 
 BPM_t tempo_tapper_cpp::bpm()
 {
-        return tt_bpm(_tt);
+        return tt_bpm(&_tt);
 }
\ No newline at end of file
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_evdev.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the input front-end for Linux input devices
+ *
+ * The following file defines the functions of the input front-end.
+ * Devices are read non-blocking, so tt_evdev_poll() drains every ready
+ * device until it would block and never waits once epoll has woken it.
+ *
+ * All function descriptions can be found in the tempo_tapper_evdev.h file.
+ */
+
+#if defined(TT_TARGET_PLATFORM_POSIX) && defined(__linux__)
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include <tempo_tapper_evdev.h>
+
+#define S_TO_NS 1000000000LL
+#define READ_EVENTS 64          ///< Events read from a device at once
+
+static int64_t read_ns(clockid_t id)
+{
+        struct timespec ts;
+        clock_gettime(id, &ts);
+        return (int64_t) ts.tv_sec * S_TO_NS + ts.tv_nsec;
+}
+
+// Returns the offset that converts tempo tapper clock times to the clock of the kernel timestamps
+static int64_t clock_offset(clockid_t id)
+{
+        tt_clock_src src = tt_clock_source();
+
+        if (src == TT_CLOCK_MONOTONIC || src == TT_CLOCK_REALTIME)
+                return 0;
+
+        tt_time_t a, b;
+        current_time(&a);
+        int64_t ns = read_ns(id);
+        current_time(&b);
+
+        return ns - (int64_t) (a + (b - a) / 2);
+}
+
+static void record(tt_evdev *ev, int64_t delay_ns)
+{
+        ev->taps++;
+        ev->delay_sum += delay_ns;
+        ev->delay_sq_sum += (double) delay_ns * delay_ns;
+
+        if (delay_ns < ev->delay_min_ns)
+                ev->delay_min_ns = delay_ns;
+
+        if (delay_ns > ev->delay_max_ns)
+                ev->delay_max_ns = delay_ns;
+}
+
+int tt_evdev_init(tt_evdev *ev, tempo_tapper *tapper, unsigned short tap_code)
+{
+        ev->tapper = tapper;
+        ev->tap_code = tap_code;
+        ev->clock = tt_clock_source() == TT_CLOCK_REALTIME ? CLOCK_REALTIME : CLOCK_MONOTONIC;
+        ev->n_fds = 0;
+
+        ev->taps = 0;
+        ev->delay_min_ns = INT64_MAX;
+        ev->delay_max_ns = INT64_MIN;
+        ev->delay_sum = 0;
+        ev->delay_sq_sum = 0;
+
+        ev->epfd = epoll_create1(EPOLL_CLOEXEC);
+        return ev->epfd < 0 ? errno : 0;
+}
+
+int tt_evdev_open(tt_evdev *ev, const char *path, bool grab)
+{
+        if (ev->n_fds == TT_EVDEV_MAX_DEVICES)
+                return ENOSPC;
+
+        int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+                return errno;
+
+        int clk = ev->clock;
+        struct epoll_event ee;
+        ee.events = EPOLLIN;
+        ee.data.u32 = ev->n_fds;
+
+        if (ioctl(fd, EVIOCSCLOCKID, &clk) < 0 || (grab && ioctl(fd, EVIOCGRAB, 1) < 0) ||
+            epoll_ctl(ev->epfd, EPOLL_CTL_ADD, fd, &ee) < 0) {
+                int err = errno;
+                close(fd);
+                return err;
+        }
+
+        ev->fds[ev->n_fds] = fd;
+        ev->dropped[ev->n_fds] = false;
+        ev->n_fds++;
+        return 0;
+}
+
+int tt_evdev_poll(tt_evdev *ev, int timeout_ms, tt_evdev_key *keys, size_t cap)
+{
+        struct epoll_event ready[TT_EVDEV_MAX_DEVICES];
+        int n_ready;
+
+        while ((n_ready = epoll_wait(ev->epfd, ready, TT_EVDEV_MAX_DEVICES, timeout_ms)) < 0) {
+                if (errno != EINTR)
+                        return -errno;
+        }
+
+        int64_t off = clock_offset(ev->clock);
+        size_t cnt = 0;
+
+        for (int r = 0; r < n_ready; r++) {
+                unsigned int d = ready[r].data.u32;
+                struct input_event buf[READ_EVENTS];
+                ssize_t len = 0;
+
+                // Every key press takes at least one event, so reading no more events than free keys never overflows keys
+                while (keys == NULL || cnt < cap) {
+                        size_t max = keys == NULL || cap - cnt > READ_EVENTS ? READ_EVENTS : cap - cnt;
+
+                        if ((len = read(ev->fds[d], buf, max * sizeof(struct input_event))) <= 0)
+                                break;
+
+                        for (size_t i = 0; i < len / sizeof(struct input_event); i++) {
+                                const struct input_event *ie = &buf[i];
+
+                                // After a buffer overrun, events are incomplete up to the next report
+                                if (ie->type == EV_SYN) {
+                                        if (ie->code == SYN_DROPPED)
+                                                ev->dropped[d] = true;
+                                        else if (ie->code == SYN_REPORT)
+                                                ev->dropped[d] = false;
+                                        continue;
+                                }
+
+                                // Only presses count, releases have the value 0 and auto-repeats 2
+                                if (ev->dropped[d] || ie->type != EV_KEY || ie->value != 1)
+                                        continue;
+
+                                tt_time_t t = (tt_time_t) ((int64_t) ie->input_event_sec * S_TO_NS +
+                                                           (int64_t) ie->input_event_usec * 1000 - off);
+                                bool tap = ev->tap_code == 0 || ie->code == ev->tap_code;
+
+                                if (tap) {
+                                        tt_time_t now;
+                                        current_time(&now);
+
+                                        tt_tap_at(ev->tapper, &t);
+                                        record(ev, (int64_t) (now - t));
+                                }
+
+                                if (keys != NULL) {
+                                        keys[cnt].code = ie->code;
+                                        keys[cnt].time = t;
+                                        keys[cnt].tapped = tap;
+                                }
+
+                                cnt++;
+                        }
+                }
+
+                if (len < 0 && errno != EAGAIN && errno != EINTR)
+                        return -errno;
+        }
+
+        return (int) cnt;
+}
+
+void tt_evdev_stats(tt_evdev *ev, tt_evdev_delay_stats *stats)
+{
+        stats->taps = ev->taps;
+
+        if (ev->taps > 0) {
+                double avg = ev->delay_sum / ev->taps;
+                double var = ev->delay_sq_sum / ev->taps - avg * avg;
+
+                stats->delay_min_ns = ev->delay_min_ns;
+                stats->delay_max_ns = ev->delay_max_ns;
+                stats->delay_avg_ns = avg;
+                stats->delay_sd_ns = var > 0 ? sqrt(var) : 0;
+        } else {
+                stats->delay_min_ns = 0;
+                stats->delay_max_ns = 0;
+                stats->delay_avg_ns = 0;
+                stats->delay_sd_ns = 0;
+        }
+}
+
+void tt_evdev_close(tt_evdev *ev)
+{
+        for (unsigned int i = 0; i < ev->n_fds; i++)
+                close(ev->fds[i]);
+
+        ev->n_fds = 0;
+
+        if (ev->epfd >= 0) {
+                close(ev->epfd);
+                ev->epfd = -1;
+        }
+}
+
+// Virtual keyboard
+
+static int emit(int fd, unsigned short type, unsigned short code, int value)
+{
+        struct input_event ie;
+        memset(&ie, 0, sizeof(ie));
+        ie.type = type;
+        ie.code = code;
+        ie.value = value;
+
+        return write(fd, &ie, sizeof(ie)) == sizeof(ie) ? 0 : errno;
+}
+
+// Looks up the event device of the input device sysname, ex. input12
+static bool find_event_node(const char *sysname, char *path, size_t len)
+{
+        char dir_path[128];
+        snprintf(dir_path, sizeof(dir_path), "/sys/devices/virtual/input/%s", sysname);
+
+        DIR *dir = opendir(dir_path);
+        if (dir == NULL)
+                return false;
+
+        struct dirent *ent;
+        bool found = false;
+
+        while (!found && (ent = readdir(dir)) != NULL) {
+                if (strncmp(ent->d_name, "event", 5) == 0) {
+                        int n = snprintf(path, len, "/dev/input/%s", ent->d_name);
+                        found = n > 0 && (size_t) n < len && access(path, F_OK) == 0;
+                }
+        }
+
+        closedir(dir);
+        return found;
+}
+
+int tt_evdev_virtual_open(tt_evdev_virtual *vd)
+{
+        struct uinput_setup setup;
+        char sysname[32];
+        int err;
+
+        vd->fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+        if (vd->fd < 0)
+                return errno;
+
+        if (ioctl(vd->fd, UI_SET_EVBIT, EV_KEY) < 0)
+                goto fail;
+
+        // Registers all regular keys, so that any key code can be pressed
+        for (int key = KEY_ESC; key < KEY_MICMUTE; key++) {
+                if (ioctl(vd->fd, UI_SET_KEYBIT, key) < 0)
+                        goto fail;
+        }
+
+        memset(&setup, 0, sizeof(setup));
+        setup.id.bustype = BUS_VIRTUAL;
+        strncpy(setup.name, "tempo tapper virtual keyboard", UINPUT_MAX_NAME_SIZE - 1);
+
+        if (ioctl(vd->fd, UI_DEV_SETUP, &setup) < 0 || ioctl(vd->fd, UI_DEV_CREATE) < 0)
+                goto fail;
+
+        if (ioctl(vd->fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0)
+                goto fail;
+
+        // The device node is created asynchronously by udev
+        for (int i = 0; i < 100; i++) {
+                if (find_event_node(sysname, vd->path, sizeof(vd->path)))
+                        return 0;
+
+                usleep(10000);
+        }
+
+        tt_evdev_virtual_close(vd);
+        return ENOENT;
+
+fail:
+        err = errno;
+        close(vd->fd);
+        vd->fd = -1;
+        return err;
+}
+
+int tt_evdev_virtual_press(tt_evdev_virtual *vd, unsigned short code)
+{
+        int err;
+
+        if ((err = emit(vd->fd, EV_KEY, code, 1)) || (err = emit(vd->fd, EV_SYN, SYN_REPORT, 0)) ||
+            (err = emit(vd->fd, EV_KEY, code, 0)) || (err = emit(vd->fd, EV_SYN, SYN_REPORT, 0)))
+                return err;
+
+        return 0;
+}
+
+void tt_evdev_virtual_close(tt_evdev_virtual *vd)
+{
+        if (vd->fd < 0)
+                return;
+
+        ioctl(vd->fd, UI_DEV_DESTROY);
+        close(vd->fd);
+        vd->fd = -1;
+}
+
+#endif
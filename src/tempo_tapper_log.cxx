@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_log.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the tap log recorder and replay engine
+ *
+ * The following file defines the functions of the tap log recorder and replay engine.
+ * Fields are converted from and to little-endian on big-endian hosts only.
+ *
+ * All function descriptions can be found in the tempo_tapper_log.h file.
+ */
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <tempo_tapper_log.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static_assert(sizeof(tt_log_header) == 32, "tt_log_header must be 32 bytes");
+static_assert(sizeof(tt_log_record) == 16, "tt_log_record must be 16 bytes");
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static inline uint16_t le16(uint16_t v) { return __builtin_bswap16(v); }
+static inline uint32_t le32(uint32_t v) { return __builtin_bswap32(v); }
+static inline uint64_t le64(uint64_t v) { return __builtin_bswap64(v); }
+#else
+static inline uint16_t le16(uint16_t v) { return v; }
+static inline uint32_t le32(uint32_t v) { return v; }
+static inline uint64_t le64(uint64_t v) { return v; }
+#endif
+
+int tt_log_create(tt_log *log, const char *path, size_t capacity, const tempo_tapper *cfg)
+{
+        tempo_tapper def;
+        size_t len = sizeof(tt_log_header) + capacity * sizeof(tt_log_record);
+
+        if (cfg == NULL) {
+                tt_init(&def);
+                cfg = &def;
+        }
+
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+                return -1;
+
+        // The file stays sparse until records are written
+        if (ftruncate(fd, len) < 0) {
+                int err = errno;
+                close(fd);
+                errno = err;
+                return -1;
+        }
+
+        void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+                int err = errno;
+                close(fd);
+                errno = err;
+                return -1;
+        }
+
+        tt_log_header *hdr = (tt_log_header *) map;
+        uint32_t chg_h = 0;
+
+#ifdef TT_CHANGE
+        memcpy(&chg_h, &cfg->chg_h, sizeof(chg_h));
+#endif
+
+        memcpy(hdr->magic, TT_LOG_MAGIC, sizeof(hdr->magic));
+        hdr->version = le16(TT_LOG_VERSION);
+        hdr->record_size = le16(sizeof(tt_log_record));
+        hdr->ticks_per_us = le32(TT_TICKS_PER_US);
+        hdr->est = cfg->est;
+        hdr->reserved = 0;
+        hdr->win_len = le16(cfg->win_len);
+        hdr->chg_h = le32(chg_h);
+        hdr->reserved2 = 0;
+        hdr->reserved3 = 0;
+
+        log->fd = fd;
+        log->map = map;
+        log->map_len = len;
+        log->records = (tt_log_record *) (hdr + 1);
+        log->cap = capacity;
+        log->next.store(0, std::memory_order_relaxed);
+        log->dropped.store(0, std::memory_order_relaxed);
+        return 0;
+}
+
+static int append(tt_log *log, uint32_t channel, tt_time_t time, tt_log_type type)
+{
+        size_t i = log->next.fetch_add(1, std::memory_order_relaxed);
+
+        if (i >= log->cap) {
+                log->dropped.fetch_add(1, std::memory_order_relaxed);
+                return -1;
+        }
+
+        tt_log_record *rec = &log->records[i];
+        rec->time = le64(time);
+        rec->channel = le32(channel);
+        memset(rec->reserved, 0, sizeof(rec->reserved));
+
+        // The type completes the record, so it is stored last
+        std::atomic_thread_fence(std::memory_order_release);
+        rec->type = type;
+        return 0;
+}
+
+int tt_log_tap(tt_log *log, uint32_t channel, tt_time_t *time)
+{
+        return append(log, channel, *time, TT_LOG_TAP);
+}
+
+int tt_log_reset(tt_log *log, uint32_t channel, tt_time_t *time)
+{
+        return append(log, channel, *time, TT_LOG_RESET);
+}
+
+size_t tt_log_count(tt_log *log)
+{
+        size_t n = log->next.load(std::memory_order_relaxed);
+        return n < log->cap ? n : log->cap;
+}
+
+int tt_log_close(tt_log *log)
+{
+        size_t len = sizeof(tt_log_header) + tt_log_count(log) * sizeof(tt_log_record);
+        int ret = 0;
+
+        munmap(log->map, log->map_len);
+
+        if (ftruncate(log->fd, len) < 0)
+                ret = -1;
+
+        if (close(log->fd) < 0)
+                ret = -1;
+
+        log->map = NULL;
+        log->records = NULL;
+        log->fd = -1;
+        return ret;
+}
+
+// Returns true if clock times of the given tick length can be converted to those of current_time()
+static bool ticks_convertible(uint32_t tpu)
+{
+        return tpu != 0 && (tpu > TT_TICKS_PER_US ? tpu % TT_TICKS_PER_US : TT_TICKS_PER_US % tpu) == 0;
+}
+
+int tt_log_map(tt_log_view *view, const char *path)
+{
+        struct stat st;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+                return -1;
+
+        if (fstat(fd, &st) < 0) {
+                int err = errno;
+                close(fd);
+                errno = err;
+                return -1;
+        }
+
+        if ((size_t) st.st_size < sizeof(tt_log_header)) {
+                close(fd);
+                errno = EINVAL;
+                return -1;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        int err = errno;
+        close(fd);
+
+        if (map == MAP_FAILED) {
+                errno = err;
+                return -1;
+        }
+
+        const tt_log_header *hdr = (const tt_log_header *) map;
+
+        if (memcmp(hdr->magic, TT_LOG_MAGIC, sizeof(hdr->magic)) != 0 ||
+            le16(hdr->version) != TT_LOG_VERSION ||
+            le16(hdr->record_size) != sizeof(tt_log_record) ||
+            !ticks_convertible(le32(hdr->ticks_per_us))) {
+                munmap(map, st.st_size);
+                errno = EINVAL;
+                return -1;
+        }
+
+        const tt_log_record *records = (const tt_log_record *) (hdr + 1);
+        size_t count = (st.st_size - sizeof(tt_log_header)) / sizeof(tt_log_record);
+
+        // Logs that have not been closed end in unwritten, preallocated records
+        while (count > 0 && records[count - 1].type == TT_LOG_END)
+                count--;
+
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+        view->map = map;
+        view->map_len = st.st_size;
+        view->hdr = hdr;
+        view->records = records;
+        view->count = count;
+        return 0;
+}
+
+void tt_log_unmap(tt_log_view *view)
+{
+        munmap(view->map, view->map_len);
+        view->map = NULL;
+        view->hdr = NULL;
+        view->records = NULL;
+        view->count = 0;
+}
+
+static inline uint64_t fnv_u32(uint64_t h, uint32_t v)
+{
+        for (int i = 0; i < 4; i++) {
+                h ^= (v >> (i * 8)) & 0xff;
+                h *= FNV_PRIME;
+        }
+
+        return h;
+}
+
+int tt_replay(const tt_log_view *view, tempo_tapper *tappers, size_t channels,
+              tt_replay_cb cb, void *arg, tt_replay_result *res)
+{
+        const tt_log_header *hdr = view->hdr;
+        uint32_t tpu = le32(hdr->ticks_per_us);
+        uint32_t chg_bits = le32(hdr->chg_h);
+        float chg_h;
+
+        memcpy(&chg_h, &chg_bits, sizeof(chg_h));
+
+        if (le16(hdr->win_len) > TT_WINDOW_CAP || isinf(chg_h))
+                return -1;
+
+#ifndef TT_CHANGE
+        // The change detection is not compiled in, so the log cannot be replayed faithfully
+        if (chg_h != 0)
+                return -1;
+#endif
+
+        for (size_t c = 0; c < channels; c++) {
+                tt_init(&tappers[c]);
+
+                if (tt_set_estimator(&tappers[c], (tt_estimator) hdr->est) < 0)
+                        return -1;
+
+#ifdef TT_CHANGE
+                if (tt_set_change_detection(&tappers[c], chg_h) < 0)
+                        return -1;
+#endif
+
+                tt_set_window(&tappers[c], le16(hdr->win_len));
+        }
+
+        res->events = 0;
+        res->skipped = 0;
+        res->digest = FNV_OFFSET;
+
+        for (size_t i = 0; i < view->count; i++) {
+                const tt_log_record *rec = &view->records[i];
+                uint32_t ch = le32(rec->channel);
+
+                // Records claimed but never written by a crashed recorder
+                if (rec->type == TT_LOG_END)
+                        continue;
+
+                if (ch >= channels || (rec->type != TT_LOG_TAP && rec->type != TT_LOG_RESET)) {
+                        res->skipped++;
+                        continue;
+                }
+
+                tempo_tapper *tt = &tappers[ch];
+
+                if (rec->type == TT_LOG_TAP) {
+                        uint64_t t = le64(rec->time);
+                        tt_time_t time = tpu > TT_TICKS_PER_US ? t / (tpu / TT_TICKS_PER_US) : t * (TT_TICKS_PER_US / tpu);
+                        tt_tap_at(tt, &time);
+                } else {
+                        tt_reset(tt);
+                }
+
+                BPM_t bpm = tt_bpm(tt);
+                uint32_t bits;
+                memcpy(&bits, &bpm, sizeof(bits));
+
+                res->digest = fnv_u32(fnv_u32(res->digest, ch), bits);
+                res->events++;
+
+                if (cb != NULL)
+                        cb(rec, tt, arg);
+        }
+
+        return 0;
+}
+
+#endif
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_metrics.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the metrics of the tap and query paths
+ *
+ * The following file defines the metrics functions.
+ * A value v of at least 2 * TT_METRICS_SUB_BUCKETS, whose highest set bit
+ * is p, falls into bucket (p - SUB_BITS) * SUB_BUCKETS + (v >> (p - SUB_BITS)),
+ * where the shifted value keeps the top SUB_BITS + 1 bits of v. Smaller
+ * values fall into the bucket of their own value.
+ *
+ * All function descriptions can be found in the tempo_tapper_metrics.h file.
+ */
+
+#if defined(TT_TARGET_PLATFORM_POSIX) && defined(TT_METRICS)
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <tempo_tapper_metrics.h>
+
+#define LINEAR (2 * TT_METRICS_SUB_BUCKETS)     ///< Values below are counted exactly
+#define PROM_MIN_EXP 7                          ///< Smallest Prometheus bucket bound, 2^7ns
+#define PROM_MAX_EXP 37                         ///< Largest finite Prometheus bucket bound, 2^37ns
+
+typedef struct histogram
+{
+        std::atomic<uint64_t> buckets[TT_METRICS_BUCKETS];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+} histogram;
+
+static histogram hists[TT_METRICS_HISTS];
+static std::atomic<uint64_t> counters[TT_METRICS_COUNTERS];
+
+static const char *hist_names[] = {
+        "tap_duration",
+        "tap_interval",
+        "query_staleness",
+};
+
+static const char *hist_help[] = {
+        "Time spent in tt_tap() and tt_tap_at()",
+        "Interval between two taps of a tempo tapper",
+        "Time since the last tap when the tempo is queried",
+};
+
+static const char *counter_names[] = {
+        "taps",
+        "resets",
+        "queries",
+        "rejected_taps",
+};
+
+static const char *counter_help[] = {
+        "Number of taps",
+        "Number of tempo tapper resets",
+        "Number of tempo queries",
+        "Number of taps rejected by concurrent tempo tappers",
+};
+
+static unsigned int bucket_of(uint64_t v)
+{
+        if (v < LINEAR)
+                return (unsigned int) v;
+
+        unsigned int shift = 63 - __builtin_clzll(v) - TT_METRICS_SUB_BITS;
+        return shift * TT_METRICS_SUB_BUCKETS + (unsigned int) (v >> shift);
+}
+
+// Returns the highest value of a bucket
+static uint64_t bucket_max(unsigned int b)
+{
+        if (b < LINEAR)
+                return b;
+
+        unsigned int shift = b / TT_METRICS_SUB_BUCKETS - 1;
+        uint64_t top = b % TT_METRICS_SUB_BUCKETS + TT_METRICS_SUB_BUCKETS;
+
+        return ((top + 1) << shift) - 1;
+}
+
+void tt_metrics_record(tt_metrics_hist hist, uint64_t ns)
+{
+        histogram *h = &hists[hist];
+
+        h->buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        h->count.fetch_add(1, std::memory_order_relaxed);
+        h->sum.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t max = h->max.load(std::memory_order_relaxed);
+        while (ns > max && !h->max.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+}
+
+void tt_metrics_add(tt_metrics_counter counter, uint64_t n)
+{
+        counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t tt_metrics_count(tt_metrics_counter counter)
+{
+        return counters[counter].load(std::memory_order_relaxed);
+}
+
+uint64_t tt_metrics_percentile(tt_metrics_hist hist, double percentile)
+{
+        histogram *h = &hists[hist];
+        uint64_t count = h->count.load(std::memory_order_relaxed);
+
+        if (count == 0)
+                return 0;
+
+        // Rank of the percentile, at least the first value
+        uint64_t rank = (uint64_t) (percentile / 100 * count + 0.5);
+        if (rank < 1)
+                rank = 1;
+
+        uint64_t seen = 0;
+        uint64_t max = h->max.load(std::memory_order_relaxed);
+
+        for (unsigned int b = 0; b < TT_METRICS_BUCKETS; b++) {
+                seen += h->buckets[b].load(std::memory_order_relaxed);
+
+                if (seen >= rank)
+                        return bucket_max(b) < max ? bucket_max(b) : max;
+        }
+
+        return max;
+}
+
+void tt_metrics_reset()
+{
+        for (unsigned int i = 0; i < TT_METRICS_HISTS; i++) {
+                for (unsigned int b = 0; b < TT_METRICS_BUCKETS; b++)
+                        hists[i].buckets[b].store(0, std::memory_order_relaxed);
+
+                hists[i].count.store(0, std::memory_order_relaxed);
+                hists[i].sum.store(0, std::memory_order_relaxed);
+                hists[i].max.store(0, std::memory_order_relaxed);
+        }
+
+        for (unsigned int i = 0; i < TT_METRICS_COUNTERS; i++)
+                counters[i].store(0, std::memory_order_relaxed);
+}
+
+// Output
+
+typedef struct writer
+{
+        int fd;
+        int err;
+        size_t len;
+        char buf[4096];
+} writer;
+
+static void flush(writer *w)
+{
+        size_t off = 0;
+
+        while (w->err == 0 && off < w->len) {
+                ssize_t n = write(w->fd, w->buf + off, w->len - off);
+
+                if (n < 0 && errno != EINTR)
+                        w->err = errno;
+                else if (n > 0)
+                        off += n;
+        }
+
+        w->len = 0;
+}
+
+static void out(writer *w, const char *fmt, ...)
+{
+        char line[256];
+        va_list ap;
+
+        va_start(ap, fmt);
+        int n = vsnprintf(line, sizeof(line), fmt, ap);
+        va_end(ap);
+
+        if (n < 0)
+                return;
+
+        if ((size_t) n >= sizeof(line))
+                n = sizeof(line) - 1;
+
+        if (w->len + n > sizeof(w->buf))
+                flush(w);
+
+        memcpy(w->buf + w->len, line, n);
+        w->len += n;
+}
+
+static void dump_prometheus(writer *w)
+{
+        for (unsigned int i = 0; i < TT_METRICS_HISTS; i++) {
+                histogram *h = &hists[i];
+                const char *name = hist_names[i];
+                uint64_t cum = 0;
+                unsigned int b = 0;
+
+                out(w, "# HELP tt_%s_seconds %s\n", name, hist_help[i]);
+                out(w, "# TYPE tt_%s_seconds histogram\n", name);
+
+                /*
+                 * Powers of two start a bucket, so the buckets below 2^e hold exactly the samples
+                 * of up to 2^e - 1 ns, which is the inclusive upper bound Prometheus expects
+                 */
+                for (unsigned int e = PROM_MIN_EXP; e <= PROM_MAX_EXP; e++) {
+                        unsigned int end = bucket_of((uint64_t) 1 << e);
+
+                        for (; b < end; b++)
+                                cum += h->buckets[b].load(std::memory_order_relaxed);
+
+                        out(w, "tt_%s_seconds_bucket{le=\"%.9g\"} %llu\n", name,
+                            (double) (((uint64_t) 1 << e) - 1) / 1e9, (unsigned long long) cum);
+                }
+
+                for (; b < TT_METRICS_BUCKETS; b++)
+                        cum += h->buckets[b].load(std::memory_order_relaxed);
+
+                out(w, "tt_%s_seconds_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long) cum);
+                out(w, "tt_%s_seconds_sum %.9f\n", name, h->sum.load(std::memory_order_relaxed) / 1e9);
+                out(w, "tt_%s_seconds_count %llu\n", name, (unsigned long long) cum);
+        }
+
+        for (unsigned int i = 0; i < TT_METRICS_COUNTERS; i++) {
+                out(w, "# HELP tt_%s_total %s\n", counter_names[i], counter_help[i]);
+                out(w, "# TYPE tt_%s_total counter\n", counter_names[i]);
+                out(w, "tt_%s_total %llu\n", counter_names[i], (unsigned long long) tt_metrics_count((tt_metrics_counter) i));
+        }
+}
+
+static void dump_json(writer *w)
+{
+        out(w, "{\"counters\":{");
+
+        for (unsigned int i = 0; i < TT_METRICS_COUNTERS; i++) {
+                out(w, "%s\"%s\":%llu", i ? "," : "", counter_names[i],
+                    (unsigned long long) tt_metrics_count((tt_metrics_counter) i));
+        }
+
+        out(w, "},\"histograms\":{");
+
+        for (unsigned int i = 0; i < TT_METRICS_HISTS; i++) {
+                histogram *h = &hists[i];
+                tt_metrics_hist hist = (tt_metrics_hist) i;
+
+                out(w, "%s\"%s_ns\":{\"count\":%llu,\"sum\":%llu,", i ? "," : "", hist_names[i],
+                    (unsigned long long) h->count.load(std::memory_order_relaxed),
+                    (unsigned long long) h->sum.load(std::memory_order_relaxed));
+                out(w, "\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+                    (unsigned long long) tt_metrics_percentile(hist, 50),
+                    (unsigned long long) tt_metrics_percentile(hist, 90),
+                    (unsigned long long) tt_metrics_percentile(hist, 99),
+                    (unsigned long long) tt_metrics_percentile(hist, 99.9),
+                    (unsigned long long) h->max.load(std::memory_order_relaxed));
+        }
+
+        out(w, "}}\n");
+}
+
+int tt_metrics_dump(int fd, tt_metrics_format fmt)
+{
+        writer w;
+        w.fd = fd;
+        w.err = 0;
+        w.len = 0;
+
+        if (fmt == TT_METRICS_JSON)
+                dump_json(&w);
+        else
+                dump_prometheus(&w);
+
+        flush(&w);
+
+        if (w.err != 0) {
+                errno = w.err;
+                return -1;
+        }
+
+        return 0;
+}
+
+#endif
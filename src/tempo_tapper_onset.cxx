@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_onset.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the onset detector
+ *
+ * The following file defines the functions of the onset detector.
+ * Samples are halved before squaring, so that the squares of two samples,
+ * as well as the square of the difference of two halved samples, fit the
+ * 32 bit lanes of _mm_madd_epi16(). The scalar fallback performs the same
+ * integer arithmetic, so both produce identical onsets.
+ *
+ * All function descriptions can be found in the tempo_tapper_onset.h file.
+ */
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <tempo_tapper_onset.h>
+
+#if defined(__SSE2__) && !defined(TT_ONSET_SCALAR)
+#include <emmintrin.h>
+#define TT_ONSET_SIMD
+#endif
+
+#define HISTORY_MASK (TT_ONSET_HISTORY - 1)
+#define SUBS (TT_ONSET_HOP / TT_ONSET_SUB)
+#define E_FLOOR 256.0f  ///< Energy per sample at -60 dBFS (halved samples), quieter hops count as silence
+
+static_assert(TT_ONSET_HOP % TT_ONSET_SUB == 0, "TT_ONSET_HOP must be a multiple of TT_ONSET_SUB");
+static_assert((TT_ONSET_HISTORY & HISTORY_MASK) == 0, "TT_ONSET_HISTORY must be a power of two");
+static_assert(TT_ONSET_HISTORY > TT_ONSET_PRE + TT_ONSET_POST, "TT_ONSET_HISTORY is too small");
+
+/*
+ * Computes the energy of n samples of cur and the energy of their difference to
+ * the samples of prev, which lag one frame behind. n must be a multiple of 8.
+ */
+#ifdef TT_ONSET_SIMD
+
+static void sub_energy(const int16_t *cur, const int16_t *prev, size_t n, uint64_t *e, uint64_t *d)
+{
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc_e = zero, acc_d = zero;
+
+        for (size_t i = 0; i < n; i += 8) {
+                __m128i a = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) (cur + i)), 1);
+                __m128i b = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) (prev + i)), 1);
+                __m128i diff = _mm_sub_epi16(a, b);
+
+                // Pairwise sums of squares are non-negative, so they are widened with zeros
+                __m128i se = _mm_madd_epi16(a, a);
+                __m128i sd = _mm_madd_epi16(diff, diff);
+
+                acc_e = _mm_add_epi64(acc_e, _mm_unpacklo_epi32(se, zero));
+                acc_e = _mm_add_epi64(acc_e, _mm_unpackhi_epi32(se, zero));
+                acc_d = _mm_add_epi64(acc_d, _mm_unpacklo_epi32(sd, zero));
+                acc_d = _mm_add_epi64(acc_d, _mm_unpackhi_epi32(sd, zero));
+        }
+
+        uint64_t le[2], ld[2];
+        _mm_storeu_si128((__m128i *) le, acc_e);
+        _mm_storeu_si128((__m128i *) ld, acc_d);
+
+        *e = le[0] + le[1];
+        *d = ld[0] + ld[1];
+}
+
+#else
+
+static void sub_energy(const int16_t *cur, const int16_t *prev, size_t n, uint64_t *e, uint64_t *d)
+{
+        uint64_t se = 0, sd = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                int32_t a = cur[i] >> 1;
+                int32_t diff = a - (prev[i] >> 1);
+
+                se += a * a;
+                sd += diff * diff;
+        }
+
+        *e = se;
+        *d = sd;
+}
+
+#endif
+
+// Converts a stream position in frames to a clock time, without overflowing on long streams
+static tt_time_t frames_to_time(tt_onset *od, uint64_t frames)
+{
+        const uint64_t ticks_per_s = (uint64_t) S_TO_US * TT_TICKS_PER_US;
+
+        return od->start + (frames / od->rate) * ticks_per_s + (frames % od->rate) * ticks_per_s / od->rate;
+}
+
+// Returns true if the candidate hop c is a peak of the novelty function
+static bool is_peak(tt_onset *od, uint64_t c)
+{
+        float n = od->nov[c & HISTORY_MASK];
+        float sum = 0;
+
+        for (uint64_t h = c - TT_ONSET_PRE; h <= c + TT_ONSET_POST; h++) {
+                float v = od->nov[h & HISTORY_MASK];
+                sum += v;
+
+                // Earlier hops win ties, so plateaus only produce a single onset
+                if (h + TT_ONSET_POST >= c && h != c && (h < c ? v >= n : v > n))
+                        return false;
+        }
+
+        return n > sum / (TT_ONSET_PRE + TT_ONSET_POST + 1) + od->threshold;
+}
+
+// Computes and stores the novelty of the buffered hop
+static float hop_novelty(tt_onset *od)
+{
+        const size_t n = TT_ONSET_SUB * od->channels;
+        uint64_t e = 0, d = 0;
+        int64_t max_rise = INT64_MIN;
+        unsigned int onset_sub = 0;
+
+        for (unsigned int k = 0; k < SUBS; k++) {
+                uint64_t se, sd;
+                sub_energy(&od->buf[od->channels + k * n], &od->buf[k * n], n, &se, &sd);
+
+                e += se;
+                d += sd;
+
+                int64_t rise = (int64_t) sd - (int64_t) od->prev_sub_d;
+                if (rise > max_rise) {
+                        max_rise = rise;
+                        onset_sub = k;
+                }
+
+                od->prev_sub_d = sd;
+        }
+
+        float samples = (float) TT_ONSET_HOP * od->channels;
+        float le = logf(1 + e / samples / E_FLOOR);
+        float ld = logf(1 + d / samples / E_FLOOR);
+        float ref_e = od->prev_e[0], ref_d = od->prev_d[0];
+
+        // Rises are measured against the loudest of the previous hops, which suppresses ripple of decaying notes
+        for (unsigned int k = 1; k < TT_ONSET_LAG; k++) {
+                if (od->prev_e[k] > ref_e)
+                        ref_e = od->prev_e[k];
+                if (od->prev_d[k] > ref_d)
+                        ref_d = od->prev_d[k];
+        }
+
+        float nov = (le > ref_e ? le - ref_e : 0) + (ld > ref_d ? ld - ref_d : 0);
+
+        memmove(&od->prev_e[1], &od->prev_e[0], (TT_ONSET_LAG - 1) * sizeof(float));
+        memmove(&od->prev_d[1], &od->prev_d[0], (TT_ONSET_LAG - 1) * sizeof(float));
+        od->prev_e[0] = le;
+        od->prev_d[0] = ld;
+
+        uint64_t h = od->hops++;
+        od->nov[h & HISTORY_MASK] = nov;
+        od->pos[h & HISTORY_MASK] = h * TT_ONSET_HOP + onset_sub * TT_ONSET_SUB;
+
+        return nov;
+}
+
+// Picks the hop TT_ONSET_POST hops before the last processed one
+static bool pick(tt_onset *od)
+{
+        uint64_t h = od->hops - 1;
+
+        if (h < TT_ONSET_PRE + TT_ONSET_POST)
+                return false;
+
+        uint64_t c = h - TT_ONSET_POST;
+
+        if (od->onsets > 0 && c - od->last_onset < od->min_gap)
+                return false;
+
+        if (!is_peak(od, c))
+                return false;
+
+        tt_time_t t = frames_to_time(od, od->pos[c & HISTORY_MASK]);
+        tt_tap_at(od->tapper, &t);
+
+        od->last_onset = c;
+        od->onsets++;
+        return true;
+}
+
+int tt_onset_init(tt_onset *od, tempo_tapper *tapper, unsigned int rate, unsigned int channels, tt_time_t *start)
+{
+        if (rate == 0 || channels == 0 || channels > TT_ONSET_MAX_CHANNELS)
+                return -1;
+
+        od->tapper = tapper;
+        od->rate = rate;
+        od->channels = channels;
+
+        if (start)
+                od->start = *start;
+        else
+                reset_time(&od->start);
+
+        memset(od->buf, 0, sizeof(od->buf));
+        od->buf_frames = 0;
+        od->hops = 0;
+
+        memset(od->prev_e, 0, sizeof(od->prev_e));
+        memset(od->prev_d, 0, sizeof(od->prev_d));
+        od->prev_sub_d = 0;
+        memset(od->nov, 0, sizeof(od->nov));
+
+        od->last_onset = 0;
+        od->onsets = 0;
+
+        tt_onset_set_threshold(od, 0.3f, 100);
+        return 0;
+}
+
+void tt_onset_set_threshold(tt_onset *od, float threshold, unsigned int min_gap_ms)
+{
+        od->threshold = threshold;
+        od->min_gap = (unsigned int) ((uint64_t) min_gap_ms * od->rate / 1000 / TT_ONSET_HOP);
+}
+
+/*
+ * Buffers frames and processes every completed hop. If env is given, the novelty
+ * of each hop is stored in env and the number of stored values is returned,
+ * otherwise onsets are picked and their number is returned.
+ */
+static size_t feed(tt_onset *od, const int16_t *pcm, size_t frames, float *env, size_t cap)
+{
+        const unsigned int ch = od->channels;
+        size_t cnt = 0;
+
+        while (frames > 0) {
+                size_t n = TT_ONSET_HOP - od->buf_frames;
+                if (n > frames)
+                        n = frames;
+
+                memcpy(&od->buf[(1 + od->buf_frames) * ch], pcm, n * ch * sizeof(int16_t));
+                od->buf_frames += n;
+                pcm += n * ch;
+                frames -= n;
+
+                if (od->buf_frames < TT_ONSET_HOP)
+                        break;
+
+                float nov = hop_novelty(od);
+
+                if (env == NULL)
+                        cnt += pick(od);
+                else if (cnt < cap)
+                        env[cnt++] = nov;
+
+                // The last frame of the hop is differenced against by the next hop
+                memcpy(od->buf, &od->buf[TT_ONSET_HOP * ch], ch * sizeof(int16_t));
+                od->buf_frames = 0;
+        }
+
+        return cnt;
+}
+
+size_t tt_onset_process(tt_onset *od, const int16_t *pcm, size_t frames)
+{
+        return feed(od, pcm, frames, NULL, 0);
+}
+
+size_t tt_onset_envelope(tt_onset *od, const int16_t *pcm, size_t frames, float *env, size_t cap)
+{
+        return feed(od, pcm, frames, env, cap);
+}
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_pool.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the tempo tapper pool allocator
+ *
+ * The following file defines the functions of the tempo tapper pool allocator.
+ *
+ * All function descriptions can be found in the tempo_tapper_pool.h file.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <tempo_tapper_pool.h>
+
+// Released slots store the pointer to the next free slot in their first bytes
+
+static tempo_tapper *get_next_free(tempo_tapper *tapper)
+{
+        tempo_tapper *next;
+        memcpy(&next, tapper, sizeof(next));
+        return next;
+}
+
+static void set_next_free(tempo_tapper *tapper, tempo_tapper *next)
+{
+        memcpy(tapper, &next, sizeof(next));
+}
+
+void tt_pool_init(tt_pool *pool, tempo_tapper *slots, size_t n)
+{
+        pool->slots = slots;
+        pool->cap = n;
+        pool->fresh = 0;
+        pool->used = 0;
+        pool->peak = 0;
+        pool->free_lst = NULL;
+}
+
+tempo_tapper* tt_pool_acquire(tt_pool *pool)
+{
+        tempo_tapper *tapper;
+
+        if (pool->free_lst != NULL) {
+                tapper = pool->free_lst;
+                pool->free_lst = get_next_free(tapper);
+        } else if (pool->fresh < pool->cap) {
+                tapper = &pool->slots[pool->fresh++];
+        } else {
+                return NULL;
+        }
+
+        if (++pool->used > pool->peak)
+                pool->peak = pool->used;
+
+        tt_init(tapper);
+        return tapper;
+}
+
+void tt_pool_release(tt_pool *pool, tempo_tapper *tapper)
+{
+        if (tapper == NULL)
+                return;
+
+        set_next_free(tapper, pool->free_lst);
+        pool->free_lst = tapper;
+        pool->used--;
+}
+
+size_t tt_pool_used(tt_pool *pool)
+{
+        return pool->used;
+}
+
+size_t tt_pool_peak(tt_pool *pool)
+{
+        return pool->peak;
+}
+
+size_t tt_pool_capacity(tt_pool *pool)
+{
+        return pool->cap;
+}
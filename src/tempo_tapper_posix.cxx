@@ -33,34 +33,139 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <time.h>
 #include <sys/time.h>
 
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TT_HAVE_TSC
+#endif
+
 #include <tempo_tapper.h>
 
-void current_time(tt_time_t *time)
+#define S_TO_NS 1000000000ULL
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+// Clock backends
+
+static tt_time_t read_realtime()
 {
-        gettimeofday(time, NULL);
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (tt_time_t) tv.tv_sec * S_TO_NS + (tt_time_t) tv.tv_usec * 1000;
 }
 
-void add_time(tt_time_t *a, tt_time_t *b, tt_time_t *res)
+static tt_time_t read_monotonic()
 {
-        timeradd(a, b, res);
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (tt_time_t) ts.tv_sec * S_TO_NS + ts.tv_nsec;
 }
 
-void sub_time(tt_time_t *a, tt_time_t *b, tt_time_t *res)
+static tt_time_t read_monotonic_raw()
 {
-        timersub(a, b, res);
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return (tt_time_t) ts.tv_sec * S_TO_NS + ts.tv_nsec;
 }
 
-unsigned long time_to_us(tt_time_t *time)
+#ifdef TT_HAVE_TSC
+
+/*
+ * The TSC is converted to nanoseconds relative to a reference point taken
+ * during calibration: ns = ref_ns + ((tsc - ref_tsc) * tsc_mult) >> 32
+ */
+static uint64_t tsc_ref;
+static tt_time_t tsc_ref_ns;
+static uint64_t tsc_mult;
+
+static tt_time_t read_tsc()
 {
-        return (time->tv_sec * S_TO_US + time->tv_usec);
+        unsigned __int128 d = (unsigned __int128) (__rdtsc() - tsc_ref) * tsc_mult;
+        return tsc_ref_ns + (tt_time_t) (d >> 32);
 }
 
-void reset_time(tt_time_t *time)
+static bool tsc_invariant()
+{
+        unsigned int eax, ebx, ecx, edx;
+
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+                return false;
+
+        return edx & (1 << 8); // Invariant TSC flag
+}
+
+static int calibrate_tsc()
+{
+        if (!tsc_invariant())
+                return -1;
+
+        struct timespec delay = {0, 20000000};
+
+        uint64_t tsc_start = __rdtsc();
+        tt_time_t ns_start = read_monotonic_raw();
+        nanosleep(&delay, NULL);
+        uint64_t tsc_end = __rdtsc();
+        tt_time_t ns_end = read_monotonic_raw();
+
+        if (tsc_end <= tsc_start)
+                return -1;
+
+        tsc_mult = ((ns_end - ns_start) << 32) / (tsc_end - tsc_start);
+        tsc_ref = tsc_end;
+        tsc_ref_ns = ns_end;
+        return 0;
+}
+
+#endif
+
+static tt_clock_src clk_src = TT_CLOCK_MONOTONIC_RAW;
+static tt_time_t (*read_clock)() = read_monotonic_raw;
+
+int tt_clock_init(tt_clock_src src)
+{
+        switch (src) {
+        case TT_CLOCK_REALTIME:
+                read_clock = read_realtime;
+                break;
+        case TT_CLOCK_MONOTONIC:
+                read_clock = read_monotonic;
+                break;
+        case TT_CLOCK_MONOTONIC_RAW:
+                read_clock = read_monotonic_raw;
+                break;
+        case TT_CLOCK_TSC:
+#ifdef TT_HAVE_TSC
+                if (calibrate_tsc() < 0)
+                        return -1;
+
+                read_clock = read_tsc;
+                break;
+#else
+                return -1;
+#endif
+        default:
+                return -1;
+        }
+
+        clk_src = src;
+        return 0;
+}
+
+tt_clock_src tt_clock_source()
+{
+        return clk_src;
+}
+
+// Platform specific time functions
+
+void current_time(tt_time_t *time)
 {
-        time->tv_sec = 0;
-        time->tv_usec = 0;
+        *time = read_clock();
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,529 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_registry.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the tempo tapper registry
+ *
+ * The following file defines the functions of the tempo tapper registry.
+ *
+ * Slots are empty, used or evicted. Lookups probe from the home slot of the channel ID
+ * until they find the channel or an empty slot, skipping evicted ones, which are reused
+ * by later insertions. Evicted slots directly in front of an empty slot end no probe
+ * sequence of a used slot, and are turned back into empty slots.
+ *
+ * All function descriptions can be found in the tempo_tapper_registry.h file.
+ */
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <tempo_tapper_registry.h>
+
+#define SLOT_EMPTY 0
+#define SLOT_USED 1
+#define SLOT_EVICTED 2
+
+#define SHARDS_PER_CPU 4
+#define LOCK_SPINS 64   ///< Number of attempts to take a shard lock before the CPU is yielded
+#define BATCH 256       ///< Number of taps sorted by shard at once by tt_registry_tap_batch()
+
+static_assert(TT_REGISTRY_MAX_SHARDS <= 65536, "TT_REGISTRY_MAX_SHARDS must fit into 16 bits");
+
+static size_t pow2_ceil(size_t n)
+{
+        size_t p = 1;
+
+        while (p < n)
+                p <<= 1;
+
+        return p;
+}
+
+// Mixes the channel ID, so that consecutive IDs spread over shards and slots (splitmix64 finalizer)
+static inline uint64_t hash(uint64_t id)
+{
+        id ^= id >> 30;
+        id *= 0xbf58476d1ce4e5b9ULL;
+        id ^= id >> 27;
+        id *= 0x94d049bb133111ebULL;
+        id ^= id >> 31;
+        return id;
+}
+
+static inline tt_registry_shard *shard_of(tt_registry *reg, uint64_t h)
+{
+        return &reg->shards[reg->shard_bits ? h >> (64 - reg->shard_bits) : 0];
+}
+
+static void lock(tt_registry_shard *sh)
+{
+        int spins = 0;
+
+        while (sh->lock.test_and_set(std::memory_order_acquire)) {
+                if (++spins >= LOCK_SPINS) {
+                        sched_yield();
+                        spins = 0;
+                }
+        }
+}
+
+static void unlock(tt_registry_shard *sh)
+{
+        sh->lock.clear(std::memory_order_release);
+}
+
+// Starts and ends writing a slot, see tt_conc's publish()
+static inline void write_begin(tt_registry_slot *slot)
+{
+        slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+}
+
+static inline void write_end(tt_registry_slot *slot)
+{
+        slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Publishes the tempo of a slot, must be called between write_begin() and write_end()
+static void publish(tt_registry_slot *slot)
+{
+        slot->taps.store(slot->tt->taps, std::memory_order_relaxed);
+        slot->period_us.store(tt_period_us(slot->tt), std::memory_order_relaxed);
+        slot->bpm.store(tt_bpm(slot->tt), std::memory_order_relaxed);
+}
+
+// Looks up a channel, may be called without holding the shard lock
+static tt_registry_slot *find(tt_registry *reg, tt_registry_shard *sh, uint64_t id, uint64_t h)
+{
+        size_t p = h & reg->shard_mask;
+
+        for (size_t i = 0; i <= reg->shard_mask; i++, p = (p + 1) & reg->shard_mask) {
+                tt_registry_slot *slot = &sh->slots[p];
+                uint8_t state = slot->state.load(std::memory_order_acquire);
+
+                if (state == SLOT_EMPTY)
+                        return NULL;
+
+                if (state == SLOT_USED && slot->id.load(std::memory_order_relaxed) == id)
+                        return slot;
+        }
+
+        return NULL;
+}
+
+// Evicts a used slot, the shard must be locked
+static void evict(tt_registry *reg, tt_registry_shard *sh, tt_registry_slot *slot)
+{
+        write_begin(slot);
+        slot->state.store(SLOT_EVICTED, std::memory_order_relaxed);
+        write_end(slot);
+
+        tt_pool_release(&sh->pool, slot->tt);
+        slot->tt = NULL;
+        sh->used.fetch_sub(1, std::memory_order_relaxed);
+        sh->evicted++;
+
+        // Evicted slots in front of an empty slot no longer lie within any probe sequence
+        size_t p = slot - sh->slots;
+        if (sh->slots[(p + 1) & reg->shard_mask].state.load(std::memory_order_relaxed) != SLOT_EMPTY)
+                return;
+
+        while (sh->slots[p].state.load(std::memory_order_relaxed) == SLOT_EVICTED) {
+                sh->slots[p].state.store(SLOT_EMPTY, std::memory_order_release);
+                sh->evicted--;
+                p = (p - 1) & reg->shard_mask;
+        }
+}
+
+static inline bool idle(tt_registry *reg, tt_registry_slot *slot, tt_time_t now)
+{
+        tt_time_t lst_t = slot->lst_t.load(std::memory_order_relaxed);
+        return now > lst_t && now - lst_t > reg->idle;
+}
+
+// Evicts the idle channels of a shard, the shard must be locked
+static size_t evict_idle(tt_registry *reg, tt_registry_shard *sh, tt_time_t now)
+{
+        size_t n = 0;
+
+        for (size_t p = 0; p <= reg->shard_mask; p++) {
+                tt_registry_slot *slot = &sh->slots[p];
+
+                if (slot->state.load(std::memory_order_relaxed) == SLOT_USED && idle(reg, slot, now)) {
+                        evict(reg, sh, slot);
+                        n++;
+                }
+        }
+
+        return n;
+}
+
+// Looks up a channel and creates it if it is missing, the shard must be locked
+static tt_registry_slot *find_or_create(tt_registry *reg, tt_registry_shard *sh, uint64_t id, uint64_t h, tt_time_t now)
+{
+        tt_registry_slot *slot = find(reg, sh, id, h);
+
+        if (slot != NULL)
+                return slot;
+
+        if (sh->used.load(std::memory_order_relaxed) >= reg->shard_max &&
+            (reg->idle == 0 || evict_idle(reg, sh, now) == 0))
+                return NULL;
+
+        // The channel is stored in the first evicted or empty slot of its probe sequence
+        size_t p = h & reg->shard_mask;
+        while (sh->slots[p].state.load(std::memory_order_relaxed) == SLOT_USED)
+                p = (p + 1) & reg->shard_mask;
+
+        slot = &sh->slots[p];
+
+        if (slot->state.load(std::memory_order_relaxed) == SLOT_EVICTED)
+                sh->evicted--;
+
+        write_begin(slot);
+        slot->tt = tt_pool_acquire(&sh->pool);
+        *slot->tt = reg->cfg;
+        slot->id.store(id, std::memory_order_relaxed);
+        slot->lst_t.store(now, std::memory_order_relaxed);
+        publish(slot);
+        slot->state.store(SLOT_USED, std::memory_order_release);
+        write_end(slot);
+
+        sh->used.fetch_add(1, std::memory_order_relaxed);
+        return slot;
+}
+
+// Taps a channel, the shard must be locked
+static int tap_locked(tt_registry *reg, tt_registry_shard *sh, uint64_t id, uint64_t h, tt_time_t time)
+{
+        tt_registry_slot *slot = find_or_create(reg, sh, id, h, time);
+
+        // Taps of other threads may have been applied since the clock time was read
+        if (slot == NULL || (slot->tt->taps >= 0 && time < slot->tt->lst_t)) {
+                reg->rejected.fetch_add(1, std::memory_order_relaxed);
+                return -1;
+        }
+
+        write_begin(slot);
+        tt_tap_at(slot->tt, &time);
+        slot->lst_t.store(time, std::memory_order_relaxed);
+        publish(slot);
+        write_end(slot);
+        return 0;
+}
+
+tt_registry* tt_registry_new(size_t capacity, size_t shards, unsigned long idle_us, const tempo_tapper *cfg)
+{
+        if (capacity == 0)
+                return NULL;
+
+        if (shards == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                shards = SHARDS_PER_CPU * (cpus > 0 ? cpus : 1);
+        }
+
+        shards = pow2_ceil(shards < TT_REGISTRY_MAX_SHARDS ? shards : TT_REGISTRY_MAX_SHARDS);
+
+        // Leave headroom for shards that receive more than their share of channels
+        size_t share = (capacity + shards - 1) / shards;
+        size_t shard_max = share + share / 8 + 16;
+        size_t slots = pow2_ceil(shard_max + shard_max / 3);
+
+        tt_registry *reg = (tt_registry *) malloc(sizeof(tt_registry));
+
+        if (reg == NULL)
+                return NULL;
+
+        size_t shard_len = shards * sizeof(tt_registry_shard);
+        size_t slot_len = shards * slots * sizeof(tt_registry_slot);
+
+        if (posix_memalign(&reg->mem, 64, shard_len + slot_len + shards * shard_max * sizeof(tempo_tapper)) != 0) {
+                free(reg);
+                return NULL;
+        }
+
+        reg->shards = (tt_registry_shard *) reg->mem;
+        reg->shard_bits = __builtin_ctzl(shards);
+        reg->shard_mask = slots - 1;
+        reg->shard_max = shard_max;
+        reg->idle = (tt_time_t) idle_us * TT_TICKS_PER_US;
+        reg->rejected.store(0, std::memory_order_relaxed);
+
+        tt_init(&reg->cfg);
+
+        if (cfg != NULL) {
+                tt_set_estimator(&reg->cfg, (tt_estimator) cfg->est);
+                tt_set_window(&reg->cfg, cfg->win_len);
+#ifdef TT_CHANGE
+                tt_set_change_detection(&reg->cfg, cfg->chg_h);
+#endif
+        }
+
+        tt_registry_slot *slot = (tt_registry_slot *) ((char *) reg->mem + shard_len);
+        tempo_tapper *tappers = (tempo_tapper *) ((char *) reg->mem + shard_len + slot_len);
+
+        for (size_t s = 0; s < shards; s++) {
+                tt_registry_shard *sh = &reg->shards[s];
+
+                sh->lock.clear();
+                sh->used.store(0, std::memory_order_relaxed);
+                sh->evicted = 0;
+                sh->slots = slot;
+                tt_pool_init(&sh->pool, &tappers[s * shard_max], shard_max);
+
+                for (size_t p = 0; p < slots; p++, slot++) {
+                        slot->seq.store(0, std::memory_order_relaxed);
+                        slot->state.store(SLOT_EMPTY, std::memory_order_relaxed);
+                        slot->tt = NULL;
+                }
+        }
+
+        return reg;
+}
+
+void tt_registry_free(tt_registry *reg)
+{
+        if (reg == NULL)
+                return;
+
+        free(reg->mem);
+        free(reg);
+}
+
+int tt_registry_tap(tt_registry *reg, uint64_t id)
+{
+        tt_time_t c_time;
+        current_time(&c_time);
+        return tt_registry_tap_at(reg, id, &c_time);
+}
+
+int tt_registry_tap_at(tt_registry *reg, uint64_t id, tt_time_t *time)
+{
+        uint64_t h = hash(id);
+        tt_registry_shard *sh = shard_of(reg, h);
+
+        lock(sh);
+        int ret = tap_locked(reg, sh, id, h, *time);
+        unlock(sh);
+
+        return ret;
+}
+
+size_t tt_registry_tap_batch(tt_registry *reg, const uint64_t *ids, const tt_time_t *times, size_t n)
+{
+        size_t shards = (size_t) 1 << reg->shard_bits;
+        uint64_t h[BATCH];
+        uint16_t shard[BATCH];
+        uint16_t order[BATCH];
+        uint16_t start[TT_REGISTRY_MAX_SHARDS + 1];
+        size_t applied = 0;
+        tt_time_t now;
+
+        if (times == NULL)
+                current_time(&now);
+
+        for (size_t base = 0; base < n; base += BATCH) {
+                size_t cnt = n - base < BATCH ? n - base : BATCH;
+
+                // Stable counting sort of the taps by shard
+                memset(start, 0, (shards + 1) * sizeof(start[0]));
+
+                for (size_t i = 0; i < cnt; i++) {
+                        h[i] = hash(ids[base + i]);
+                        shard[i] = reg->shard_bits ? h[i] >> (64 - reg->shard_bits) : 0;
+                        start[shard[i] + 1]++;
+                }
+
+                for (size_t s = 0; s < shards; s++)
+                        start[s + 1] += start[s];
+
+                for (size_t i = 0; i < cnt; i++)
+                        order[start[shard[i]]++] = i;
+
+                // start[s] now holds the end of the taps of shard s
+                size_t i = 0;
+                while (i < cnt) {
+                        tt_registry_shard *sh = &reg->shards[shard[order[i]]];
+                        size_t end = start[shard[order[i]]];
+
+                        lock(sh);
+                        for (; i < end; i++) {
+                                size_t k = order[i];
+                                if (tap_locked(reg, sh, ids[base + k], h[k], times ? times[base + k] : now) == 0)
+                                        applied++;
+                        }
+                        unlock(sh);
+                }
+        }
+
+        return applied;
+}
+
+int tt_registry_reset(tt_registry *reg, uint64_t id)
+{
+        uint64_t h = hash(id);
+        tt_registry_shard *sh = shard_of(reg, h);
+
+        lock(sh);
+        tt_registry_slot *slot = find(reg, sh, id, h);
+
+        if (slot != NULL) {
+                write_begin(slot);
+                tt_reset(slot->tt);
+                publish(slot);
+                write_end(slot);
+        }
+
+        unlock(sh);
+        return slot != NULL ? 0 : -1;
+}
+
+int tt_registry_remove(tt_registry *reg, uint64_t id)
+{
+        uint64_t h = hash(id);
+        tt_registry_shard *sh = shard_of(reg, h);
+
+        lock(sh);
+        tt_registry_slot *slot = find(reg, sh, id, h);
+
+        if (slot != NULL)
+                evict(reg, sh, slot);
+
+        unlock(sh);
+        return slot != NULL ? 0 : -1;
+}
+
+size_t tt_registry_evict(tt_registry *reg, tt_time_t *now)
+{
+        size_t shards = (size_t) 1 << reg->shard_bits;
+        size_t n = 0;
+        tt_time_t c_time;
+
+        if (reg->idle == 0)
+                return 0;
+
+        if (now == NULL) {
+                current_time(&c_time);
+                now = &c_time;
+        }
+
+        for (size_t s = 0; s < shards; s++) {
+                lock(&reg->shards[s]);
+                n += evict_idle(reg, &reg->shards[s], *now);
+                unlock(&reg->shards[s]);
+        }
+
+        return n;
+}
+
+/*
+ * Reads a slot trough its sequence lock, returns false if the slot
+ * does not hold the channel id, or any channel if any is true.
+ */
+static bool read_slot(tt_registry_slot *slot, uint64_t id, bool any, tt_registry_entry *entry)
+{
+        unsigned seq0, seq1;
+        uint8_t state;
+
+        do {
+                seq0 = slot->seq.load(std::memory_order_acquire);
+
+                state = slot->state.load(std::memory_order_relaxed);
+                entry->id = slot->id.load(std::memory_order_relaxed);
+                entry->taps = slot->taps.load(std::memory_order_relaxed);
+                entry->period_us = slot->period_us.load(std::memory_order_relaxed);
+                entry->bpm = slot->bpm.load(std::memory_order_relaxed);
+                entry->lst_t = slot->lst_t.load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                seq1 = slot->seq.load(std::memory_order_relaxed);
+        } while (seq0 != seq1 || (seq0 & 1));
+
+        return state == SLOT_USED && (any || entry->id == id);
+}
+
+int tt_registry_read(tt_registry *reg, uint64_t id, tt_registry_entry *entry)
+{
+        uint64_t h = hash(id);
+        tt_registry_shard *sh = shard_of(reg, h);
+
+        // The slot may be evicted and reused between the lookup and the read
+        while (1) {
+                tt_registry_slot *slot = find(reg, sh, id, h);
+
+                if (slot == NULL)
+                        return -1;
+
+                if (read_slot(slot, id, false, entry))
+                        return 0;
+        }
+}
+
+BPM_t tt_registry_bpm(tt_registry *reg, uint64_t id)
+{
+        tt_registry_entry entry;
+        return tt_registry_read(reg, id, &entry) == 0 ? entry.bpm : 0;
+}
+
+size_t tt_registry_read_all(tt_registry *reg, tt_registry_entry *entries, size_t max)
+{
+        size_t shards = (size_t) 1 << reg->shard_bits;
+        size_t n = 0;
+
+        for (size_t s = 0; s < shards; s++) {
+                tt_registry_shard *sh = &reg->shards[s];
+
+                for (size_t p = 0; p <= reg->shard_mask && n < max; p++) {
+                        if (sh->slots[p].state.load(std::memory_order_relaxed) != SLOT_USED)
+                                continue;
+
+                        if (read_slot(&sh->slots[p], 0, true, &entries[n]))
+                                n++;
+                }
+        }
+
+        return n;
+}
+
+size_t tt_registry_count(tt_registry *reg)
+{
+        size_t shards = (size_t) 1 << reg->shard_bits;
+        size_t n = 0;
+
+        for (size_t s = 0; s < shards; s++)
+                n += reg->shards[s].used.load(std::memory_order_relaxed);
+
+        return n;
+}
+
+unsigned long tt_registry_rejected(tt_registry *reg)
+{
+        return reg->rejected.load(std::memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2021  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file tempo_tapper_snap.cxx
+ * @author Patrick Pedersen
+ * @date 2021-08-05
+ *
+ * @brief Defines the snapshot functions
+ *
+ * The following file defines the functions to encode, decode, save and restore
+ * snapshots. Fields are converted from and to little-endian on big-endian hosts only.
+ *
+ * All function descriptions can be found in the tempo_tapper_snap.h file.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <tempo_tapper_snap.h>
+#include <tempo_tapper_tpl.h>
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define CHUNK_RECORDS 1024      ///< Records encoded per write
+
+static_assert(sizeof(tt_snap_header) == 32, "tt_snap_header must be 32 bytes");
+static_assert(sizeof(tt_snap_record) == 32, "tt_snap_record must be 32 bytes");
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static inline uint16_t le16(uint16_t v) { return __builtin_bswap16(v); }
+static inline uint32_t le32(uint32_t v) { return __builtin_bswap32(v); }
+static inline uint64_t le64(uint64_t v) { return __builtin_bswap64(v); }
+#else
+static inline uint16_t le16(uint16_t v) { return v; }
+static inline uint32_t le32(uint32_t v) { return v; }
+static inline uint64_t le64(uint64_t v) { return v; }
+#endif
+
+// Converts clock ticks of a snapshot to ticks of current_time()
+static tt_time_t to_ticks(uint64_t v, uint32_t ticks_per_us)
+{
+        if (ticks_per_us > TT_TICKS_PER_US)
+                return v / (ticks_per_us / TT_TICKS_PER_US);
+
+        return v * (TT_TICKS_PER_US / ticks_per_us);
+}
+
+void tt_snap_header_init(tt_snap_header *hdr, uint64_t count)
+{
+        memcpy(hdr->magic, TT_SNAP_MAGIC, sizeof(hdr->magic));
+        hdr->version = le16(TT_SNAP_VERSION);
+        hdr->record_size = le16(sizeof(tt_snap_record));
+        hdr->ticks_per_us = le32(TT_TICKS_PER_US);
+        hdr->reserved = 0;
+        hdr->count = le64(count);
+        hdr->reserved2 = 0;
+}
+
+int tt_snap_header_check(const tt_snap_header *hdr)
+{
+        uint32_t tpu = le32(hdr->ticks_per_us);
+
+        if (memcmp(hdr->magic, TT_SNAP_MAGIC, sizeof(hdr->magic)) != 0 ||
+            le16(hdr->version) != TT_SNAP_VERSION ||
+            le16(hdr->record_size) != sizeof(tt_snap_record))
+                return -1;
+
+        // One tick length must be a multiple of the other
+        if (tpu == 0 || (tpu > TT_TICKS_PER_US ? tpu % TT_TICKS_PER_US : TT_TICKS_PER_US % tpu) != 0)
+                return -1;
+
+        return 0;
+}
+
+void tt_snap_encode(tempo_tapper *tapper, tt_snap_record *rec)
+{
+        int64_t phase = 0;
+        uint32_t chg_h = 0;
+
+#ifdef TT_KALMAN
+        if (tapper->est == TT_EST_KALMAN) {
+                phase = tapper->kf_e;
+
+                if (phase > INT32_MAX)
+                        phase = INT32_MAX;
+                else if (phase < INT32_MIN)
+                        phase = INT32_MIN;
+        }
+#endif
+
+#ifdef TT_CHANGE
+        memcpy(&chg_h, &tapper->chg_h, sizeof(chg_h));
+#endif
+
+        rec->lst_t = le64(tapper->lst_t);
+        rec->period = le64(tt::runtime_estimator::period(*tapper));
+        rec->phase = (int32_t) le32((uint32_t) phase);
+        rec->taps = (int32_t) le32((uint32_t) tapper->taps);
+        rec->win_len = le16(tapper->win_len);
+        rec->est = tapper->est;
+        rec->reserved = 0;
+        rec->chg_h = le32(chg_h);
+}
+
+#ifdef TT_KALMAN
+
+// Number of intervals the Kalman filter is refitted to, only their mean without the ring buffer
+#define KF_REFIT (TT_WINDOW_CAP > 0 ? TT_WINDOW_CAP : 1)
+
+// Kalman filter state, as held by the tempo_tapper struct
+struct kf_state
+{
+        int64_t kf_e;
+        tt_time_t kf_p;
+        tt_kf_t kf_p00;
+        tt_kf_t kf_p01;
+        tt_kf_t kf_p11;
+};
+
+/*
+ * Returns the Kalman filter covariance after n intervals, which does not depend on
+ * the intervals themselves, so it is computed once for all restored tempo tappers
+ */
+static const kf_state &kf_steady(unsigned int n)
+{
+        struct table {
+                kf_state after[KF_REFIT + 1];
+
+                table()
+                {
+                        kf_state s;
+                        tt::detail::kf_reset(s);
+                        after[0] = s;
+
+                        for (unsigned int k = 1; k <= KF_REFIT; k++) {
+                                tt::detail::kf_push(s, (tt_time_t) 1);
+                                after[k] = s;
+                        }
+                }
+        };
+
+        static const table t;
+        return t.after[n];
+}
+
+#endif
+
+int tt_snap_decode(tempo_tapper *tapper, const tt_snap_record *rec, uint32_t ticks_per_us)
+{
+        uint32_t chg_bits = le32(rec->chg_h);
+        uint16_t win_len = le16(rec->win_len);
+        int32_t taps = (int32_t) le32((uint32_t) rec->taps);
+        float chg_h;
+
+        memcpy(&chg_h, &chg_bits, sizeof(chg_h));
+
+        // Records can only be restored with estimators that are compiled in
+        if (!tt::runtime_estimator::available(rec->est) || win_len > TT_WINDOW_CAP || !(chg_h >= 0) || isinf(chg_h) || taps < -1)
+                return -1;
+
+#ifndef TT_CHANGE
+        // The change detection is not compiled in, so it cannot be restored
+        if (chg_h != 0)
+                return -1;
+#endif
+
+        tt_init(tapper);
+        tapper->est = rec->est;
+        tapper->win_len = win_len;
+#ifdef TT_CHANGE
+        tapper->chg_h = chg_h;
+#endif
+        tapper->lst_t = to_ticks(le64(rec->lst_t), ticks_per_us);
+
+        if (taps < 1) {
+                tapper->taps = taps;
+                return 0;
+        }
+
+        // The intervals are restored as if they had all been equal to the period
+        tt_time_t prd = to_ticks(le64(rec->period), ticks_per_us);
+
+#if TT_WINDOW_CAP > 0
+        unsigned int n = taps < TT_WINDOW_CAP ? taps : TT_WINDOW_CAP;
+
+        for (unsigned int k = 0; k < n; k++)
+                tapper->ring[k] = prd;
+
+        tapper->ring_head = n % TT_WINDOW_CAP;
+        tapper->ring_cnt = n;
+
+        if (win_len > 0)
+                tapper->win_sum = prd * (n < win_len ? n : win_len);
+
+#ifdef TT_MEDIAN
+        if (tapper->est == TT_EST_MEDIAN) {
+                tapper->srt_cnt = n < tt::runtime_estimator::med_len(*tapper) ? n : tt::runtime_estimator::med_len(*tapper);
+
+                for (unsigned int k = 0; k < tapper->srt_cnt; k++)
+                        tapper->srt[k] = prd;
+        }
+#endif
+#endif
+
+#ifdef TT_KALMAN
+        if (tapper->est == TT_EST_KALMAN) {
+                const kf_state &cov = kf_steady(taps < KF_REFIT ? taps : KF_REFIT);
+                int32_t phase = (int32_t) le32((uint32_t) rec->phase);
+
+                tapper->kf_e = ticks_per_us > TT_TICKS_PER_US ? phase / (int32_t) (ticks_per_us / TT_TICKS_PER_US)
+                                                              : (int64_t) phase * (TT_TICKS_PER_US / ticks_per_us);
+                tapper->kf_p = prd > 0 ? prd : 1;
+                tapper->kf_p00 = cov.kf_p00;
+                tapper->kf_p01 = cov.kf_p01;
+                tapper->kf_p11 = cov.kf_p11;
+        }
+#endif
+
+        tapper->prd_sum = prd * taps;
+        tapper->taps = taps;
+        tt::detail::invalidate(*tapper);
+        return 0;
+}
+
+BPM_t tt_snap_bpm(const tt_snap_record *rec, uint32_t ticks_per_us)
+{
+        unsigned long us = (unsigned long) (to_ticks(le64(rec->period), ticks_per_us) / TT_TICKS_PER_US);
+
+        if ((int32_t) le32((uint32_t) rec->taps) < 1 || us == 0)
+                return 0;
+
+        return (60 * S_TO_US)/(BPM_t)us;
+}
+
+#ifdef TT_TARGET_PLATFORM_POSIX
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+        const char *p = (const char *) buf;
+
+        while (len > 0) {
+                ssize_t w = write(fd, p, len);
+
+                if (w < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -1;
+                }
+
+                p += w;
+                len -= w;
+        }
+
+        return 0;
+}
+
+int tt_snap_save(const char *path, tempo_tapper *tappers, size_t n)
+{
+        tt_snap_record chunk[CHUNK_RECORDS];
+        tt_snap_header hdr;
+        char tmp[4096];
+
+        if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int) sizeof(tmp)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+                return -1;
+
+        tt_snap_header_init(&hdr, n);
+
+        if (write_all(fd, &hdr, sizeof(hdr)) < 0)
+                goto fail;
+
+        for (size_t i = 0; i < n; i += CHUNK_RECORDS) {
+                size_t cnt = n - i < CHUNK_RECORDS ? n - i : CHUNK_RECORDS;
+
+                for (size_t k = 0; k < cnt; k++)
+                        tt_snap_encode(&tappers[i + k], &chunk[k]);
+
+                if (write_all(fd, chunk, cnt * sizeof(tt_snap_record)) < 0)
+                        goto fail;
+        }
+
+        if (close(fd) < 0) {
+                unlink(tmp);
+                return -1;
+        }
+
+        if (rename(tmp, path) < 0) {
+                int err = errno;
+                unlink(tmp);
+                errno = err;
+                return -1;
+        }
+
+        return 0;
+
+fail:
+        int err = errno;
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+}
+
+int tt_snap_open(tt_snap *snap, const char *path)
+{
+        struct stat st;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+                return -1;
+
+        if (fstat(fd, &st) < 0) {
+                int err = errno;
+                close(fd);
+                errno = err;
+                return -1;
+        }
+
+        if ((size_t) st.st_size < sizeof(tt_snap_header)) {
+                close(fd);
+                errno = EINVAL;
+                return -1;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        int err = errno;
+        close(fd);
+
+        if (map == MAP_FAILED) {
+                errno = err;
+                return -1;
+        }
+
+        const tt_snap_header *hdr = (const tt_snap_header *) map;
+        uint64_t count = le64(hdr->count);
+
+        if (tt_snap_header_check(hdr) < 0 ||
+            count > ((size_t) st.st_size - sizeof(tt_snap_header)) / sizeof(tt_snap_record)) {
+                munmap(map, st.st_size);
+                errno = EINVAL;
+                return -1;
+        }
+
+        // Records are read sequentially when restoring whole arrays
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+        snap->map = map;
+        snap->map_len = st.st_size;
+        snap->records = (const tt_snap_record *) (hdr + 1);
+        snap->count = count;
+        snap->ticks_per_us = le32(hdr->ticks_per_us);
+        return 0;
+}
+
+int tt_snap_restore(const tt_snap *snap, size_t i, tempo_tapper *tapper)
+{
+        if (i >= snap->count)
+                return -1;
+
+        return tt_snap_decode(tapper, &snap->records[i], snap->ticks_per_us);
+}
+
+size_t tt_snap_restore_all(const tt_snap *snap, tempo_tapper *tappers, size_t n)
+{
+        size_t restored = 0;
+
+        if (n > snap->count)
+                n = snap->count;
+
+        for (size_t i = 0; i < n; i++) {
+                if (tt_snap_decode(&tappers[i], &snap->records[i], snap->ticks_per_us) == 0)
+                        restored++;
+                else
+                        tt_init(&tappers[i]);
+        }
+
+        return restored;
+}
+
+void tt_snap_close(tt_snap *snap)
+{
+        munmap(snap->map, snap->map_len);
+        snap->map = NULL;
+        snap->records = NULL;
+        snap->count = 0;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#!/bin/bash
+
+#
+# Copyright (C) 2021  Patrick Pedersen
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+# 
+# Author: Patrick Pedersen <ctx.xda@gmail.com>
+# Brief description: Script to build and run the hot path microbenchmarks
+# Detailed description:
+#       The following script builds examples/posix/hotpath_bench_posix.cxx
+#       with optimizations, runs it and stores its JSON results in the file
+#       passed as first argument, or in bench-<revision>.json if none is
+#       given, so that results of different releases can be compared.
+#       Any further arguments are passed to the benchmark, ex. -n 1000000.
+#
+#       The compiler and flags can be overridden trough the CXX and
+#       CXXFLAGS environment variables.
+
+CXX="${CXX:-g++}"
+CXXFLAGS="${CXXFLAGS:--O2}"
+
+### MAIN ###
+
+# cd into project root
+DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" &> /dev/null && pwd )"
+PROJECT_ROOT="$DIR/.."
+cd "$PROJECT_ROOT"
+
+REV="$(git describe --always --dirty 2> /dev/null || echo unknown)"
+OUT="${1:-bench-$REV.json}"
+shift
+
+$CXX $CXXFLAGS -D TT_TARGET_PLATFORM_POSIX -I include/ \
+        examples/posix/hotpath_bench_posix.cxx \
+        src/tempo_tapper_common.cxx \
+        src/tempo_tapper_posix.cxx \
+        -o examples/posix/hotpath_bench || exit 1
+
+./examples/posix/hotpath_bench -o "$OUT" "$@" || exit 1
+
+echo "makebench: Results written to $OUT"